@@ -20,11 +20,91 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <algorithm>
 #include <sstream>
+#include <string>
+#include <vector>
 #include <sys/stat.h>
 #include <time.h>
 #include <hdf5.h>
 #include <hdf5_hl.h>
+#include <sample_storage.h>
+
+// Chunks of the Channel Data made from the columnar layout hold this many
+// samples of one channel, which is also how much is copied at a time
+#define COLUMN_CHUNK_ROWS 65536
+
+// Turn the Channel Columns of a trial into the same 2-D Channel Data as the
+// row layout gets, chunked along time for each channel so that reading one
+// channel still only reads its own chunks
+static void convert_columns(hid_t fid, const std::string &sync) {
+	std::vector<hid_t> columns;
+	for (int i = 1;; ++i) {
+		std::stringstream column_name;
+		column_name << sync << "/Channel Columns/" << i;
+		hid_t column = H5Dopen(fid, column_name.str().c_str(), H5P_DEFAULT);
+		if (column < 0)
+			break;
+		columns.push_back(column);
+	}
+	if (columns.empty())
+		return;
+
+	// A recording that was cut short can have more rows in the first columns
+	hsize_t rows = 0;
+	for (size_t i = 0; i < columns.size(); ++i) {
+		hid_t space = H5Dget_space(columns[i]);
+		hsize_t n;
+		H5Sget_simple_extent_dims(space, &n, NULL);
+		H5Sclose(space);
+		rows = i ? std::min(rows, n) : n;
+	}
+
+	hsize_t cols = columns.size();
+	hsize_t dims[] = { rows, cols };
+	hsize_t chunk[] = { std::min(rows, static_cast<hsize_t>(COLUMN_CHUNK_ROWS)), 1 };
+	hid_t space = H5Screate_simple(2, dims, dims);
+	hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+	if (rows)
+		H5Pset_chunk(plist, 2, chunk);
+	std::string data_name = sync + "/Channel Data";
+	hid_t table = H5Dcreate(fid, data_name.c_str(), H5T_IEEE_F64LE, space,
+			H5P_DEFAULT, plist, H5P_DEFAULT);
+	H5Pclose(plist);
+
+	std::vector<double> data(COLUMN_CHUNK_ROWS);
+	for (hsize_t c = 0; c < cols; ++c) {
+		// Narrower columns are converted by HDF5, only Int16 is scaled
+		SampleStorage::layout_t layout;
+		if (SampleStorage::readAttributes(columns[c], layout))
+			layout.narrow = false;
+
+		hid_t column_space = H5Dget_space(columns[c]);
+		hsize_t start = 0;
+		while (start < rows) {
+			hsize_t count = std::min(rows - start, static_cast<hsize_t>(COLUMN_CHUNK_ROWS));
+			hid_t data_space = H5Screate_simple(1, &count, NULL);
+			H5Sselect_hyperslab(column_space, H5S_SELECT_SET, &start, NULL, &count, NULL);
+			H5Dread(columns[c], H5T_NATIVE_DOUBLE, data_space, column_space, H5P_DEFAULT, &data[0]);
+			if (layout.narrow)
+				for (hsize_t i = 0; i < count; ++i)
+					data[i] = data[i] * layout.columns[0].scale + layout.columns[0].offset;
+
+			hsize_t offset[] = { start, c };
+			hsize_t size[] = { count, 1 };
+			H5Sselect_hyperslab(space, H5S_SELECT_SET, offset, NULL, size, NULL);
+			H5Dwrite(table, H5T_NATIVE_DOUBLE, data_space, space, H5P_DEFAULT, &data[0]);
+			H5Sclose(data_space);
+			start += count;
+		}
+		H5Sclose(column_space);
+		H5Dclose(columns[c]);
+	}
+
+	H5Sclose(space);
+	H5Dclose(table);
+	H5Ldelete(fid, (sync + "/Channel Columns").c_str(), H5P_DEFAULT);
+}
 
 int main(int argc, char *argv[]) {
 
@@ -68,6 +148,9 @@ int main(int argc, char *argv[]) {
 	while (H5Gget_info_by_name(fid, trial_name.str().c_str(), &junk,
 			H5P_DEFAULT) >= 0) {
 
+		// the columnar layout is converted directly, and skipped below
+		convert_columns(fid, trial_name.str() + "/Synchronous Data");
+
 		// determine the dimension of the data
 		trial_name << "/Synchronous Data/Channel Data";
 		hid_t table = H5Dopen(fid, trial_name.str().c_str(), H5P_DEFAULT);
@@ -84,7 +167,11 @@ int main(int argc, char *argv[]) {
 				continue;
 			}
 
-			hsize_t cols = H5Tget_size(type) / sizeof(double);
+			// Channels stored narrower than doubles are turned back into them
+			SampleStorage::layout_t layout;
+			if (SampleStorage::readAttributes(table, layout))
+				layout.narrow = false;
+			hsize_t cols = layout.narrow ? layout.columns.size() : H5Tget_size(type) / sizeof(double);
 			H5Dclose(type);
 			H5Dclose(table);
 
@@ -93,10 +180,15 @@ int main(int argc, char *argv[]) {
 			H5PTget_num_packets(table, &rows);
 
 			lseek(tmpfd, SEEK_SET, 0);
+			std::vector<char> packed(layout.narrow ? layout.size : 0);
 			for (int i = 0; i < rows; ++i) {
 				double data[cols];
 
-				H5PTget_next(table, 1, data);
+				if (layout.narrow) {
+					H5PTget_next(table, 1, &packed[0]);
+					SampleStorage::unpack(layout, &packed[0], 1, data);
+				} else
+					H5PTget_next(table, 1, data);
 				write(tmpfd, data, sizeof(data));
 			}
 
@@ -156,7 +248,11 @@ int main(int argc, char *argv[]) {
 				continue;
 			}
 
-			hsize_t cols = H5Tget_size(type) / sizeof(double);
+			// Channels stored narrower than doubles are turned back into them
+			SampleStorage::layout_t layout;
+			if (SampleStorage::readAttributes(table, layout))
+				layout.narrow = false;
+			hsize_t cols = layout.narrow ? layout.columns.size() : H5Tget_size(type) / sizeof(double);
 			H5Dclose(type);
 			H5Dclose(table);
 
@@ -165,10 +261,15 @@ int main(int argc, char *argv[]) {
 			H5PTget_num_packets(table, &rows);
 
 			lseek(tmpfd, SEEK_SET, 0);
+			std::vector<char> packed(layout.narrow ? layout.size : 0);
 			for (int i = 0; i < rows; ++i) {
 				double data[cols];
 
-				H5PTget_next(table, 1, data);
+				if (layout.narrow) {
+					H5PTget_next(table, 1, &packed[0]);
+					SampleStorage::unpack(layout, &packed[0], 1, data);
+				} else
+					H5PTget_next(table, 1, data);
 				write(tmpfd, data, sizeof(data));
 			}
 
@@ -16,6 +16,7 @@
 
  */
 
+#include <climits>
 #include <cstdlib>
 #include <errno.h>
 #include <getopt.h>
@@ -23,13 +24,33 @@
 
 #include <hdf5.h>
 #include <hdf5_hl.h>
+#include <sample_storage.h>
 
+#include <algorithm>
+#include <fstream>
 #include <sstream>
 #include <string>
 #include <unistd.h>
+#include <vector>
+
+// How often a followed trial is checked for new rows, in microseconds
+#define FOLLOW_INTERVAL 100000
+
+// Rows read from the file at once
+#define READ_BLOCK_ROWS 4096
+
+// Tick times are rebuilt this many at a time, from the time of the first
+// tick of the block
+#define STAMP_BLOCK_TICKS 65536
+
+// Gaps listed by --info
+#define STAMP_MAX_GAPS 10
 
 struct options {
     int info;
+    int follow;
+    int timestamps;
+    int group;
     int trial;
     int binary;
     int cols_start;
@@ -41,11 +62,65 @@ struct options {
     char *filename;
 };
 
+// A file of a rotated recording, as listed by its manifest
+struct segment_t {
+    std::string name;
+    int first;
+    int continued;
+};
+
+struct stamp_exception_t {
+    long long tick;
+    long long time;
+};
+
+// Tick times of a trial in one file. The recorder stores the jitter of each
+// tick against the tick before and the period, and the times the jitter
+// can't hold, like the first one or those after a gap, as exceptions
+struct timestamps_t {
+    hid_t jitter;
+    long long period;
+    long long downsample;
+    hsize_t ticks;
+    std::vector<stamp_exception_t> exceptions;
+    std::vector<long long> checkpoints;
+    std::vector<std::pair<hsize_t,hsize_t> > gaps;
+    hsize_t lost;
+    hsize_t late;
+    long long max_jitter;
+    hsize_t block;
+    std::vector<long long> times;
+};
+
+// Channel Data of a trial in one file. Rows of every channel are one
+// dataset, the columnar layout has a dataset per channel instead. Channels
+// stored narrower than doubles have a layout that turns them back
+struct part_t {
+    hid_t data;
+    SampleStorage::layout_t layout;
+    std::vector<hid_t> columns;
+    std::vector<SampleStorage::layout_t> layouts;
+    hsize_t offset;
+    timestamps_t stamps;
+};
+
 int getopts(int,char *[],struct options *);
+int read_manifest(const char *,std::vector<segment_t> &);
 void print_trial_info(hid_t,int);
+void print_row(const double *,const long long *,const struct options &);
+int open_channel_data(hid_t,int,struct part_t &,hsize_t &);
+hsize_t count_rows(const struct part_t &,int);
+void read_rows(const struct part_t &,hsize_t,hsize_t,hsize_t,hsize_t,const struct options &,double *);
+void close_channel_data(struct part_t &);
+int open_timestamps(hid_t,struct timestamps_t &);
+long long tick_time(struct timestamps_t &,hsize_t);
+int follow_trial(const char *,std::vector<segment_t> &,std::vector<hid_t> &,size_t,hsize_t,hsize_t,hsize_t,const struct options &);
 
 int main(int argc,char *argv[]) {
     struct options opts = {
+        0,
+        0,
+        0,
         0,
         1,
         0,
@@ -62,49 +137,115 @@ int main(int argc,char *argv[]) {
 
     H5Eset_auto2(H5E_DEFAULT,NULL,NULL);
 
-    hid_t fid = H5Fopen(opts.filename,H5F_ACC_RDONLY,H5P_DEFAULT);
-    if(fid < 0) {
-        fprintf(stderr,"Failed to open %s.\n",opts.filename);
-        return fid;
+    // A manifest stands for the files of a rotated recording, a single file
+    // is its only segment
+    std::vector<segment_t> segments;
+    std::string filename = opts.filename;
+    const char *manifest = NULL;
+    if(filename.size() > 9 && filename.substr(filename.size()-9) == ".manifest") {
+        manifest = opts.filename;
+        if(read_manifest(opts.filename,segments))
+            return -EINVAL;
+    } else {
+        segment_t segment = { filename, 1, 0, };
+        segments.push_back(segment);
+    }
+
+    // Files that are still being written can only be read in SWMR mode, and
+    // only if the recorder created them for it
+    unsigned flags = opts.follow ? H5F_ACC_RDONLY|H5F_ACC_SWMR_READ : H5F_ACC_RDONLY;
+    std::vector<hid_t> fids;
+    for(size_t i = 0;i < segments.size();++i) {
+        hid_t fid = H5Fopen(segments[i].name.c_str(),flags,H5P_DEFAULT);
+        if(fid < 0 && !opts.follow)
+            fid = H5Fopen(segments[i].name.c_str(),H5F_ACC_RDONLY|H5F_ACC_SWMR_READ,H5P_DEFAULT);
+        if(fid < 0) {
+            if(opts.follow)
+                fprintf(stderr,"Failed to open %s, only files recorded with SWMR can be followed.\n",segments[i].name.c_str());
+            else
+                fprintf(stderr,"Failed to open %s.\n",segments[i].name.c_str());
+            return fid;
+        }
+        fids.push_back(fid);
     }
 
     if(opts.info) {
-        // count the number of trials in the file        
+        // count the number of trials in each file
         hid_t trial;
-        int num_trials = 0;
         std::stringstream trial_name;
 
-        for(;;) {
-            trial_name.str("");
-            trial_name << "/Trial" << num_trials+1;
+        for(size_t i = 0;i < segments.size();++i) {
+            if(segments.size() > 1)
+                printf("%s\n\n",segments[i].name.c_str());
 
-            if((trial = H5Gopen(fid,trial_name.str().c_str(),H5P_DEFAULT)) < 0)
-                break;
-            else {
-                print_trial_info(trial,++num_trials);
-                H5Gclose(trial);
+            for(int num_trial = 1;;++num_trial) {
+                trial_name.str("");
+                trial_name << "/Trial" << num_trial;
+
+                if((trial = H5Gopen(fids[i],trial_name.str().c_str(),H5P_DEFAULT)) < 0)
+                    break;
+                else {
+                    if(num_trial == 1 && segments[i].continued)
+                        printf("Trial #%d continues from the previous file.\n",segments[i].first);
+                    print_trial_info(trial,segments[i].first+num_trial-1);
+                    H5Gclose(trial);
+                }
             }
+            H5Fclose(fids[i]);
         }
 
-        H5Fclose(fid);
         return 0;
     }
 
-    std::stringstream data_name;
-    data_name << "/Trial" << opts.trial << "/Synchronous Data/Channel Data";
+    // A trial split by rotation has a part in each file it spans, their rows
+    // are read as one table
+    std::vector<part_t> parts;
+    size_t last = 0;
+    hsize_t ncols = 0;
+    hsize_t nrows = 0;
+    for(size_t i = 0;i < segments.size();++i) {
+        int local = opts.trial-segments[i].first+1;
+        if(local < 1)
+            continue;
 
-    hid_t table = H5Dopen(fid,data_name.str().c_str(),H5P_DEFAULT);
-    if(table < 0) {
-        fprintf(stderr,"Requested trial #%d does not exist.\n",opts.trial);
-        return table;
+        std::stringstream trial_name;
+        trial_name << "/Trial" << local;
+
+        hid_t trial = H5Gopen(fids[i],trial_name.str().c_str(),H5P_DEFAULT);
+        if(trial < 0)
+            continue;
+        part_t part;
+        int failed = open_channel_data(trial,opts.group,part,ncols);
+        if(!failed && opts.timestamps && open_timestamps(trial,part.stamps)) {
+            fprintf(stderr,"Trial #%d was recorded without timestamps.\n",opts.trial);
+            return -EINVAL;
+        }
+        if(opts.group)
+            part.stamps.downsample = opts.group;
+        H5Gclose(trial);
+        if(failed)
+            continue;
+
+        part.offset = nrows;
+        parts.push_back(part);
+        nrows += count_rows(part,0);
+        last = i;
     }
 
-    hsize_t ncols = H5Tget_size(H5Dget_type(table))/sizeof(double);
-    H5Dclose(table);
+    if(parts.empty() && opts.group) {
+        fprintf(stderr,"Requested trial #%d has no channels at rate %d.\n",opts.trial,opts.group);
+        return -EINVAL;
+    } else if(parts.empty()) {
+        fprintf(stderr,"Requested trial #%d does not exist.\n",opts.trial);
+        return -EINVAL;
+    }
 
-    table = H5PTopen(fid,data_name.str().c_str());
-    hsize_t nrows;
-    H5PTget_num_packets(table,&nrows);
+    // Only an open-ended row range is followed, from where it starts or
+    // after the rows already printed
+    int follow = opts.follow && opts.rows_end == -1 && opts.rows_step > 0;
+    int follow_step = opts.rows_step;
+    hsize_t next_row = opts.rows_start;
+    int skip = follow && static_cast<hsize_t>(opts.rows_start) >= nrows;
 
     // validate column and row ranges
     if(opts.cols_end == -1 || opts.cols_end >= ncols)
@@ -118,37 +259,93 @@ int main(int argc,char *argv[]) {
     if((opts.rows_start-opts.rows_end)*opts.rows_step > 0)
         opts.rows_step *= -1;
 
-    int row_idx = opts.rows_start;
-    do {
-
-        H5PTset_index(table,row_idx);
-
-        double data[ncols];
-        H5PTget_next(table,1,data);
+    // Rows are read a block of steps at a time, in the columnar layout only
+    // the columns that are printed are read
+    std::vector<double> block(READ_BLOCK_ROWS*ncols);
+    size_t block_part = parts.size();
+    hsize_t block_start = 0;
+    hsize_t block_count = 0;
+    hsize_t stride = std::abs(opts.rows_step);
 
-        int col_idx = opts.cols_start;
-        do {
-            if(opts.binary) {
-                write(1,data+col_idx,sizeof(double));
+    int row_idx = opts.rows_start;
+    if(!skip) do {
+
+        size_t part = parts.size()-1;
+        while(parts[part].offset > static_cast<hsize_t>(row_idx))
+            --part;
+        hsize_t local = row_idx-parts[part].offset;
+
+        if(part != block_part || local < block_start || local >= block_start+block_count*stride) {
+            hsize_t rows = (part+1 < parts.size() ? parts[part+1].offset : nrows)-parts[part].offset;
+            if(opts.rows_step > 0) {
+                block_count = std::min<hsize_t>(READ_BLOCK_ROWS,(rows-1-local)/stride+1);
+                block_start = local;
             } else {
-                printf("%e ",data[col_idx]);
+                block_count = std::min<hsize_t>(READ_BLOCK_ROWS,local/stride+1);
+                block_start = local-(block_count-1)*stride;
             }
+            read_rows(parts[part],block_start,stride,block_count,ncols,opts,&block[0]);
+            block_part = part;
+        }
 
-            if(col_idx == opts.cols_end)
-                break;
-            col_idx += opts.cols_step;
-        } while(1);
-
-        if(!opts.binary)
-            printf("\n");
+        // Row k lines up with tick k*downsample
+        long long time = 0;
+        if(opts.timestamps)
+            time = tick_time(parts[part].stamps,local*parts[part].stamps.downsample);
+        print_row(&block[(local-block_start)/stride*ncols],opts.timestamps ? &time : NULL,opts);
 
-        if(row_idx == opts.rows_end)
+        if(row_idx == opts.rows_end) {
+            next_row = row_idx+opts.rows_step;
             break;
+        }
         row_idx += opts.rows_step;
     } while(1);
 
-    H5PTclose(table);
-    H5Fclose(fid);
+    hsize_t follow_offset = parts.back().offset;
+    for(size_t i = 0;i < parts.size();++i)
+        close_channel_data(parts[i]);
+
+    if(follow) {
+        opts.rows_step = follow_step;
+        fflush(stdout);
+        follow_trial(manifest,segments,fids,last,follow_offset,ncols,next_row,opts);
+    }
+    for(size_t i = 0;i < fids.size();++i)
+        H5Fclose(fids[i]);
+
+    return 0;
+}
+
+int read_manifest(const char *filename,std::vector<segment_t> &segments) {
+    std::ifstream manifest(filename);
+    if(!manifest) {
+        fprintf(stderr,"Failed to open %s.\n",filename);
+        return -EINVAL;
+    }
+
+    // Segment names are relative to the manifest
+    std::string dir = filename;
+    dir = dir.find('/') == std::string::npos ? "" : dir.substr(0,dir.rfind('/')+1);
+
+    std::string line;
+    while(std::getline(manifest,line)) {
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        segment_t segment;
+        if(!std::getline(fields,segment.name,'\t') || !(fields >> segment.first >> segment.continued)) {
+            fprintf(stderr,"Invalid line in %s: \"%s\".\n",filename,line.c_str());
+            return -EINVAL;
+        }
+        segment.name = dir+segment.name;
+        segments.push_back(segment);
+    }
+
+    if(segments.empty()) {
+        fprintf(stderr,"%s lists no files.\n",filename);
+        return -EINVAL;
+    }
 
     return 0;
 }
@@ -222,14 +419,17 @@ int getopts(int argc,char *argv[],struct options *options) {
         {"ascii", 0, NULL, 'a'},
         {"binary", 0, NULL, 'b'},
         {"columns", 1, NULL, 'c'},
+        {"follow", 0, NULL, 'f'},
+        {"group", 1, NULL, 'g'},
         {"info", 0, NULL, 'i'},
         {"rows", 1, NULL, 'r'},
         {"trial", 1, NULL, 't'},
+        {"timestamps", 0, NULL, 'T'},
         { 0, 0, 0, 0}
     };
 
     while(1) {
-        c = getopt_long(argc,argv,"abc:ir:t:",long_options,&option_index);
+        c = getopt_long(argc,argv,"abc:fg:ir:t:T",long_options,&option_index);
 
         if(c < 0)
             break;
@@ -273,6 +473,12 @@ int getopts(int argc,char *argv[],struct options *options) {
                     options->cols_step = strtol(stringarg.substr(stringarg.find(':')+1,stringarg.rfind(':')-stringarg.find(':')-1).c_str(),NULL,10);
               }
               break;
+          case 'f':
+              options->follow = 1;
+              break;
+          case 'g':
+              options->group = strtol(optarg,NULL,10);
+              break;
           case 'i':
               options->info = 1;
               break;
@@ -310,13 +516,21 @@ int getopts(int argc,char *argv[],struct options *options) {
           case 't':
               options->trial = strtol(optarg,NULL,10);
               break;
+          case 'T':
+              options->timestamps = 1;
+              break;
         };
 
     };
 
+    if(options->follow && options->timestamps) {
+        fprintf(stderr,"Timestamps can't be printed while following a trial\n");
+        exit(-EINVAL);
+    }
+
     if(optind == argc) {
         fprintf(stderr,"Usage: %s [options] <filename>\n",argv[0]);
-        fprintf(stderr,"\tMust specify a filename\n");
+        fprintf(stderr,"\tMust specify a filename, or the .manifest of a rotated recording\n");
         exit(-EINVAL);
     } else if(optind == argc-1) {
         options->filename = argv[optind];
@@ -342,16 +556,31 @@ void print_trial_info(hid_t trial,int num_trial) {
 
     printf("\tDate: %s\n",string_data);
 
-    data = H5Dopen(trial,"Synchronous Data/Channel Data",H5P_DEFAULT);
-    hsize_t nchans = H5Tget_size(H5Dget_type(data))/sizeof(double);
-    H5Dclose(data);
-
-    data = H5PTopen(trial,"Synchronous Data/Channel Data");
-    hsize_t nsamples;
-    H5PTget_num_packets(data,&nsamples);
+    part_t part;
+    hsize_t nchans = 0;
+    hsize_t nsamples = 0;
+    if(!open_channel_data(trial,0,part,nchans)) {
+        nsamples = count_rows(part,0);
+        if(part.columns.size())
+            printf("\tChannel Columns\n");
+        close_channel_data(part);
+    }
 
     printf("\t%llu Channels X %llu samples\n",nchans,nsamples);
 
+    timestamps_t stamps;
+    if(!open_timestamps(trial,stamps)) {
+        printf("\tTimestamps: %llu ticks, %llu late, largest jitter %lld ns\n",stamps.ticks,stamps.late,stamps.max_jitter);
+        if(stamps.gaps.size())
+            printf("\t%lu gaps, %llu ticks lost\n",stamps.gaps.size(),stamps.lost);
+        for(size_t i = 0;i < stamps.gaps.size() && i < STAMP_MAX_GAPS;++i)
+            printf("\t\t%llu ticks lost before tick %llu, %.6f s into the trial\n",stamps.gaps[i].second,stamps.gaps[i].first,
+                    (tick_time(stamps,stamps.gaps[i].first)-stamps.checkpoints[0])*1e-9);
+        if(stamps.gaps.size() > STAMP_MAX_GAPS)
+            printf("\t\t...\n");
+        H5Dclose(stamps.jitter);
+    }
+
     for(int i=1;i<=nchans;++i) {
         std::stringstream channel_name;
         channel_name << "Synchronous Data/Channel "  << i << " Name";
@@ -362,5 +591,361 @@ void print_trial_info(hid_t trial,int num_trial) {
         printf("\t\t#%d: %s\n",i,string_data);
     }
 
+    // Groups of channels recorded at their own rate, read with --group
+    hid_t groups = H5Gopen(trial,"Synchronous Data/Decimated Data",H5P_DEFAULT);
+    if(groups >= 0) {
+        hsize_t ncols;
+        H5G_info_t info;
+        H5Gget_info(groups,&info);
+        for(hsize_t i = 0;i < info.nlinks;++i) {
+            char name[64];
+            H5Lget_name_by_idx(groups,".",H5_INDEX_NAME,H5_ITER_INC,i,name,sizeof(name),H5P_DEFAULT);
+            int rate;
+            if(sscanf(name,"Rate %d",&rate) != 1 || open_channel_data(trial,rate,part,ncols))
+                continue;
+            printf("\t%s: %llu Channels X %llu samples\n",name,ncols,count_rows(part,0));
+            close_channel_data(part);
+        }
+        H5Gclose(groups);
+    }
+
     printf("\n");
 }
+
+void print_row(const double *data,const long long *time,const struct options &opts) {
+    if(time) {
+        if(opts.binary)
+            write(1,time,sizeof(*time));
+        else
+            printf("%lld ",*time);
+    }
+
+    int col_idx = opts.cols_start;
+    do {
+        if(opts.binary) {
+            write(1,data+col_idx,sizeof(double));
+        } else {
+            printf("%e ",data[col_idx]);
+        }
+
+        if(col_idx == opts.cols_end)
+            break;
+        col_idx += opts.cols_step;
+    } while(1);
+
+    if(!opts.binary)
+        printf("\n");
+}
+
+// Open the Channel Data of a trial, in either layout, or that of the group
+// of channels recorded at 1/group of the real-time rate
+int open_channel_data(hid_t trial,int group,struct part_t &part,hsize_t &ncols) {
+    part.stamps.jitter = -1;
+    part.layout.narrow = false;
+    part.columns.clear();
+    part.layouts.clear();
+    if(group) {
+        std::stringstream group_name;
+        group_name << "Synchronous Data/Decimated Data/Rate " << group << "/Channel Data";
+        part.data = H5Dopen(trial,group_name.str().c_str(),H5P_DEFAULT);
+    } else
+        part.data = H5Dopen(trial,"Synchronous Data/Channel Data",H5P_DEFAULT);
+    if(part.data >= 0) {
+        if(!SampleStorage::readAttributes(part.data,part.layout)) {
+            ncols = part.layout.columns.size();
+            return 0;
+        }
+        hid_t type = H5Dget_type(part.data);
+        ncols = H5Tget_size(type)/sizeof(double);
+        H5Tclose(type);
+        return 0;
+    }
+
+    for(int i = 1;;++i) {
+        std::stringstream column_name;
+        column_name << "Synchronous Data/Channel Columns/" << i;
+        hid_t column = H5Dopen(trial,column_name.str().c_str(),H5P_DEFAULT);
+        if(column < 0)
+            break;
+        part.columns.push_back(column);
+        part.layouts.push_back(SampleStorage::layout_t());
+        if(SampleStorage::readAttributes(column,part.layouts.back()))
+            part.layouts.back().narrow = false;
+    }
+    if(part.columns.empty())
+        return -1;
+    ncols = part.columns.size();
+    return 0;
+}
+
+// Rows of Channel Data. The recorder appends the columns one after the
+// other, while it writes the first ones can be ahead of the rest
+hsize_t count_rows(const struct part_t &part,int refresh) {
+    std::vector<hid_t> data = part.columns;
+    if(data.empty())
+        data.push_back(part.data);
+
+    hsize_t nrows = 0;
+    for(size_t i = 0;i < data.size();++i) {
+        if(refresh)
+            H5Drefresh(data[i]);
+        hid_t space = H5Dget_space(data[i]);
+        hsize_t rows;
+        H5Sget_simple_extent_dims(space,&rows,NULL);
+        H5Sclose(space);
+        nrows = i ? std::min(nrows,rows) : rows;
+    }
+
+    return nrows;
+}
+
+// Read count rows, stride apart from start, into data, ncols doubles per row.
+// Only the columns that are printed are read from the columnar layout
+void read_rows(const struct part_t &part,hsize_t start,hsize_t stride,hsize_t count,hsize_t ncols,
+        const struct options &opts,double *data) {
+    hid_t memspace = H5Screate_simple(1,&count,NULL);
+
+    if(part.columns.empty()) {
+        hid_t type = H5Dget_type(part.data);
+        hid_t space = H5Dget_space(part.data);
+        H5Sselect_hyperslab(space,H5S_SELECT_SET,&start,&stride,&count,NULL);
+        if(part.layout.narrow) {
+            std::vector<char> rows(count*part.layout.size);
+            H5Dread(part.data,type,memspace,space,H5P_DEFAULT,&rows[0]);
+            SampleStorage::unpack(part.layout,&rows[0],count,data);
+        } else
+            H5Dread(part.data,type,memspace,space,H5P_DEFAULT,data);
+        H5Sclose(space);
+        H5Tclose(type);
+    } else {
+        std::vector<double> column(count);
+        int col_idx = opts.cols_start;
+        do {
+            hid_t space = H5Dget_space(part.columns[col_idx]);
+            H5Sselect_hyperslab(space,H5S_SELECT_SET,&start,&stride,&count,NULL);
+            H5Dread(part.columns[col_idx],H5T_NATIVE_DOUBLE,memspace,space,H5P_DEFAULT,&column[0]);
+            H5Sclose(space);
+
+            // Narrower columns are converted by HDF5, only Int16 is scaled
+            const SampleStorage::layout_t &layout = part.layouts[col_idx];
+            double scale = layout.narrow ? layout.columns[0].scale : 1.0;
+            double offset = layout.narrow ? layout.columns[0].offset : 0.0;
+            for(hsize_t i = 0;i < count;++i)
+                data[i*ncols+col_idx] = column[i]*scale+offset;
+
+            if(col_idx == opts.cols_end)
+                break;
+            col_idx += opts.cols_step;
+        } while(1);
+    }
+
+    H5Sclose(memspace);
+}
+
+void close_channel_data(struct part_t &part) {
+    if(part.data >= 0)
+        H5Dclose(part.data);
+    for(size_t i = 0;i < part.columns.size();++i)
+        H5Dclose(part.columns[i]);
+    if(part.stamps.jitter >= 0)
+        H5Dclose(part.stamps.jitter);
+    part.data = -1;
+    part.columns.clear();
+    part.stamps.jitter = -1;
+}
+
+static bool earlier(const stamp_exception_t &a,const stamp_exception_t &b) {
+    return a.tick < b.tick;
+}
+
+// Times of count ticks from first on, prev is the time of the tick before
+static void rebuild_times(const struct timestamps_t &stamps,hsize_t first,const short *jitter,hsize_t count,
+        long long prev,long long *times) {
+    stamp_exception_t key = { static_cast<long long>(first), 0, };
+    std::vector<stamp_exception_t>::const_iterator e =
+        std::lower_bound(stamps.exceptions.begin(),stamps.exceptions.end(),key,earlier);
+
+    for(hsize_t i = 0;i < count;++i) {
+        if(e != stamps.exceptions.end() && e->tick == static_cast<long long>(first+i))
+            times[i] = (e++)->time;
+        else
+            times[i] = prev+stamps.period+jitter[i];
+        prev = times[i];
+    }
+}
+
+static void read_jitter(const struct timestamps_t &stamps,hsize_t first,hsize_t count,short *jitter) {
+    hid_t space = H5Dget_space(stamps.jitter);
+    hid_t memspace = H5Screate_simple(1,&count,NULL);
+    H5Sselect_hyperslab(space,H5S_SELECT_SET,&first,NULL,&count,NULL);
+    H5Dread(stamps.jitter,H5T_NATIVE_SHORT,memspace,space,H5P_DEFAULT,jitter);
+    H5Sclose(memspace);
+    H5Sclose(space);
+}
+
+// Open the timestamps of a trial. Every tick is rebuilt once, to keep the
+// time of the first tick of each block and to find the gaps
+int open_timestamps(hid_t trial,struct timestamps_t &stamps) {
+    stamps.jitter = H5Dopen(trial,"Synchronous Data/Timestamps/Jitter (ns)",H5P_DEFAULT);
+    if(stamps.jitter < 0)
+        return -1;
+
+    hid_t data = H5Dopen(trial,"Period (ns)",H5P_DEFAULT);
+    H5Dread(data,H5T_NATIVE_LLONG,H5S_ALL,H5S_ALL,H5P_DEFAULT,&stamps.period);
+    H5Dclose(data);
+    data = H5Dopen(trial,"Downsampling Rate",H5P_DEFAULT);
+    H5Dread(data,H5T_NATIVE_LLONG,H5S_ALL,H5S_ALL,H5P_DEFAULT,&stamps.downsample);
+    H5Dclose(data);
+
+    hid_t type = H5Tcreate(H5T_COMPOUND,sizeof(stamp_exception_t));
+    H5Tinsert(type,"tick",HOFFSET(stamp_exception_t,tick),H5T_NATIVE_LLONG);
+    H5Tinsert(type,"time",HOFFSET(stamp_exception_t,time),H5T_NATIVE_LLONG);
+    data = H5Dopen(trial,"Synchronous Data/Timestamps/Exceptions",H5P_DEFAULT);
+    hid_t space = H5Dget_space(data);
+    hsize_t count;
+    H5Sget_simple_extent_dims(space,&count,NULL);
+    H5Sclose(space);
+    stamps.exceptions.resize(count);
+    if(count)
+        H5Dread(data,type,H5S_ALL,H5S_ALL,H5P_DEFAULT,&stamps.exceptions[0]);
+    H5Dclose(data);
+    H5Tclose(type);
+
+    space = H5Dget_space(stamps.jitter);
+    H5Sget_simple_extent_dims(space,&stamps.ticks,NULL);
+    H5Sclose(space);
+
+    // A tick more than half a period late stands for the ticks lost before
+    // it, the others are late if the jitter couldn't hold them
+    stamps.checkpoints.clear();
+    stamps.gaps.clear();
+    stamps.lost = 0;
+    stamps.late = 0;
+    stamps.max_jitter = 0;
+    stamps.block = -1;
+    std::vector<short> jitter(STAMP_BLOCK_TICKS);
+    std::vector<long long> times(STAMP_BLOCK_TICKS);
+    long long prev = 0;
+    for(hsize_t first = 0;first < stamps.ticks;first += STAMP_BLOCK_TICKS) {
+        count = std::min<hsize_t>(STAMP_BLOCK_TICKS,stamps.ticks-first);
+        read_jitter(stamps,first,count,&jitter[0]);
+        rebuild_times(stamps,first,&jitter[0],count,prev,&times[0]);
+        stamps.checkpoints.push_back(times[0]);
+
+        for(hsize_t i = first ? 0 : 1;i < count;++i) {
+            long long delta = times[i]-(i ? times[i-1] : prev);
+            if(2*delta >= 3*stamps.period) {
+                hsize_t lost = (delta+stamps.period/2)/stamps.period-1;
+                stamps.gaps.push_back(std::make_pair(first+i,lost));
+                stamps.lost += lost;
+                continue;
+            }
+            long long late = delta > stamps.period ? delta-stamps.period : stamps.period-delta;
+            stamps.max_jitter = std::max(stamps.max_jitter,late);
+            if(late > SHRT_MAX)
+                ++stamps.late;
+        }
+        prev = times[count-1];
+    }
+
+    return 0;
+}
+
+// Time of a tick, past the last tick the period is added
+long long tick_time(struct timestamps_t &stamps,hsize_t tick) {
+    if(!stamps.ticks)
+        return 0;
+    if(tick >= stamps.ticks)
+        return tick_time(stamps,stamps.ticks-1)+(tick-stamps.ticks+1)*stamps.period;
+
+    hsize_t block = tick/STAMP_BLOCK_TICKS;
+    if(block != stamps.block) {
+        hsize_t first = block*STAMP_BLOCK_TICKS;
+        hsize_t count = std::min<hsize_t>(STAMP_BLOCK_TICKS,stamps.ticks-first);
+        std::vector<short> jitter(count);
+        read_jitter(stamps,first,count,&jitter[0]);
+        stamps.times.resize(count);
+        stamps.times[0] = stamps.checkpoints[block];
+        rebuild_times(stamps,first+1,&jitter[0]+1,count-1,stamps.times[0],&stamps.times[1]);
+        stamps.block = block;
+    }
+
+    return stamps.times[tick-block*STAMP_BLOCK_TICKS];
+}
+
+// Print the rows of a trial as the recorder appends them, from row on, until
+// its stop timestamp is written. The part of the trial in segment starts at
+// row offset, a trial split by rotation is followed into the next segment
+// once the manifest lists it
+int follow_trial(const char *manifest,std::vector<segment_t> &segments,std::vector<hid_t> &fids,size_t segment,
+        hsize_t offset,hsize_t ncols,hsize_t row,const struct options &opts) {
+    std::vector<double> rows;
+    for(;;) {
+        std::stringstream trial_name;
+        trial_name << "/Trial" << opts.trial-segments[segment].first+1;
+        hid_t trial = H5Gopen(fids[segment],trial_name.str().c_str(),H5P_DEFAULT);
+        part_t part;
+        if(trial < 0 || open_channel_data(trial,opts.group,part,ncols)) {
+            fprintf(stderr,"Trial #%d has no Channel Data in %s.\n",opts.trial,segments[segment].name.c_str());
+            return -EINVAL;
+        }
+        hid_t stop = H5Dopen(trial,"Timestamp Stop (ns)",H5P_DEFAULT);
+
+        hsize_t end = offset;
+        for(;;) {
+            // The stop timestamp is checked before the rows are, so the rows
+            // read once it is set are the last ones
+            unsigned long long timestamp = 1;
+            if(stop >= 0) {
+                H5Drefresh(stop);
+                H5Dread(stop,H5T_NATIVE_ULLONG,H5S_ALL,H5S_ALL,H5P_DEFAULT,&timestamp);
+            }
+
+            end = offset+count_rows(part,1);
+            if(row < end) {
+                hsize_t count = (end-row-1)/opts.rows_step+1;
+                rows.resize(count*ncols);
+                read_rows(part,row-offset,opts.rows_step,count,ncols,opts,&rows[0]);
+                for(hsize_t i = 0;i < count;++i)
+                    print_row(&rows[i*ncols],NULL,opts);
+                row += count*opts.rows_step;
+                fflush(stdout);
+            }
+
+            if(timestamp)
+                break;
+            usleep(FOLLOW_INTERVAL);
+        }
+
+        if(stop >= 0)
+            H5Dclose(stop);
+        close_channel_data(part);
+        H5Gclose(trial);
+
+        // The recorder lists the next segment right after stopping the part
+        if(!manifest)
+            return 0;
+        usleep(FOLLOW_INTERVAL);
+        std::vector<segment_t> listed;
+        if(read_manifest(manifest,listed) || listed.size() <= segments.size())
+            return 0;
+        const segment_t &next = listed[segments.size()];
+        if(!next.continued || next.first != opts.trial)
+            return 0;
+
+        // It can only be opened once the trial is started in it
+        hid_t fid = -1;
+        for(int attempt = 0;fid < 0 && attempt < 50;++attempt) {
+            usleep(FOLLOW_INTERVAL);
+            fid = H5Fopen(next.name.c_str(),H5F_ACC_RDONLY|H5F_ACC_SWMR_READ,H5P_DEFAULT);
+        }
+        if(fid < 0) {
+            fprintf(stderr,"Failed to open %s.\n",next.name.c_str());
+            return fid;
+        }
+        segments.push_back(next);
+        fids.push_back(fid);
+        segment = segments.size()-1;
+        offset = end;
+    }
+}
@@ -0,0 +1,548 @@
+/*
+ Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornel Medical College
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/*
+ * Converts a raw capture written by the Data Recorder into the HDF5
+ * trial layout the recorder writes itself.
+ *
+ * Channel Data is written chunk by chunk with direct chunk writes. The
+ * worker threads copy each chunk out of the mapped capture and run the
+ * shuffle and deflate filters on it, the main thread only hands the
+ * finished chunks to HDF5, which is not thread safe.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <hdf5.h>
+#include <hdf5_hl.h>
+#include <zlib.h>
+
+#include <raw_capture.h>
+
+#include <sstream>
+#include <string>
+
+struct options {
+    int threads;
+    int level;
+    int force;
+    int legacyAsync;
+    long chunk;
+    char *input;
+    std::string output;
+};
+
+struct param_hdf_t {
+    long long index;
+    double value;
+};
+
+struct async_index_t {
+    long long time;
+    long long tick;
+    unsigned long long offset;
+    unsigned long long length;
+};
+
+// Asynchronous Data of one trial in the Samples and Index tables, or
+// in one dataset per event when legacy is set
+struct async_t {
+    bool legacy;
+    long long start;
+    long long period;
+    std::vector<double> samples;
+    std::vector<async_index_t> index;
+};
+
+// Chunks in flight, per worker thread
+#define CHUNK_WINDOW 4
+
+// Automatic chunks hold about this many bytes, like the recorder's
+#define CHUNK_TARGET_BYTES (256*1024)
+
+// Chunks of the Asynchronous Data tables, like the recorder's
+#define ASYNC_CHUNK_SAMPLES 4096
+#define ASYNC_CHUNK_ENTRIES 512
+
+struct chunk_t {
+    chunk_t(void) : done(false) {};
+    bool done;
+    std::vector<unsigned char> data;
+};
+
+struct convert_t {
+    const char *frames;
+    hsize_t frameCount;
+    size_t frameSize;
+    hsize_t chunkRows;
+    hsize_t chunkCount;
+    int level;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable space;
+    hsize_t next;
+    hsize_t written;
+    std::map<hsize_t,chunk_t> chunks;
+    int window;
+};
+
+void getopts(int,char *[],struct options *);
+int convert_trial(hid_t,int,const RawCapture::trial_header_t &,const char *,const struct options &);
+
+int main(int argc,char *argv[]) {
+    struct options opts = {
+        0,
+        4,
+        0,
+        0,
+        0,
+        NULL,
+        "",
+    };
+
+    getopts(argc,argv,&opts);
+
+    H5Eset_auto2(H5E_DEFAULT,NULL,NULL);
+
+    int fd = open(opts.input,O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr,"Failed to open %s.\n",opts.input);
+        return -errno;
+    }
+
+    struct stat st;
+    fstat(fd,&st);
+    uint64_t size = st.st_size;
+    const char *base = NULL;
+    if(size) {
+        base = reinterpret_cast<const char *>(mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0));
+        if(base == MAP_FAILED) {
+            fprintf(stderr,"Failed to map %s.\n",opts.input);
+            return -errno;
+        }
+        madvise(const_cast<char *>(base),size,MADV_SEQUENTIAL);
+    }
+
+    hid_t fid = H5Fcreate(opts.output.c_str(),opts.force ? H5F_ACC_TRUNC : H5F_ACC_EXCL,H5P_DEFAULT,H5P_DEFAULT);
+    if(fid < 0) {
+        fprintf(stderr,"Failed to create %s, use --force to overwrite it.\n",opts.output.c_str());
+        return fid;
+    }
+
+    int trial = 0;
+    uint64_t offset = 0;
+    RawCapture::trial_header_t header;
+    while(offset < size && !RawCapture::readTrial(fd,offset,size,header)) {
+        if(!header.stopTime)
+            fprintf(stderr,"Trial #%d was not stopped, recovering %llu frames.\n",trial+1,
+                    static_cast<unsigned long long>(header.frameCount));
+
+        if(convert_trial(fid,++trial,header,base+offset,opts)) {
+            fprintf(stderr,"Failed to convert trial #%d.\n",trial);
+            H5Fclose(fid);
+            return -EIO;
+        }
+
+        printf("Trial #%d: %u channels X %llu samples\n",trial,header.channelCount,
+                static_cast<unsigned long long>(header.frameCount));
+        offset += header.trialSize;
+    }
+
+    if(offset < size)
+        fprintf(stderr,"Ignoring %llu bytes of unknown data at the end of %s.\n",
+                static_cast<unsigned long long>(size-offset),opts.input);
+
+    H5Fclose(fid);
+    if(base)
+        munmap(const_cast<char *>(base),size);
+    close(fd);
+
+    return 0;
+}
+
+// Same byte order as the HDF5 shuffle filter
+static void shuffle(const unsigned char *in,unsigned char *out,size_t elements,size_t size) {
+    if(size <= 1 || elements <= 1) {
+        memcpy(out,in,elements*size);
+        return;
+    }
+    for(size_t j = 0;j < size;++j)
+        for(size_t i = 0;i < elements;++i)
+            out[j*elements+i] = in[i*size+j];
+}
+
+// Worker thread, filters chunks in order of their index
+static void filter_chunks(convert_t *c) {
+    size_t chunkBytes = c->chunkRows*c->frameSize;
+    std::vector<unsigned char> raw(chunkBytes);
+    std::vector<unsigned char> shuffled(chunkBytes);
+
+    for(;;) {
+        hsize_t idx;
+        {
+            std::unique_lock<std::mutex> lock(c->mutex);
+            while(c->next < c->chunkCount && c->next >= c->written+c->window)
+                c->space.wait(lock);
+            if(c->next >= c->chunkCount)
+                return;
+            idx = c->next++;
+        }
+
+        // The last chunk is padded with zeros, chunks are always stored whole
+        hsize_t first = idx*c->chunkRows;
+        hsize_t rows = std::min(c->chunkRows,c->frameCount-first);
+        memcpy(&raw[0],c->frames+first*c->frameSize,rows*c->frameSize);
+        memset(&raw[0]+rows*c->frameSize,0,chunkBytes-rows*c->frameSize);
+
+        std::vector<unsigned char> data;
+        if(c->level > 0) {
+            shuffle(&raw[0],&shuffled[0],c->chunkRows,c->frameSize);
+            uLongf n = compressBound(chunkBytes);
+            data.resize(n);
+            compress2(&data[0],&n,&shuffled[0],chunkBytes,c->level);
+            data.resize(n);
+        } else
+            data = raw;
+
+        std::unique_lock<std::mutex> lock(c->mutex);
+        chunk_t &chunk = c->chunks[idx];
+        chunk.data.swap(data);
+        chunk.done = true;
+        c->ready.notify_one();
+    }
+}
+
+static int write_channel_data(hid_t sdata,const RawCapture::trial_header_t &header,const char *trial,const struct options &opts) {
+    hsize_t array_size[] = { header.channelCount };
+    hid_t array_type = H5Tarray_create(H5T_IEEE_F64LE,1,array_size);
+
+    convert_t c;
+    c.frames = trial+header.headerSize;
+    c.frameCount = header.frameCount;
+    c.frameSize = header.frameSize;
+    c.chunkRows = opts.chunk;
+    if(!c.chunkRows) {
+        c.chunkRows = CHUNK_TARGET_BYTES/header.frameSize;
+        c.chunkRows = std::min(c.chunkRows,static_cast<hsize_t>(std::max(1000000000ll/std::max(static_cast<long long>(header.period*header.downsample),1ll),1ll)));
+        c.chunkRows = std::max(c.chunkRows,static_cast<hsize_t>(64));
+    }
+    c.chunkCount = (c.frameCount+c.chunkRows-1)/c.chunkRows;
+    c.level = opts.level;
+    c.next = 0;
+    c.written = 0;
+
+    int threads = opts.threads;
+    if(threads <= 0)
+        threads = std::max(1u,std::thread::hardware_concurrency());
+    c.window = CHUNK_WINDOW*threads;
+
+    // A packet table is an extendible, chunked, one dimensional dataset
+    hsize_t dims[] = { c.frameCount };
+    hsize_t maxdims[] = { H5S_UNLIMITED };
+    hid_t space = H5Screate_simple(1,dims,maxdims);
+    hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+    hsize_t chunk_dims[] = { c.chunkRows };
+    H5Pset_chunk(plist,1,chunk_dims);
+    if(c.level > 0) {
+        H5Pset_shuffle(plist);
+        H5Pset_deflate(plist,c.level);
+    }
+    hid_t table = H5Dcreate(sdata,"Channel Data",array_type,space,H5P_DEFAULT,plist,H5P_DEFAULT);
+    H5Pclose(plist);
+    H5Sclose(space);
+    H5Tclose(array_type);
+    if(table < 0)
+        return -1;
+
+    std::vector<std::thread> workers;
+    for(int i = 0;i < threads;++i)
+        workers.push_back(std::thread(filter_chunks,&c));
+
+    int retval = 0;
+    for(hsize_t idx = 0;idx < c.chunkCount;++idx) {
+        std::vector<unsigned char> data;
+        {
+            std::unique_lock<std::mutex> lock(c.mutex);
+            while(!c.chunks[idx].done)
+                c.ready.wait(lock);
+            data.swap(c.chunks[idx].data);
+            c.chunks.erase(idx);
+        }
+
+        hsize_t offset[] = { idx*c.chunkRows };
+#if H5_VERSION_GE(1,10,3)
+        if(H5Dwrite_chunk(table,H5P_DEFAULT,0,offset,data.size(),&data[0]) < 0)
+#else
+        if(H5DOwrite_chunk(table,H5P_DEFAULT,0,offset,data.size(),&data[0]) < 0)
+#endif
+            retval = -1;
+
+        std::unique_lock<std::mutex> lock(c.mutex);
+        c.written = idx+1;
+        c.space.notify_all();
+    }
+
+    for(size_t i = 0;i < workers.size();++i)
+        workers[i].join();
+
+    H5Dclose(table);
+    return retval;
+}
+
+static void write_scalar(hid_t loc,const char *name,long long value) {
+    hid_t scalar_space = H5Screate(H5S_SCALAR);
+    hid_t data = H5Dcreate(loc,name,H5T_STD_U64LE,scalar_space,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+    H5Dwrite(data,H5T_STD_U64LE,H5S_ALL,H5S_ALL,H5P_DEFAULT,&value);
+    H5Dclose(data);
+    H5Sclose(scalar_space);
+}
+
+static void write_string(hid_t loc,const char *name,const char *value) {
+    hid_t scalar_space = H5Screate(H5S_SCALAR);
+    hid_t string_type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(string_type,1024);
+    char buffer[1024] = { 0 };
+    strncpy(buffer,value,sizeof(buffer)-1);
+    hid_t data = H5Dcreate(loc,name,string_type,scalar_space,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+    H5Dwrite(data,string_type,H5S_ALL,H5S_ALL,H5P_DEFAULT,buffer);
+    H5Dclose(data);
+    H5Tclose(string_type);
+    H5Sclose(scalar_space);
+}
+
+static void write_records(hid_t adata,hid_t pdata,const char *section,uint64_t size,async_t &async) {
+    hid_t param_type = H5Tcreate(H5T_COMPOUND,sizeof(param_hdf_t));
+    H5Tinsert(param_type,"index",HOFFSET(param_hdf_t,index),H5T_STD_I64LE);
+    H5Tinsert(param_type,"value",HOFFSET(param_hdf_t,value),H5T_IEEE_F64LE);
+    std::map<std::string,hid_t> tables;
+
+    uint64_t offset = 0;
+    while(offset+sizeof(RawCapture::record_t) <= size) {
+        RawCapture::record_t record;
+        memcpy(&record,section+offset,sizeof(record));
+        const char *payload = section+offset+sizeof(record);
+        offset += sizeof(record)+record.size;
+        if(offset > size)
+            break;
+
+        if(record.type == RawCapture::ASYNC && !async.legacy) {
+            const double *samples = reinterpret_cast<const double *>(payload);
+            size_t n = record.size/sizeof(double);
+            async_index_t entry = { record.time,(record.time-async.start)/async.period,async.samples.size(),n, };
+            async.index.push_back(entry);
+            async.samples.insert(async.samples.end(),samples,samples+n);
+        } else if(record.type == RawCapture::ASYNC) {
+            std::stringstream name;
+            name << static_cast<unsigned long long>(record.time);
+            hsize_t dims[] = { record.size/sizeof(double) };
+            hid_t space = H5Screate_simple(1,dims,dims);
+            hid_t data = H5Dcreate(adata,name.str().c_str(),H5T_IEEE_F64LE,space,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+            std::vector<double> samples(dims[0]);
+            memcpy(&samples[0],payload,dims[0]*sizeof(double));
+            H5Dwrite(data,H5T_IEEE_F64LE,H5S_ALL,H5S_ALL,H5P_DEFAULT,&samples[0]);
+            H5Dclose(data);
+            H5Sclose(space);
+        } else if(record.type == RawCapture::PARAM) {
+            RawCapture::param_record_t change;
+            memcpy(&change,payload,sizeof(change));
+            std::string name(payload+sizeof(change),strnlen(payload+sizeof(change),record.size-sizeof(change)));
+
+            hid_t &table = tables[name];
+            if(!table)
+                table = H5PTcreate_fl(pdata,name.c_str(),param_type,sizeof(param_hdf_t),-1);
+            param_hdf_t value = { change.index, change.value, };
+            H5PTappend(table,1,&value);
+        } else if(record.type == RawCapture::COMMENT) {
+            std::string name(payload,strnlen(payload,record.size));
+            std::string text(payload+name.size()+1,strnlen(payload+name.size()+1,record.size-name.size()-1));
+            hsize_t dims = text.size()+1;
+            hid_t space = H5Screate_simple(1,&dims,&dims);
+            hid_t data = H5Dcreate(pdata,name.c_str(),H5T_C_S1,space,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+            H5Dwrite(data,H5T_C_S1,H5S_ALL,H5S_ALL,H5P_DEFAULT,text.c_str());
+            H5Dclose(data);
+            H5Sclose(space);
+        }
+    }
+
+    for(std::map<std::string,hid_t>::iterator i = tables.begin();i != tables.end();++i)
+        H5PTclose(i->second);
+    H5Tclose(param_type);
+}
+
+static void write_async(hid_t adata,const async_t &async,const struct options &opts) {
+    hid_t index_type = H5Tcreate(H5T_COMPOUND,sizeof(async_index_t));
+    H5Tinsert(index_type,"time",HOFFSET(async_index_t,time),H5T_STD_I64LE);
+    H5Tinsert(index_type,"tick",HOFFSET(async_index_t,tick),H5T_STD_I64LE);
+    H5Tinsert(index_type,"offset",HOFFSET(async_index_t,offset),H5T_STD_U64LE);
+    H5Tinsert(index_type,"length",HOFFSET(async_index_t,length),H5T_STD_U64LE);
+
+    int level = opts.level > 0 ? opts.level : -1;
+    hid_t samples = H5PTcreate_fl(adata,"Samples",H5T_IEEE_F64LE,ASYNC_CHUNK_SAMPLES,level);
+    hid_t index = H5PTcreate_fl(adata,"Index",index_type,ASYNC_CHUNK_ENTRIES,level);
+    if(async.samples.size())
+        H5PTappend(samples,async.samples.size(),&async.samples[0]);
+    if(async.index.size())
+        H5PTappend(index,async.index.size(),&async.index[0]);
+
+    H5PTclose(samples);
+    H5PTclose(index);
+    H5Tclose(index_type);
+}
+
+int convert_trial(hid_t fid,int num_trial,const RawCapture::trial_header_t &header,const char *trial,const struct options &opts) {
+    std::stringstream trial_name;
+    trial_name << "/Trial" << num_trial;
+
+    hid_t tid = H5Gcreate(fid,trial_name.str().c_str(),H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+    hid_t pdata = H5Gcreate(tid,"Parameters",H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+    hid_t adata = H5Gcreate(tid,"Asynchronous Data",H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+    hid_t sdata = H5Gcreate(tid,"Synchronous Data",H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+
+    write_scalar(tid,"Period (ns)",header.period);
+    write_scalar(tid,"Downsampling Rate",header.downsample);
+    write_scalar(tid,"Timestamp Start (ns)",header.startTime);
+    write_string(tid,"Date",std::string(header.date,strnlen(header.date,sizeof(header.date))).c_str());
+
+    const RawCapture::channel_t *channels = reinterpret_cast<const RawCapture::channel_t *>(trial+sizeof(header));
+    for(uint32_t i = 0;i < header.channelCount;++i) {
+        std::stringstream name;
+        name << i+1 << ": " << std::string(channels[i].name,strnlen(channels[i].name,sizeof(channels[i].name)));
+        write_string(sdata,name.str().c_str(),name.str().c_str());
+    }
+
+    int retval = 0;
+    if(header.channelCount)
+        retval = write_channel_data(sdata,header,trial,opts);
+
+    async_t async;
+    async.legacy = opts.legacyAsync;
+    async.start = header.startTime;
+    async.period = header.period;
+    write_records(adata,pdata,trial+header.asyncOffset,header.asyncSize,async);
+    write_records(adata,pdata,trial+header.paramOffset,header.paramSize,async);
+    if(!async.legacy)
+        write_async(adata,async,opts);
+
+    // Trials that were never stopped end with the last frame
+    long long stop = header.stopTime;
+    long long length = header.trialLength;
+    if(!stop) {
+        length = header.period*header.downsample*header.frameCount;
+        stop = header.startTime+length;
+    }
+    write_scalar(tid,"Timestamp Stop (ns)",stop);
+    write_scalar(tid,"Trial Length (ns)",length);
+
+    H5Gclose(sdata);
+    H5Gclose(adata);
+    H5Gclose(pdata);
+    H5Gclose(tid);
+
+    return retval;
+}
+
+void getopts(int argc,char *argv[],struct options *options) {
+    int c;
+    char *end;
+    int option_index = 0;
+    struct option long_options[] = {
+        {"chunk", 1, NULL, 'c'},
+        {"force", 0, NULL, 'f'},
+        {"threads", 1, NULL, 'j'},
+        {"legacy-async", 0, NULL, 'l'},
+        {"level", 1, NULL, 'z'},
+        { 0, 0, 0, 0}
+    };
+
+    while(1) {
+        c = getopt_long(argc,argv,"c:fj:lz:",long_options,&option_index);
+
+        if(c < 0)
+            break;
+
+        switch(c) {
+          case 'c':
+              errno = 0;
+              options->chunk = strtol(optarg,&end,10);
+              if(errno || end == optarg || *end || options->chunk <= 0) {
+                  fprintf(stderr,"Invalid chunk size: %s, expected a positive number of samples.\n",optarg);
+                  exit(-EINVAL);
+              }
+              break;
+          case 'f':
+              options->force = 1;
+              break;
+          case 'j': {
+              errno = 0;
+              long threads = strtol(optarg,&end,10);
+              if(errno || end == optarg || *end || threads <= 0 || threads > INT_MAX) {
+                  fprintf(stderr,"Invalid thread count: %s, expected a positive number.\n",optarg);
+                  exit(-EINVAL);
+              }
+              options->threads = threads;
+              break;
+          }
+          case 'l':
+              options->legacyAsync = 1;
+              break;
+          case 'z':
+              options->level = strtol(optarg,NULL,10);
+              if(options->level < 0 || options->level > 9) {
+                  fprintf(stderr,"Invalid compression level: %s, expected 0 to 9.\n",optarg);
+                  exit(-EINVAL);
+              }
+              break;
+          default:
+              exit(-EINVAL);
+        };
+    };
+
+    if(optind == argc || optind < argc-2) {
+        fprintf(stderr,"Usage: %s [options] <capture> [output]\n",argv[0]);
+        fprintf(stderr,"\t-c, --chunk N\tsamples per chunk, picked from the capture by default\n");
+        fprintf(stderr,"\t-f, --force\toverwrite the output file\n");
+        fprintf(stderr,"\t-j, --threads N\tcompression threads, one per core by default\n");
+        fprintf(stderr,"\t-l, --legacy-async\twrite one dataset per asynchronous event\n");
+        fprintf(stderr,"\t-z, --level N\tdeflate level, 0 disables shuffle and deflate (default 4)\n");
+        exit(-EINVAL);
+    }
+
+    options->input = argv[optind];
+    if(optind == argc-2)
+        options->output = argv[optind+1];
+    else {
+        options->output = options->input;
+        if(options->output.size() > 4 && options->output.substr(options->output.size()-4) == ".raw")
+            options->output.erase(options->output.size()-4);
+        options->output += ".h5";
+    }
+}
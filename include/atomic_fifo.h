@@ -21,6 +21,7 @@
 
 #include <cstdlib>
 #include <atomic>
+#include <fifo_monitor.h>
 
 //! Lockfree SINGLE producer / SINGLE consumer FIFO
 /*
@@ -28,12 +29,18 @@
  * It is an absolute requirement only one thread produces ( calls write() )
  * and only one thread consumes ( calls read() ).
  *
+ * The consumer may optionally block in wait() instead of polling. The
+ * producer then signals an eventfd, but only when the consumer is parked
+ * and enough data has accumulated, so most writes remain a plain store.
+ * A producer that can't make system calls without leaving realtime never
+ * signals, and the consumer is woken by its timeout instead.
+ *
  */
 
-class AtomicFifo {
+class AtomicFifo : public FifoMonitor::Source {
 
 public:
-    AtomicFifo(size_t);
+    AtomicFifo(size_t, const std::string &name = "AtomicFifo");
     ~AtomicFifo(void);
 
     /*!
@@ -58,14 +65,70 @@ public:
      *
      */
     bool isLockFree() const;
+
+    /*!
+     * Function to enable blocking consumer wakeups. A parked consumer is
+     * only signaled once watermark bytes are waiting to be read, or when
+     * the producer calls notify().
+     *
+     * \param watermark Number of buffered bytes that wakes the consumer
+     * \return True if the notification descriptor was created
+     */
+    bool enableNotification(size_t watermark);
+
+    /*!
+     * Function for the producer to wake a parked consumer regardless of
+     * the watermark, e.g. after writing a control token.
+     */
+    void notify(void);
+
+    /*!
+     * Function for the consumer to block until data arrives or the
+     * deadline passes. Without notification it simply sleeps for timeout.
+     *
+     * \param timeout Maximum time to block in nanoseconds
+     * \return True if data is available to be read
+     */
+    bool wait(long long timeout);
+
+    /*!
+     * Function for a consumer that polls several FIFOs at once. It parks
+     * the consumer like wait() does, but returns the descriptor to poll
+     * for POLLIN instead of blocking. unpark() must follow the poll.
+     *
+     * \return The descriptor, -1 if the watermark is already reached, or
+     *   -2 if notification is disabled and the consumer has to poll
+     */
+    int park(void);
+
+    /*!
+     * Function to end a park(), the pending wakeup is consumed.
+     */
+    void unpark(void);
+
+    /*!
+     * Function returning the number of bytes waiting to be read
+     */
+    size_t available(void) const;
+
+    void getStats(FifoMonitor::stats_t &) const;
+    void resetStats(void);
+
 private:
     size_t increment(size_t current_ptr, size_t itemSize) const;
+    void signal(void);
         
     char *data;
     std::atomic<size_t> head;
     std::atomic<size_t> tail;
     size_t fifoSize;
 
+    int eventFd;
+    size_t watermark;
+    std::atomic<bool> parked;
+
+    FifoMonitor::Counters counters;
+
 };
 
 #endif /* ATOMIC_FIFO_H */
@@ -21,6 +21,7 @@
 #define DEBUG_H
 
 #include <execinfo.h>
+#include <rt_log.h>
 #include <stdio.h>
 
 #ifdef _RTUTILS_H
@@ -37,11 +38,22 @@ static inline void PRINT_BACKTRACE(void) {
 	backtrace_symbols_fd(buffer,buffer_size,2);
 }
 
-#define ERROR_MSG(fmt,args...) do { fprintf(stderr,"%s:%d:",__FILE__,__LINE__); fprintf(stderr,fmt,## args); } while(0)
+namespace RT {
+	namespace OS {
+		bool isRealtime(void);
+	} // namespace OS
+} // namespace RT
+
+//! Prints error messages to standard error.
+/*!
+ * In the realtime thread the message is handed to RTLog instead,
+ *   so that stdio is never touched from realtime.
+ */
+#define ERROR_MSG(fmt,args...) do { if (RT::OS::isRealtime()) RTLog::post(__FILE__,__LINE__,fmt,## args); else { fprintf(stderr,"%s:%d:",__FILE__,__LINE__); fprintf(stderr,fmt,## args); } } while(0)
 
 #ifdef DEBUG
 
-#define DEBUG_MSG(fmt,args...) do { fprintf(stderr,"%s:%d:",__FILE__,__LINE__); fprintf(stderr,fmt,## args); } while(0)
+#define DEBUG_MSG(fmt,args...) ERROR_MSG(fmt,## args)
 
 #else /* !DEBUG */
 
@@ -0,0 +1,178 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DIRECT_WRITER_H
+#define DIRECT_WRITER_H
+
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+#define DIRECT_WRITER_ALIGN         4096
+#define DIRECT_WRITER_BUFFER_SIZE   (1024*1024)
+#define DIRECT_WRITER_BUFFERS       3
+
+//! Append-only file writer that bypasses the page cache.
+/*!
+ * Data is copied into a small set of aligned buffers. Each full buffer
+ *   is written asynchronously while the next one fills, through io_uring
+ *   when the kernel has it, or by a background thread otherwise. The
+ *   file is opened with O_DIRECT, on filesystems that refuse it the
+ *   written ranges are flushed and dropped from the page cache instead.
+ *
+ * Only one thread may use a DirectWriter at a time.
+ */
+class DirectWriter {
+
+	public:
+
+		enum backend_t {
+			AUTO,           /*!< io_uring if available, else THREAD */
+			URING,
+			THREAD,
+		};
+
+		DirectWriter(size_t bufferSize =DIRECT_WRITER_BUFFER_SIZE,size_t bufferCount =DIRECT_WRITER_BUFFERS);
+		~DirectWriter(void);
+
+		/*!
+		 * Open a file for writing.
+		 *
+		 * \param name The file name.
+		 * \param offset Where writing starts, rounded up to DIRECT_WRITER_ALIGN.
+		 * \param truncate Truncate the file first.
+		 * \param backend How buffers are written.
+		 * \return 0 on success, -1 on failure.
+		 */
+		int open(const std::string &name,off_t offset =0,bool truncate =true,backend_t backend =AUTO);
+
+		/*!
+		 * Write everything out, sync the file and close it. The file is
+		 *   cut back to the last byte written.
+		 *
+		 * \return 0 on success, -1 if any write failed.
+		 */
+		int close(void);
+
+		bool isOpen(void) const { return fd >= 0; };
+
+		/*!
+		 * Append data. Only blocks when all buffers are being written.
+		 *
+		 * \return 0 on success, -1 on failure.
+		 */
+		int write(const void *data,size_t size);
+
+		/*!
+		 * Append zeros up to the next multiple of alignment.
+		 */
+		int pad(size_t alignment =DIRECT_WRITER_ALIGN);
+
+		/*!
+		 * Overwrite data that has already been appended. The range must
+		 *   start and end on DIRECT_WRITER_ALIGN boundaries.
+		 */
+		int writeAt(off_t offset,const void *data,size_t size);
+
+		/*!
+		 * Write out everything appended so far and wait for it.
+		 */
+		int flush(void);
+
+		/*!
+		 * Flush and sync the file data to disk.
+		 */
+		int sync(void);
+
+		/*!
+		 * Sync the file data every interval nanoseconds while writing,
+		 *   zero only syncs on close.
+		 */
+		void setSyncInterval(long long interval) { syncInterval = interval; };
+		long long getSyncInterval(void) const { return syncInterval; };
+
+		/*!
+		 * \return The offset of the next byte appended.
+		 */
+		off_t tell(void) const { return position; };
+
+		backend_t getBackend(void) const { return backend; };
+		bool isDirect(void) const { return direct; };
+
+	private:
+
+		struct buffer_t {
+			char *data;
+			off_t offset;
+			size_t used;
+			size_t length;          /*!< bytes being written */
+			bool busy;
+			struct iovec iov;
+		};
+
+		int submit(size_t);
+		int wait(size_t);
+		int drain(void);
+		void complete(size_t,ssize_t);
+		void maybeSync(void);
+
+		int setupRing(void);
+		void teardownRing(void);
+		int reap(bool);
+
+		static void *bounce(void *);
+		void processBuffers(void);
+
+		int fd;
+		bool direct;
+		backend_t backend;
+		bool failed;
+
+		size_t bufferSize;
+		std::vector<buffer_t> buffers;
+		size_t current;
+		off_t position;
+
+		long long syncInterval;
+		long long lastSync;
+		bool syncPending;
+
+		// io_uring
+		int ringFd;
+		bool fixedBuffers;
+		void *sqRing, *cqRing;
+		size_t sqRingSize, cqRingSize;
+		void *sqes;
+		size_t sqesSize;
+		unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+		unsigned *cqHead, *cqTail, *cqMask;
+		void *cqes;
+
+		// Background thread
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		std::vector<size_t> queue;
+		bool done;
+
+}; // class DirectWriter
+
+#endif // DIRECT_WRITER_H
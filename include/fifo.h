@@ -21,19 +21,23 @@
 #define FIFO_H
 
 #include <cstdlib>
+#include <fifo_monitor.h>
 #include <pthread.h>
 
-class Fifo
+class Fifo : public FifoMonitor::Source
 {
 
 	public:
 
-		Fifo(size_t);
+		Fifo(size_t,const std::string & ="Fifo");
 		~Fifo(void);
 
 		size_t read(void *,size_t,bool =true);
 		size_t write(const void *,size_t);
 
+		void getStats(FifoMonitor::stats_t &) const;
+		void resetStats(void);
+
 	private:
 
 		char *data;
@@ -42,6 +46,7 @@ class Fifo
 		size_t size;
 		pthread_mutex_t mutex;
 		pthread_cond_t data_available;
+		FifoMonitor::Counters counters;
 
 };
 
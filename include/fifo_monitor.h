@@ -0,0 +1,193 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef FIFO_MONITOR_H
+#define FIFO_MONITOR_H
+
+#include <atomic>
+#include <cstdlib>
+#include <list>
+#include <mutex.h>
+#include <string>
+
+//! Fill level and loss telemetry for every FIFO in the system.
+/*!
+ * Each FIFO registers itself with the Manager when it is constructed so
+ *   that panels and other tools can inspect it by name.
+ */
+namespace FifoMonitor {
+
+	/*!
+	 * Snapshot of the counters kept by a FIFO.
+	 */
+	struct stats_t {
+		size_t capacity;        /*!< Size of the FIFO in bytes */
+		size_t used;            /*!< Bytes written but not yet read */
+		size_t highWater;       /*!< Largest value of used since the last reset */
+		size_t failedWrites;    /*!< Writes dropped because the FIFO was full */
+		long long maxStall;     /*!< Longest gap in ns between consumer reads while data was waiting */
+	};
+
+	/*!
+	 * Counters shared by the FIFO implementations. The producer owns
+	 *   highWater and failedWrites, the consumer owns the stall clock.
+	 */
+	class Counters {
+
+		public:
+
+			Counters(void);
+
+			void reset(void);
+
+			/*!
+			 * Called by the producer after a write with the new fill level.
+			 */
+			void wrote(size_t used);
+
+			/*!
+			 * Called by the producer when data was lost.
+			 */
+			void failed(void);
+
+			/*!
+			 * Called by the consumer after a successful read.
+			 *
+			 * \param remaining Bytes still waiting after the read.
+			 */
+			void consumed(size_t remaining);
+
+			void fill(stats_t &) const;
+
+		private:
+
+			std::atomic<size_t> highWater;
+			std::atomic<size_t> failedWrites;
+			std::atomic<long long> maxStall;
+			long long lastRead;
+
+	}; // class Counters
+
+	class Manager;
+
+	/*!
+	 * Base class for objects whose statistics are published through the Manager.
+	 */
+	class Source {
+
+		friend class Manager;
+
+		public:
+
+			Source(const std::string &);
+			virtual ~Source(void);
+
+			std::string getName(void) const;
+			void setName(const std::string &);
+
+			/*!
+			 * Fill in the current statistics of the FIFO.
+			 */
+			virtual void getStats(stats_t &) const=0;
+
+			/*!
+			 * Clear the high-water mark, drop and stall counters.
+			 */
+			virtual void resetStats(void)=0;
+
+		protected:
+
+			/*!
+			 * Must be called first thing in the destructor of derived classes
+			 *   so that getStats() is never invoked on a partially destroyed object.
+			 */
+			void unregisterSource(void);
+
+		private:
+
+			std::string name;
+			bool registered;
+
+	}; // class Source
+
+	/*!
+	 * Registry of all live FIFOs.
+	 */
+	class Manager {
+
+		friend class Source;
+
+		public:
+
+		/*!
+		 * Manager is a Singleton, which means that there can only be one instance.
+		 *   This function returns a pointer to that single instance.
+		 *
+		 * \return The instance of Manager.
+		 */
+		static Manager *getInstance(void);
+
+		/*!
+		 * Loop through each registered FIFO and execute a callback.
+		 * The callback takes three parameters, the FIFO, a snapshot of its
+		 *   statistics and param, the second parameter to foreachFifo.
+		 *
+		 * \param callback The callback function.
+		 * \param param A parameter to the callback function.
+		 */
+		void foreachFifo(void (*callback)(Source *,const stats_t &,void *),void *param);
+
+		/*!
+		 * Look up the statistics of a FIFO by name.
+		 *
+		 * \return False if no FIFO with that name is registered.
+		 */
+		bool getStats(const std::string &name,stats_t &stats);
+
+		/*!
+		 * Reset the counters of every registered FIFO.
+		 */
+		void resetAll(void);
+
+		private:
+
+		/*****************************************************************
+		 * The constructor, destructor, and assignment operator are made *
+		 *   private to control instantiation of the class.              *
+		 *****************************************************************/
+
+		Manager(void) : mutex(Mutex::RECURSIVE) {};
+		~Manager(void) {};
+		Manager(const Manager &) : mutex(Mutex::RECURSIVE) {};
+		Manager &operator=(const Manager &) { return *getInstance(); };
+
+		static Manager *instance;
+
+		void insertSource(Source *);
+		void removeSource(Source *);
+
+		// Recursive so that foreachFifo callbacks may call Source::getName()
+		Mutex mutex;
+		std::list<Source *> sourceList;
+
+	}; // class Manager
+
+}; // namespace FifoMonitor
+
+#endif /* FIFO_MONITOR_H */
@@ -0,0 +1,118 @@
+/*
+ Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef MPSC_FIFO_H
+#define MPSC_FIFO_H
+
+#include <cstdlib>
+#include <atomic>
+#include <fifo_monitor.h>
+
+//! Lockfree MULTIPLE producer / SINGLE consumer FIFO
+/*
+ * Bounded ring of fixed-size slots. Each slot carries a sequence number,
+ * producers claim slots by advancing a shared ticket and publish them by
+ * bumping the slot sequence, so write() never blocks and never takes a
+ * lock. Items from the same producer are read in the order they were
+ * written. Only one thread may consume ( call read() ).
+ *
+ */
+
+class MpscFifo : public FifoMonitor::Source {
+
+public:
+    MpscFifo(size_t slotSize, size_t slotCount, const std::string &name = "MpscFifo");
+    ~MpscFifo(void);
+
+    /*!
+     * Function for writing one item to the FIFO, safe from any thread
+     *
+     * \param buffer Memory source
+     * \param itemSize Size of the item, at most getSlotSize() bytes
+     * \return False if the FIFO is full or the item is too large
+     */
+    bool write(const void *buffer, size_t itemSize);
+
+    /*!
+     * Function for writing one item made of a header and a payload
+     *   without assembling it in a temporary buffer first
+     *
+     * \param header Memory source of the first part
+     * \param headerSize Size of the first part
+     * \param payload Memory source of the second part
+     * \param payloadSize Size of the second part
+     * \return False if the FIFO is full or the item is too large
+     */
+    bool write(const void *header, size_t headerSize, const void *payload, size_t payloadSize);
+
+    /*!
+     * Function for reading a batch of items from the FIFO. Item i is
+     *   copied to buffer + i*getSlotSize().
+     *
+     * \param buffer Memory destination, at least maxItems*getSlotSize() bytes
+     * \param maxItems Maximum number of items to be read
+     * \param sizes Optional array receiving the size of each item read
+     * \return Number of items read
+     */
+    size_t read(void *buffer, size_t maxItems, size_t *sizes = 0);
+
+    size_t getSlotSize(void) const { return slotSize; };
+    size_t getSlotCount(void) const { return slotCount; };
+
+    /*!
+     *
+     * Function to check if FIFO is truly atomic for the hardware architecture
+     *
+     */
+    bool isLockFree() const;
+
+    /*!
+     * Function to silence the "fifo full" message, for users that
+     *   account for lost items themselves.
+     */
+    void setQuiet(bool q) { quiet = q; };
+
+    void getStats(FifoMonitor::stats_t &) const;
+    void resetStats(void);
+
+private:
+    struct slot_t {
+        std::atomic<size_t> sequence;
+        size_t size;
+    };
+
+    slot_t *claim(size_t itemSize);
+    slot_t *getSlot(size_t pos) const;
+    char *getData(slot_t *) const;
+    size_t used(size_t enqueue) const;
+
+    char *data;
+    size_t slotSize;
+    size_t slotStride;
+    size_t slotCount;
+    size_t mask;
+    bool quiet;
+
+    std::atomic<size_t> enqueuePos;
+    std::atomic<size_t> dequeuePos; // Written by the consumer only, atomic so getStats() may read it
+
+    FifoMonitor::Counters counters;
+
+};
+
+#endif /* MPSC_FIFO_H */
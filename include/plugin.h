@@ -152,6 +152,20 @@ namespace Plugin {
 		 */
 		std::string getLibrary(void) const;
 
+		/*!
+		 * Get the size of the text, data and BSS of the library.
+		 *
+		 * \return The size in bytes, 0 if the object was not loaded from a library.
+		 */
+		size_t getImageSize(void) const;
+
+		/*!
+		 * Get how much of the library image was locked in memory when it was loaded.
+		 *
+		 * \return The locked size in bytes.
+		 */
+		size_t getLockedMemory(void) const;
+
 		/*!
 		 * A mechanism which an object can use to unload itself. Should only be
 		 *   called from within the GUI thread.
@@ -164,6 +178,8 @@ namespace Plugin {
 		u_int32_t magic_number;
 		std::string library;
 		void *handle;
+		size_t imageSize;
+		size_t lockedMemory;
 
 	}; // class Object
 
@@ -0,0 +1,152 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RAW_CAPTURE_H
+#define RAW_CAPTURE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define RAW_CAPTURE_MAGIC     "RTXIRAW"
+#define RAW_CAPTURE_VERSION   1
+#define RAW_CAPTURE_ALIGN     4096
+#define RAW_CAPTURE_NAME_SIZE 256
+
+//! Append-only binary capture written by the Data Recorder.
+/*!
+ * A capture file is a sequence of trials. Each trial starts on a
+ *   RAW_CAPTURE_ALIGN boundary with a trial_header_t followed by one
+ *   channel_t per channel. The frames start at headerSize, which is
+ *   aligned as well, so they can be mapped and used as a plain
+ *   frameCount by channelCount array of doubles.
+ *
+ * The asynchronous data and parameter sections follow the frames.
+ *   They are sequences of record_t, each followed by its payload, and
+ *   are written when the trial stops. All offsets are relative to the
+ *   start of the trial.
+ *
+ * A trial that was never stopped has a stopTime of zero. Its frames
+ *   run to the end of the file and it has no sections.
+ *
+ * rtxi_raw_convert turns a capture into the usual HDF5 trial layout.
+ */
+namespace RawCapture {
+
+	enum record_type_t {
+		ASYNC = 1,                  /*!< payload: the samples as doubles */
+		PARAM,                      /*!< payload: param_record_t, then the name */
+		COMMENT,                    /*!< payload: the name, then the text */
+	};
+
+	struct trial_header_t {
+		char magic[8];
+		uint32_t version;
+		uint32_t channelCount;
+		uint64_t headerSize;        /*!< offset of the first frame */
+		uint64_t frameSize;         /*!< bytes per frame */
+		uint64_t frameCount;
+		int64_t period;             /*!< ns */
+		int64_t downsample;
+		int64_t startTime;          /*!< ns */
+		int64_t stopTime;           /*!< ns, zero until the trial stops */
+		int64_t trialLength;        /*!< ns */
+		uint64_t asyncOffset;
+		uint64_t asyncSize;
+		uint64_t paramOffset;
+		uint64_t paramSize;
+		uint64_t trialSize;         /*!< offset of the next trial */
+		char date[32];
+	};
+
+	struct channel_t {
+		char name[RAW_CAPTURE_NAME_SIZE];
+	};
+
+	struct record_t {
+		uint32_t type;
+		uint32_t size;              /*!< payload bytes */
+		int64_t time;               /*!< ns */
+	};
+
+	struct param_record_t {
+		int64_t index;              /*!< sample the change applies from */
+		double value;
+	};
+
+	inline uint64_t align(uint64_t n) {
+		return (n + RAW_CAPTURE_ALIGN - 1) & ~static_cast<uint64_t>(RAW_CAPTURE_ALIGN - 1);
+	}
+
+	inline uint64_t headerSize(uint32_t channels) {
+		return align(sizeof(trial_header_t) + channels * sizeof(channel_t));
+	}
+
+	/*!
+	 * \return True if size bytes at offset fit in limit bytes.
+	 */
+	inline bool fits(uint64_t offset, uint64_t size, uint64_t limit) {
+		return offset <= limit && size <= limit - offset;
+	}
+
+	/*!
+	 * Read the header of the trial at offset. The frame count and size
+	 *   of a trial that was never stopped are derived from the file size.
+	 *
+	 * \param fd The capture file.
+	 * \param offset Offset of the trial in the file.
+	 * \param fileSize Size of the file.
+	 * \param header The header read.
+	 * \return 0 on success, -1 if there is no valid trial at offset, or if
+	 *   its frames or records don't fit in the trial and the file.
+	 */
+	inline int readTrial(int fd, uint64_t offset, uint64_t fileSize, trial_header_t &header) {
+		if (offset + sizeof(header) > fileSize ||
+				pread(fd, &header, sizeof(header), offset) != static_cast<ssize_t>(sizeof(header)))
+			return -1;
+		if (memcmp(header.magic, RAW_CAPTURE_MAGIC, sizeof(RAW_CAPTURE_MAGIC)) ||
+				header.version != RAW_CAPTURE_VERSION ||
+				header.headerSize != headerSize(header.channelCount) ||
+				header.frameSize != header.channelCount * sizeof(double))
+			return -1;
+
+		if (!header.stopTime) {
+			uint64_t frames = offset + header.headerSize < fileSize ? fileSize - offset - header.headerSize : 0;
+			header.frameCount = header.frameSize ? frames / header.frameSize : 0;
+			header.asyncSize = header.paramSize = 0;
+			header.trialSize = fileSize - offset;
+		}
+
+		if (header.trialSize < header.headerSize || offset + header.trialSize > align(fileSize))
+			return -1;
+
+		// The last trial is padded to the alignment, which may be missing
+		uint64_t limit = header.trialSize < fileSize - offset ? header.trialSize : fileSize - offset;
+		if (!fits(0, header.headerSize, limit) ||
+				(header.frameSize && header.frameCount > (limit - header.headerSize) / header.frameSize) ||
+				(header.asyncSize && !fits(header.asyncOffset, header.asyncSize, limit)) ||
+				(header.paramSize && !fits(header.paramOffset, header.paramSize, limit)))
+			return -1;
+		return 0;
+	}
+
+} // namespace RawCapture
+
+#endif // RAW_CAPTURE_H
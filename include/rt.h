@@ -48,6 +48,13 @@ namespace RT {
 
 		bool isRealtime(void);
 
+		/*!
+		 * Whether the calling thread may make a Linux system call without
+		 *   leaving realtime. False in the realtime task under Xenomai,
+		 *   where it causes a mode switch, and under RTAI.
+		 */
+		bool canSyscall(void);
+
 		/*!
 		 * Returns the current CPU time in nanoseconds. In general
 		 *   this is really only useful for determining the time
@@ -0,0 +1,115 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RT_ARENA_H
+#define RT_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <stdint.h>
+#include <string>
+
+namespace RT {
+
+	/*!
+	 * A block of memory that is mapped, prefaulted and locked when it is
+	 *   constructed, so that the realtime thread can take memory from it
+	 *   without calling malloc or touching a fresh page. Allocation is a
+	 *   lock-free bump of an offset, memory is only returned all at once
+	 *   when the Arena is destroyed.
+	 *
+	 * Every Arena is tagged with an owner, normally the plugin that created
+	 *   it, and can be inspected through foreachArena().
+	 */
+	class Arena {
+
+		public:
+
+			struct stats_t {
+				size_t size;            /*!< Bytes mapped */
+				size_t used;            /*!< Bytes handed out */
+				size_t failed;          /*!< Allocations refused because the Arena was full */
+				bool hugePages;         /*!< Backed by huge pages */
+				bool locked;            /*!< mlock() succeeded */
+			};
+
+			/*!
+			 * \param owner Name used to account the memory, usually the plugin name.
+			 * \param name Name of this Arena within the owner.
+			 * \param size Number of bytes to reserve.
+			 * \param hugePages Try to back the Arena with huge pages, falls back
+			 *   to normal pages if none are available.
+			 */
+			Arena(const std::string &owner,const std::string &name,size_t size,bool hugePages =false);
+			~Arena(void);
+
+			/*!
+			 * Take memory from the Arena, safe from any thread including realtime.
+			 *
+			 * \return A pointer to the memory, or 0 if the Arena is exhausted.
+			 */
+			void *allocate(size_t size,size_t alignment =sizeof(double));
+
+			/*!
+			 * Allocate and construct an array of n objects.
+			 */
+			template<typename T>
+				T *allocateArray(size_t n) {
+					void *p = allocate(n*sizeof(T),alignof(T));
+					return p ? new (p) T[n] : 0;
+				};
+
+			const std::string &getOwner(void) const { return owner; };
+			const std::string &getName(void) const { return name; };
+			size_t getSize(void) const { return size; };
+			size_t getUsed(void) const { return used.load(std::memory_order_relaxed); };
+			void getStats(stats_t &) const;
+
+			/*!
+			 * Loop through each Arena and execute a callback.
+			 * The callback takes two parameters, an Arena pointer and param,
+			 *   the second parameter to foreachArena.
+			 *
+			 * \param callback The callback function.
+			 * \param param A parameter to the callback function.
+			 */
+			static void foreachArena(void (*callback)(Arena *,void *),void *param);
+
+		private:
+
+			Arena(const Arena &);
+			Arena &operator=(const Arena &);
+
+			std::string owner;
+			std::string name;
+			char *base;
+			size_t size;
+			size_t mapped;
+			bool hugePages;
+			bool locked;
+			std::atomic<size_t> used;
+			std::atomic<size_t> failed;
+
+	}; // class Arena
+
+} // namespace RT
+
+#endif // RT_ARENA_H
@@ -0,0 +1,115 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RT_DIAGNOSTICS_H
+#define RT_DIAGNOSTICS_H
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+
+#define RTDIAG_MAX_OBJECTS 128
+
+namespace RT {
+	class Device;
+	class Thread;
+};
+
+//! Opt-in detector for page faults and heap use in the realtime thread.
+/*!
+ * While enabled, RT::System::execute() marks which RT::Device or RT::Thread
+ *   it is running and reads the fault counters of the realtime thread at
+ *   every switch. malloc, free, new and delete are interposed, and any call
+ *   made in realtime is counted against the object that was running and
+ *   logged through RTLog.
+ *
+ * Reading the fault counters is a system call, so under Xenomai every tick
+ *   traced this way leaves primary mode. Only enable it to hunt a problem.
+ */
+namespace RTDiagnostics {
+
+	enum kind_t {
+		SYSTEM,     /*!< RT::System itself, between objects and in events */
+		DEVICE,
+		THREAD,
+	};
+
+	/*!
+	 * Counters for one object, a snapshot as returned by foreachObject().
+	 */
+	struct object_stats_t {
+		const void *object;
+		kind_t kind;
+		size_t allocations;
+		size_t frees;
+		size_t bytes;
+		size_t minorFaults;
+		size_t majorFaults;
+	};
+
+	struct tick_stats_t {
+		size_t ticks;               /*!< Ticks traced */
+		size_t faultTicks;          /*!< Ticks with at least one fault */
+		size_t maxFaults;           /*!< Most faults in a single tick */
+		size_t allocations;         /*!< Heap calls made in realtime */
+	};
+
+	void setEnabled(bool);
+	bool isEnabled(void);
+
+	/*!
+	 * Clear all counters. The realtime thread does the clearing at the
+	 *   start of its next traced tick.
+	 */
+	void reset(void);
+
+	/*!
+	 * Loop through each object that faulted or allocated and execute a
+	 *   callback with a snapshot of its counters.
+	 */
+	void foreachObject(void (*callback)(const object_stats_t &,void *),void *param);
+	void getTickStats(tick_stats_t &);
+
+	/*!
+	 * Name of a traced object, if it is still registered with RT::System.
+	 *   Must not be called in realtime.
+	 */
+	std::string describe(const object_stats_t &);
+
+	/*!
+	 * Print a summary of the counters to standard error.
+	 */
+	void report(void);
+
+	/******************************************************************
+	 * Tracing hooks for RT::System::execute(), realtime thread only. *
+	 ******************************************************************/
+
+	/*!
+	 * Start a tick, returns whether the hooks below should be called in it.
+	 */
+	bool beginTick(void);
+	void enter(const RT::Device *);
+	void enter(const RT::Thread *);
+	void leave(void);
+	void endTick(void);
+
+}; // namespace RTDiagnostics
+
+#endif /* RT_DIAGNOSTICS_H */
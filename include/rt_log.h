@@ -0,0 +1,195 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RT_LOG_H
+#define RT_LOG_H
+
+#include <cstddef>
+#include <string.h>
+#include <type_traits>
+
+#define RTLOG_MAX_ARGS    12
+#define RTLOG_STRING_SIZE 128
+
+//! Lockfree message log for the realtime thread.
+/*!
+ * Messages posted from the realtime thread are not formatted there.
+ *   Instead the format pointer and the binary value of each argument
+ *   are copied into a preallocated ring, and a background thread does
+ *   the formatting and the writing to standard error. ERROR_MSG and
+ *   DEBUG_MSG use this path automatically when called in realtime.
+ *
+ * The format string must have static storage duration, as string
+ *   literals do. String arguments are copied, up to RTLOG_STRING_SIZE
+ *   bytes in total per message.
+ */
+namespace RTLog {
+
+	enum arg_type_t {
+		SIGNED,
+		UNSIGNED,
+		FLOATING,
+		POINTER,
+		STRING,
+		UNKNOWN,                    /*!< No capture for the type, printed as "(?)" */
+	};
+
+	struct arg_t {
+		unsigned char type;
+		unsigned char size;         /*!< sizeof() the original integer type */
+		union {
+			long long i;
+			unsigned long long u;
+			double d;
+			const void *p;
+			size_t offset;          /*!< STRING: offset into record_t::text */
+		} value;
+	};
+
+	struct record_t {
+		const char *file;
+		const char *fmt;
+		long long time;
+		int line;
+		unsigned char nargs;
+		unsigned short textUsed;
+		arg_t args[RTLOG_MAX_ARGS];
+		char text[RTLOG_STRING_SIZE];
+	};
+
+	/*!
+	 * Start the background thread that formats and prints messages.
+	 *   Called by RT::System before the realtime task is created.
+	 */
+	int start(void);
+
+	/*!
+	 * Print everything still queued and stop the background thread.
+	 */
+	void stop(void);
+
+	/*!
+	 * Timestamp a filled record and queue it. Never blocks; if the ring
+	 *   is full the message is counted as dropped.
+	 */
+	void submit(record_t &);
+
+	/*!
+	 * Number of messages lost because the ring was full.
+	 */
+	size_t getDropped(void);
+
+	/******************************************************************
+	 * Argument capture, everything below runs in the realtime thread *
+	 ******************************************************************/
+
+	inline void pack(record_t &r,const char *s) {
+		arg_t &a = r.args[r.nargs++];
+		a.type = STRING;
+		a.size = 0;
+		a.value.offset = r.textUsed;
+
+		// Once text is full, the terminator of the last string stands for
+		// the ones that don't fit
+		if (r.textUsed >= RTLOG_STRING_SIZE) {
+			a.value.offset = RTLOG_STRING_SIZE-1;
+			return;
+		}
+
+		if (!s)
+			s = "(null)";
+		size_t room = RTLOG_STRING_SIZE-r.textUsed;
+		size_t n = strnlen(s,room-1);
+		memcpy(r.text+r.textUsed,s,n);
+		r.text[r.textUsed+n] = '\0';
+		r.textUsed += n+1;
+	}
+
+	inline void pack(record_t &r,char *s) {
+		pack(r,static_cast<const char *>(s));
+	}
+
+	template<typename T>
+		typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+		pack(record_t &r,T v) {
+			arg_t &a = r.args[r.nargs++];
+			a.size = sizeof(T);
+			if (std::is_signed<T>::value || std::is_enum<T>::value) {
+				a.type = SIGNED;
+				a.value.i = static_cast<long long>(v);
+			} else {
+				a.type = UNSIGNED;
+				a.value.u = static_cast<unsigned long long>(v);
+			}
+		}
+
+	template<typename T>
+		typename std::enable_if<std::is_floating_point<T>::value>::type
+		pack(record_t &r,T v) {
+			arg_t &a = r.args[r.nargs++];
+			a.type = FLOATING;
+			a.size = sizeof(double);
+			a.value.d = static_cast<double>(v);
+		}
+
+	template<typename T>
+		void pack(record_t &r,const T *p) {
+			arg_t &a = r.args[r.nargs++];
+			a.type = POINTER;
+			a.size = sizeof(void *);
+			a.value.p = p;
+		}
+
+	template<typename T>
+		typename std::enable_if<!std::is_arithmetic<T>::value && !std::is_enum<T>::value && !std::is_pointer<T>::value>::type
+		pack(record_t &r,const T &) {
+			arg_t &a = r.args[r.nargs++];
+			a.type = UNKNOWN;
+			a.size = 0;
+			a.value.p = 0;
+		}
+
+	inline void packAll(record_t &) {}
+
+	template<typename T,typename... Args>
+		void packAll(record_t &r,T v,Args... args) {
+			if (r.nargs >= RTLOG_MAX_ARGS)
+				return;
+			pack(r,v);
+			packAll(r,args...);
+		}
+
+	/*!
+	 * Queue a printf style message from the realtime thread.
+	 */
+	template<typename... Args>
+		void post(const char *file,int line,const char *fmt,Args... args) {
+			record_t r;
+			r.file = file;
+			r.fmt = fmt;
+			r.line = line;
+			r.nargs = 0;
+			r.textUsed = 0;
+			packAll(r,args...);
+			submit(r);
+		}
+
+}; // namespace RTLog
+
+#endif /* RT_LOG_H */
@@ -0,0 +1,74 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RT_MEMORY_H
+#define RT_MEMORY_H
+
+#include <cstdlib>
+
+// Default number of bytes of stack touched when the realtime task starts
+#define RTMEMORY_STACK_DEPTH (256*1024)
+
+//! Prefaulting and locking of memory the realtime thread will touch.
+/*!
+ * mlockall() at start-up covers what is mapped at that time, and only if
+ *   RLIMIT_MEMLOCK allows it. These helpers fault in and lock memory that
+ *   appears later, the realtime stack and the image of every plugin, and
+ *   check that it really is resident.
+ */
+namespace RTMemory {
+
+	struct region_stats_t {
+		size_t size;        /*!< Bytes in the region */
+		size_t resident;    /*!< Bytes found resident by mincore() after touching */
+		size_t locked;      /*!< Bytes successfully passed to mlock() */
+	};
+
+	/*!
+	 * Set how much of the realtime stack is prefaulted. Must be called
+	 *   before RT::System is created.
+	 */
+	void setStackDepth(size_t bytes);
+	size_t getStackDepth(void);
+
+	/*!
+	 * Touch and lock the top of the calling thread's stack, clamped to
+	 *   the size of that stack. Called by the realtime task on start-up.
+	 */
+	void prefaultStack(region_stats_t &stats);
+
+	/*!
+	 * Touch and lock the text, data and BSS of a library opened with dlopen().
+	 *
+	 * \param handle The handle returned by dlopen().
+	 * \param stats Filled with the size of the image and how much of it is locked.
+	 * \return False if the image could not be found or not all of it was locked.
+	 */
+	bool lockLibrary(void *handle,region_stats_t &stats);
+
+	/*!
+	 * Warn if locking another size bytes would exceed RLIMIT_MEMLOCK.
+	 *
+	 * \return False if the budget is insufficient.
+	 */
+	bool checkBudget(size_t size,const char *what);
+
+}; // namespace RTMemory
+
+#endif /* RT_MEMORY_H */
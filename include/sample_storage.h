@@ -0,0 +1,270 @@
+/*
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SAMPLE_STORAGE_H
+#define SAMPLE_STORAGE_H
+
+#include <hdf5.h>
+#include <hdf5_hl.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//! Storage types of the channels in a Data Recorder table.
+/*!
+ * A table whose channels are all FLOAT64 is stored as rows of doubles,
+ *   like it always was. Otherwise each row is a packed compound with a
+ *   member per channel, named by its column number, and the BIT channels
+ *   packed into a trailing "Bits" member, the first one in bit 0. The
+ *   "Storage", "Scale" and "Offset" attributes of the table hold the type
+ *   of each column and how INT16 columns map back to values.
+ *
+ * In the columnar layout each column is stored with its own type, and an
+ *   INT16 column has its scale and offset attached.
+ *
+ * Readers get the values back as doubles with unpack().
+ */
+namespace SampleStorage {
+
+	enum type_t {
+		FLOAT64,
+		FLOAT32,
+		INT16,                      /*!< value = stored * scale + offset */
+		BIT,                        /*!< a digital line, stored as one bit */
+	};
+
+	struct column_t {
+		int type;
+		double scale;
+		double offset;
+	};
+
+	struct layout_t {
+		std::vector<column_t> columns;
+		std::vector<size_t> position; /*!< byte offset, or bit index for BIT */
+		size_t bits;                  /*!< BIT columns */
+		size_t bitOffset;             /*!< byte offset of the Bits member */
+		size_t size;                  /*!< bytes per row */
+		bool narrow;                  /*!< not all FLOAT64 */
+	};
+
+	inline size_t typeSize(int type) {
+		switch (type) {
+			case FLOAT32:
+				return sizeof(float);
+			case INT16:
+				return sizeof(int16_t);
+			case BIT:
+				return 0;
+			default:
+				return sizeof(double);
+		}
+	}
+
+	/*!
+	 * Scale and offset of an INT16 column that covers minimum to maximum.
+	 */
+	inline column_t int16Column(double minimum, double maximum) {
+		column_t column = { INT16, (maximum - minimum) / 65534.0, (maximum + minimum) / 2.0, };
+		if (!(column.scale > 0.0))
+			column.scale = 1.0;
+		return column;
+	}
+
+	/*!
+	 * Lay out a row of the given columns.
+	 */
+	inline void setup(layout_t &layout, const std::vector<column_t> &columns) {
+		layout.columns = columns;
+		layout.position.resize(columns.size());
+		layout.bits = 0;
+		layout.size = 0;
+		layout.narrow = false;
+		for (size_t i = 0; i < columns.size(); ++i) {
+			if (columns[i].type == BIT)
+				layout.position[i] = layout.bits++;
+			else {
+				layout.position[i] = layout.size;
+				layout.size += typeSize(columns[i].type);
+			}
+			layout.narrow = layout.narrow || columns[i].type != FLOAT64;
+		}
+		layout.bitOffset = layout.size;
+		layout.size += (layout.bits + 7) / 8;
+	}
+
+	/*!
+	 * \return The file type of a column on its own, like in the columnar layout.
+	 */
+	inline hid_t columnType(int type) {
+		switch (type) {
+			case FLOAT32:
+				return H5Tcopy(H5T_IEEE_F32LE);
+			case INT16:
+				return H5Tcopy(H5T_STD_I16LE);
+			case BIT:
+				return H5Tcopy(H5T_STD_U8LE);
+			default:
+				return H5Tcopy(H5T_IEEE_F64LE);
+		}
+	}
+
+	/*!
+	 * \return The file type of a row, to be closed by the caller.
+	 */
+	inline hid_t rowType(const layout_t &layout) {
+		if (!layout.narrow) {
+			hsize_t array_size[] = { layout.columns.size() };
+			return H5Tarray_create(H5T_IEEE_F64LE, 1, array_size);
+		}
+
+		hid_t type = H5Tcreate(H5T_COMPOUND, layout.size);
+		for (size_t i = 0; i < layout.columns.size(); ++i) {
+			if (layout.columns[i].type == BIT)
+				continue;
+			hid_t member = columnType(layout.columns[i].type);
+			H5Tinsert(type, std::to_string(i + 1).c_str(), layout.position[i], member);
+			H5Tclose(member);
+		}
+		if (layout.bits) {
+			hsize_t bytes[] = { (layout.bits + 7) / 8 };
+			hid_t member = H5Tarray_create(H5T_STD_U8LE, 1, bytes);
+			H5Tinsert(type, "Bits", layout.bitOffset, member);
+			H5Tclose(member);
+		}
+		return type;
+	}
+
+	/*!
+	 * Attach the storage of a table to it, nothing is attached to rows of doubles.
+	 */
+	inline void writeAttributes(hid_t group, const char *name, const layout_t &layout) {
+		if (!layout.narrow)
+			return;
+
+		std::vector<int> types;
+		std::vector<double> scales, offsets;
+		for (size_t i = 0; i < layout.columns.size(); ++i) {
+			types.push_back(layout.columns[i].type);
+			scales.push_back(layout.columns[i].type == INT16 ? layout.columns[i].scale : 1.0);
+			offsets.push_back(layout.columns[i].type == INT16 ? layout.columns[i].offset : 0.0);
+		}
+		H5LTset_attribute_int(group, name, "Storage", &types[0], types.size());
+		H5LTset_attribute_double(group, name, "Scale", &scales[0], scales.size());
+		H5LTset_attribute_double(group, name, "Offset", &offsets[0], offsets.size());
+	}
+
+	/*!
+	 * Read the layout of a table back from its attributes.
+	 *
+	 * \return 0 on success, -1 if the table is stored as rows of doubles.
+	 */
+	inline int readAttributes(hid_t data, layout_t &layout) {
+		if (H5Aexists(data, "Storage") <= 0)
+			return -1;
+
+		hsize_t count;
+		H5T_class_t type_class;
+		size_t type_size;
+		if (H5LTget_attribute_info(data, ".", "Storage", &count, &type_class, &type_size) < 0 || !count)
+			return -1;
+
+		std::vector<int> types(count);
+		std::vector<double> scales(count, 1.0), offsets(count, 0.0);
+		H5LTget_attribute_int(data, ".", "Storage", &types[0]);
+		H5LTget_attribute_double(data, ".", "Scale", &scales[0]);
+		H5LTget_attribute_double(data, ".", "Offset", &offsets[0]);
+
+		std::vector<column_t> columns(count);
+		for (size_t i = 0; i < count; ++i) {
+			column_t column = { types[i], scales[i], offsets[i], };
+			columns[i] = column;
+		}
+		setup(layout, columns);
+		return 0;
+	}
+
+	/*!
+	 * Convert rows of doubles, stride doubles apart, into stored rows.
+	 */
+	inline void pack(const layout_t &layout, const double *in, size_t rows, size_t stride, char *out) {
+		for (size_t r = 0; r < rows; ++r, in += stride, out += layout.size) {
+			if (layout.bits)
+				memset(out + layout.bitOffset, 0, (layout.bits + 7) / 8);
+			for (size_t i = 0; i < layout.columns.size(); ++i) {
+				const column_t &column = layout.columns[i];
+				char *slot = out + layout.position[i];
+				double x = in[i];
+				switch (column.type) {
+					case FLOAT32: {
+						float y = x;
+						memcpy(slot, &y, sizeof(y));
+						break;
+					}
+					case INT16: {
+						double y = nearbyint((x - column.offset) / column.scale);
+						int16_t v = y >= 32767.0 ? 32767 : (y <= -32767.0 ? -32767 : (y == y ? static_cast<int16_t>(y) : 0));
+						memcpy(slot, &v, sizeof(v));
+						break;
+					}
+					case BIT:
+						if (x >= 0.5)
+							out[layout.bitOffset + layout.position[i] / 8] |= 1 << (layout.position[i] % 8);
+						break;
+					default:
+						memcpy(out + layout.position[i], &x, sizeof(x));
+				}
+			}
+		}
+	}
+
+	/*!
+	 * Convert stored rows back into rows of doubles.
+	 */
+	inline void unpack(const layout_t &layout, const char *in, size_t rows, double *out) {
+		for (size_t r = 0; r < rows; ++r, in += layout.size, out += layout.columns.size())
+			for (size_t i = 0; i < layout.columns.size(); ++i) {
+				const column_t &column = layout.columns[i];
+				const char *slot = in + layout.position[i];
+				switch (column.type) {
+					case FLOAT32: {
+						float y;
+						memcpy(&y, slot, sizeof(y));
+						out[i] = y;
+						break;
+					}
+					case INT16: {
+						int16_t v;
+						memcpy(&v, slot, sizeof(v));
+						out[i] = v * column.scale + column.offset;
+						break;
+					}
+					case BIT:
+						out[i] = (in[layout.bitOffset + layout.position[i] / 8] >> (layout.position[i] % 8)) & 1;
+						break;
+					default:
+						memcpy(&out[i], slot, sizeof(double));
+				}
+			}
+	}
+
+} // namespace SampleStorage
+
+#endif // SAMPLE_STORAGE_H
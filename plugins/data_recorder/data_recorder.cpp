@@ -16,8 +16,14 @@
 
  */
 
+#include <algorithm>
+#include <cmath>
 #include <daq.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <string>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <compiler.h>
 #include <debug.h>
@@ -25,6 +31,7 @@
 #include <sstream>
 #include <workspace.h>
 #include <data_recorder.h>
+#include <writer_limits.h>
 #include <iostream>
 #include <pthread.h>
 
@@ -33,11 +40,42 @@
 #define QDisableGroupsEvent         (QEvent::User+2)
 #define QEnableGroupsEvent          (QEvent::User+3)
 
-struct param_hdf_t
-{
-	long long index;
-	double value;
-};
+// Parameter changes and Asynchronous Data entries are appended to their
+// tables once this many are pending
+#define WRITER_EVENT_ROWS           1024
+
+// Files written for SWMR readers get their metadata flushed this often, so
+// readers see the rows appended since
+#define SWMR_FLUSH_INTERVAL         250000000ll // ns
+
+// Tick jitter that fits in the Jitter table, and chunks of the timestamp
+// tables in ticks and exceptions
+#define STAMP_MAX_JITTER            32767 // ns
+#define STAMP_CHUNK_TICKS           16384
+#define STAMP_CHUNK_EXCEPTIONS      256
+
+// Chunks of the Asynchronous Data tables, in samples and index entries
+#define ASYNC_CHUNK_SAMPLES         4096
+#define ASYNC_CHUNK_ENTRIES         512
+
+// Asynchronous data and parameter changes share a multi-producer ring,
+// whose slots together hold as much as the sample FIFO but never fewer
+// than EVENT_MIN_SAMPLES each
+#define EVENT_FIFO_SLOTS            128
+#define EVENT_MIN_SAMPLES           2048
+#define EVENT_READ_SLOTS            16
+
+// Prefaulted memory for the frames staged by the realtime thread
+#define FRAME_ARENA_SIZE            (1024*1024)
+#define FRAME_MIN_CHANNELS          64
+
+// The realtime thread packs up to PACK_MAX_TICKS ticks into one token, but
+// never holds on to more than PACK_MAX_LATENCY worth of samples
+#define PACK_MAX_TICKS              1024
+#define PACK_MAX_LATENCY            50000000ll // ns
+
+// Longest pre- and post-trigger windows of triggered recording
+#define TRIGGER_MAX_WINDOW          60000 // ms
 
 struct find_daq_t {
 	int index;
@@ -76,17 +114,18 @@ namespace
 		list->push_back(block);
 	};
 
-	struct FileExistsEventData
-	{
-		QString filename;
-		int response;
-		QWaitCondition done;
+	// Answers to the file exists question, in the order of its buttons
+	enum open_reply_t {
+		OPEN_APPEND,
+		OPEN_OVERWRITE,
+		OPEN_CANCEL,
+		OPEN_PENDING,
 	};
 
+	// Owned by the event, deleted once the GUI handled it
 	struct SetFileNameEditEventData
 	{
 		QString filename;
-		QWaitCondition done;
 	};
 
 	class InsertChannelEvent: public RT::Event
@@ -121,61 +160,60 @@ namespace
 	class OpenFileEvent: public RT::Event
 	{
 		public:
-			OpenFileEvent(QString &, AtomicFifo &);
+			OpenFileEvent(QString &, DataRecorder::Panel &);
 			~OpenFileEvent(void);
 			int callback(void);
 
 		private:
 			QString &filename;
-			AtomicFifo &fifo;
+			DataRecorder::Panel &panel;
 	}; // class OpenFileEvent
 
 	class StartRecordingEvent: public RT::Event
 	{
 		public:
-			StartRecordingEvent(bool &, AtomicFifo &);
+			StartRecordingEvent(DataRecorder::Panel &);
 			~StartRecordingEvent(void);
 			int callback(void);
 
 		private:
-			bool &recording;
-			AtomicFifo &fifo;
+			DataRecorder::Panel &panel;
 	}; // class StartRecordingEvent
 
 	class StopRecordingEvent: public RT::Event
 	{
 		public:
-			StopRecordingEvent(bool &, AtomicFifo &);
+			StopRecordingEvent(DataRecorder::Panel &);
 			~StopRecordingEvent(void);
 			int callback(void);
 
 		private:
-			bool &recording;
-			AtomicFifo &fifo;
+			DataRecorder::Panel &panel;
 	}; //class StopRecordingEvent
 
 	class AsyncDataEvent: public RT::Event
 	{
 		public:
-			AsyncDataEvent(const double *, size_t, AtomicFifo &);
+			AsyncDataEvent(const double *, size_t, size_t *, DataRecorder::Panel &);
 			~AsyncDataEvent(void);
 			int callback(void);
 
 		private:
 			const double *data;
 			size_t size;
-			AtomicFifo &fifo;
+			size_t *dropped;
+			DataRecorder::Panel &panel;
 	}; // class AsyncDataEvent
 
 	class DoneEvent: public RT::Event
 	{
 		public:
-			DoneEvent(AtomicFifo &);
+			DoneEvent(DataRecorder::Panel &);
 			~DoneEvent(void);
 			int callback(void);
 
 		private:
-			AtomicFifo &fifo;
+			DataRecorder::Panel &panel;
 	}; // class DoneEvent
 }; // namespace
 
@@ -217,8 +255,8 @@ int RemoveChannelEvent::callback(void)
 	return 0;
 }
 
-OpenFileEvent::OpenFileEvent(QString &n, AtomicFifo &f) :
-	filename(n), fifo(f)
+OpenFileEvent::OpenFileEvent(QString &n, DataRecorder::Panel &p) :
+	filename(n), panel(p)
 {
 }
 
@@ -232,13 +270,12 @@ int OpenFileEvent::callback(void)
 	token.type = DataRecorder::OPEN;
 	token.size = filename.length() + 1;
 	token.time = RT::OS::getTime();
-	fifo.write(&token, sizeof(token));
-	fifo.write(filename.toLatin1().constData(), token.size);
+	panel.queueToken(token, filename.toLatin1().constData());
 	return 0;
 }
 
-StartRecordingEvent::StartRecordingEvent(bool &r, AtomicFifo &f) :
-	recording(r), fifo(f)
+StartRecordingEvent::StartRecordingEvent(DataRecorder::Panel &p) :
+	panel(p)
 {
 }
 
@@ -248,17 +285,12 @@ StartRecordingEvent::~StartRecordingEvent(void)
 
 int StartRecordingEvent::callback(void)
 {
-	DataRecorder::data_token_t token;
-	recording = true;
-	token.type = DataRecorder::START;
-	token.size = 0;
-	token.time = RT::OS::getTime();
-	fifo.write(&token, sizeof(token));
+	panel.startRecordingRT();
 	return 0;
 }
 
-StopRecordingEvent::StopRecordingEvent(bool &r, AtomicFifo &f) :
-	recording(r), fifo(f)
+StopRecordingEvent::StopRecordingEvent(DataRecorder::Panel &p) :
+	panel(p)
 {
 }
 
@@ -268,17 +300,12 @@ StopRecordingEvent::~StopRecordingEvent(void)
 
 int StopRecordingEvent::callback(void)
 {
-	DataRecorder::data_token_t token;
-	recording = false;
-	token.type = DataRecorder::STOP;
-	token.size = 0;
-	token.time = RT::OS::getTime();
-	fifo.write(&token, sizeof(token));
+	panel.stopRecordingRT();
 	return 0;
 }
 
-AsyncDataEvent::AsyncDataEvent(const double *d, size_t s, AtomicFifo &f) :
-	data(d), size(s), fifo(f)
+AsyncDataEvent::AsyncDataEvent(const double *d, size_t s, size_t *l, DataRecorder::Panel &p) :
+	data(d), size(s), dropped(l), panel(p)
 {
 }
 
@@ -292,13 +319,13 @@ int AsyncDataEvent::callback(void)
 	token.type = DataRecorder::ASYNC;
 	token.size = size * sizeof(double);
 	token.time = RT::OS::getTime();
-	fifo.write(&token, sizeof(token));
-	fifo.write(data, token.size);
+	if (!panel.queueEvent(token, data) && dropped)
+		++*dropped;
 	return 1;
 }
 
-DoneEvent::DoneEvent(AtomicFifo &f) :
-	fifo(f)
+DoneEvent::DoneEvent(DataRecorder::Panel &p) :
+	panel(p)
 {
 }
 
@@ -312,7 +339,7 @@ int DoneEvent::callback(void)
 	token.type = DataRecorder::DONE;
 	token.size = 0;
 	token.time = RT::OS::getTime();
-	fifo.write(&token, sizeof(token));
+	panel.queueToken(token);
 	return 0;
 }
 
@@ -359,18 +386,29 @@ void DataRecorder::openFile(const QString& filename)
 		Event::Manager::getInstance()->postEvent(&event);
 }
 
-void DataRecorder::postAsyncData(const double *data, size_t size)
+bool DataRecorder::postAsyncData(const double *data, size_t size)
 {
+	size_t dropped = 0;
 	Event::Object event(Event::ASYNC_DATA_EVENT);
 	event.setParam("data", const_cast<double *> (data));
 	event.setParam("size", &size);
+	event.setParam("dropped", &dropped);
 	if (RT::OS::isRealtime())
 		Event::Manager::getInstance()->postEventRT(&event);
 	else
 		Event::Manager::getInstance()->postEvent(&event);
+	return !dropped;
 }
 
-DataRecorder::Channel::Channel(void)
+// Slot size of the event ring for a sample FIFO of buffersize bytes
+static size_t eventSlotSize(size_t buffersize)
+{
+	size_t samples = std::max(buffersize / EVENT_FIFO_SLOTS / sizeof(double), static_cast<size_t>(EVENT_MIN_SAMPLES));
+	return sizeof(DataRecorder::event_token_t) + samples * sizeof(double);
+}
+
+DataRecorder::Channel::Channel(void) :
+	decimation(0), storage(SampleStorage::FLOAT64), minimum(-10.0), maximum(10.0)
 {
 }
 
@@ -379,7 +417,21 @@ DataRecorder::Channel::~Channel(void)
 }
 
 DataRecorder::Panel::Panel(QWidget *parent, size_t buffersize) :
-	QWidget(parent), RT::Thread(RT::Thread::MinimumPriority), fifo(buffersize), recording(false)
+	QWidget(parent), RT::Thread(RT::Thread::MinimumPriority), fifo(buffersize,"Data Recorder samples"),
+	eventFifo(eventSlotSize(buffersize), EVENT_FIFO_SLOTS, "Data Recorder events"), eventBuffer(eventSlotSize(buffersize)*EVENT_READ_SLOTS),
+	marksQueued(0), marksHandled(0), eventSizes(EVENT_READ_SLOTS), eventNext(0), eventCount(0),
+	arena("Data Recorder", "frames", FRAME_ARENA_SIZE), frame(0), frameCapacity(0), packTicks(1), packRows(1), packed(0),
+	tokenRetrieved(false), writerState(CLOSED), writerPriority(WriterPool::NORMAL),
+	triggerSource(TRIGGER_OFF), triggerEdge(EDGE_RISING), triggerChannel(0), triggerLevel(0.0), triggerPrev(0.0),
+	triggerPending(false), preTime(0), postTime(0), ringStart(0), ringCount(0), ringCapacity(0), postTicks(0),
+	trialTicks(0), trialStart(0), triggerTrial(false),
+	batchWidth(0), batchLimit(0), batchRows(0), batchTime(0), channelLayout(LAYOUT_ROWS), decimate(false), groupRows(0), paramRows(0),
+	stampTicks(false), stampJitter(-1), stampExceptionTable(-1), stampCount(0), lastStamp(0), stampPeriod(0),
+	asyncLayout(ASYNC_TABLE), asyncSamples(-1), asyncIndex(-1), asyncOffset(0), writeTime(0), writeBytes(0),
+	storedBytes(0), chunkSize(0), compression(COMPRESSION_NONE), syncInterval(0), swmr(false), swmrFlush(0),
+	rotateMode(ROTATE_OFF), rotateLimit(0), rotating(false), segment(0), nextSegment(0), nextReady(false), nextId(-1),
+	segmentReserve(0), nextReserve(0), segmentTrials(0), segmentStart(0), segmentSize(0), trialCount(0), recording(false),
+	openPending(false), openReply(OPEN_PENDING), closing(false)
 {
 	setAttribute(Qt::WA_DeleteOnClose);
 
@@ -390,15 +442,29 @@ DataRecorder::Panel::Panel(QWidget *parent, size_t buffersize) :
 			"are listed here as /dev/comedi[#]. Use the \"Type\" and \"Channel\" drop-down boxes "
 			"to select the signals that you want to save. Use the left and right arrow buttons to "
 			"add these signals to the file. You may select a downsampling rate that is applied "
-			"to the real-time period for execution (set in the System Control Panel). The real-time "
+			"to the real-time period for execution (set in the System Control Panel). Signals are "
+			"lowpass filtered before downsampling, so they don't alias. Channels added with the "
+			"same \"Rate\" form a group, stored in rows at that rate in Synchronous Data/Decimated "
+			"Data/Rate [#]/Channel Data, all recorded in the same real-time pass. The real-time "
 			"period and the data downsampling rate are both saved as metadata in the HDF5 file "
-			"so that you can reconstruct your data correctly. The current recording status of "
-			"the Data Recorder is shown at the bottom.</p>");
+			"so that you can reconstruct your data correctly. The \"Columns\" layout stores each "
+			"channel in Synchronous Data/Channel Columns instead of rows of Channel Data. A channel can be "
+			"stored as Float32, as Int16 over its \"Range\" or as a Bit, the readers turn it back "
+			"into doubles. With "
+			"\"Timestamps\" checked, the time of every tick is kept in Synchronous Data/Timestamps "
+			"and rtxi_hdf_reader reports the ticks that were late or lost. Data posted by modules is appended "
+			"to Asynchronous Data/Samples, each event's time, tick, offset and length are in "
+			"Asynchronous Data/Index. The current recording status of "
+			"the Data Recorder is shown at the bottom. With a trigger \"Source\", starting arms "
+			"the recorder instead: each trigger writes a trial from \"Pre\" before it to \"Post\" "
+			"after it, and triggers close enough together share a trial. With \"SWMR\" checked, "
+			"rtxi_hdf_reader --follow can read each trial while it is recorded. Files ending in .raw are written as raw "
+			"binary captures instead, use rtxi_raw_convert to turn them into HDF5 files.</p>");
 
 	// Make Mdi
 	subWindow = new QMdiSubWindow;
 	subWindow->setWindowIcon(QIcon("/usr/local/lib/rtxi/RTXI-widget-icon.png"));
-	subWindow->setFixedSize(500,480);
+	subWindow->setFixedSize(500,870);
 	subWindow->setAttribute(Qt::WA_DeleteOnClose);
 	subWindow->setWindowFlags(Qt::CustomizeWindowHint);
 	subWindow->setWindowFlags(Qt::WindowCloseButtonHint);
@@ -431,6 +497,41 @@ DataRecorder::Panel::Panel(QWidget *parent, size_t buffersize) :
 	channelList = new QComboBox;
 	channelLayout->addWidget(channelList);
 
+	channelLayout->addWidget(new QLabel(tr("Rate:")));
+	rateSpin = new QSpinBox(this);
+	rateSpin->setMinimum(0);
+	rateSpin->setMaximum(500);
+	rateSpin->setPrefix("1/");
+	rateSpin->setSpecialValueText("Panel");
+	rateSpin->setToolTip("Downsampling rate of the channel, Panel uses the downsample rate below");
+	channelLayout->addWidget(rateSpin);
+
+	channelLayout->addWidget(new QLabel(tr("Store as:")));
+	sampleTypeList = new QComboBox;
+	sampleTypeList->addItem("Float64", SampleStorage::FLOAT64);
+	sampleTypeList->addItem("Float32", SampleStorage::FLOAT32);
+	sampleTypeList->addItem("Int16", SampleStorage::INT16);
+	sampleTypeList->addItem("Bit", SampleStorage::BIT);
+	sampleTypeList->setToolTip("How the channel is stored in HDF5 files, Int16 maps the range below onto "
+			"the 16-bit integers and Bit stores a digital line as one bit");
+	channelLayout->addWidget(sampleTypeList);
+	QObject::connect(sampleTypeList,SIGNAL(activated(int)),this,SLOT(updateSampleType(int)));
+
+	QHBoxLayout *rangeLayout = new QHBoxLayout;
+	rangeLayout->addWidget(new QLabel(tr("Range:")));
+	rangeMinSpin = new QDoubleSpinBox;
+	rangeMinSpin->setRange(-1e6, 1e6);
+	rangeMinSpin->setDecimals(3);
+	rangeMinSpin->setValue(-10.0);
+	rangeLayout->addWidget(rangeMinSpin);
+	rangeMaxSpin = new QDoubleSpinBox;
+	rangeMaxSpin->setRange(-1e6, 1e6);
+	rangeMaxSpin->setDecimals(3);
+	rangeMaxSpin->setValue(10.0);
+	rangeLayout->addWidget(rangeMaxSpin);
+	channelLayout->addLayout(rangeLayout);
+	updateSampleType(0);
+
 	// Attach layout to child widget
 	channelGroup->setLayout(channelLayout);
 
@@ -500,6 +601,122 @@ DataRecorder::Panel::Panel(QWidget *parent, size_t buffersize) :
 	// Attach layout to child
 	fileGroup->setLayout(fileLayout);
 
+	// Create child widget and layout for storage options
+	storageGroup = new QGroupBox(tr("Storage"));
+	QGridLayout *storageLayout = new QGridLayout;
+
+	// Create elements for storage options
+	storageLayout->addWidget(new QLabel(tr("Chunk \nSize:")), 0, 0);
+	chunkSpin = new QSpinBox(this);
+	chunkSpin->setMinimum(0);
+	chunkSpin->setMaximum(CHUNK_MAX_ROWS);
+	chunkSpin->setSingleStep(CHUNK_MIN_ROWS);
+	chunkSpin->setSpecialValueText("Auto");
+	chunkSpin->setToolTip("Samples per HDF5 chunk, Auto picks it from the channel count and sample rate");
+	storageLayout->addWidget(chunkSpin, 0, 1);
+	QObject::connect(chunkSpin,SIGNAL(valueChanged(int)),this,SLOT(updateChunkSize(int)));
+
+	storageLayout->addWidget(new QLabel(tr("Filter:")), 0, 2);
+	compressionList = new QComboBox;
+	compressionList->addItem("None", COMPRESSION_NONE);
+	if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0)
+	{
+		compressionList->addItem("Deflate", COMPRESSION_DEFLATE);
+		if (H5Zfilter_avail(H5Z_FILTER_SHUFFLE) > 0)
+			compressionList->addItem("Shuffle + Deflate", COMPRESSION_SHUFFLE_DEFLATE);
+	}
+	storageLayout->addWidget(compressionList, 0, 3);
+	QObject::connect(compressionList,SIGNAL(activated(int)),this,SLOT(updateCompression(int)));
+
+	storageLayout->addWidget(new QLabel(tr("Sync (s):")), 1, 0);
+	syncSpin = new QSpinBox(this);
+	syncSpin->setMinimum(0);
+	syncSpin->setMaximum(3600);
+	syncSpin->setSpecialValueText("Trial");
+	syncSpin->setToolTip("How often raw captures are synced to disk while recording, Trial only syncs when the trial stops");
+	storageLayout->addWidget(syncSpin, 1, 1);
+	QObject::connect(syncSpin,SIGNAL(valueChanged(int)),this,SLOT(updateSyncInterval(int)));
+
+	storageLayout->addWidget(new QLabel(tr("Pack:")), 1, 2);
+	packSpin = new QSpinBox(this);
+	packSpin->setMinimum(1);
+	packSpin->setMaximum(PACK_MAX_TICKS);
+	packSpin->setToolTip("Ticks gathered by the real-time thread before they are queued for the writer, "
+			"limited to 50 ms of samples");
+	storageLayout->addWidget(packSpin, 1, 3);
+	QObject::connect(packSpin,SIGNAL(valueChanged(int)),this,SLOT(updatePackTicks(int)));
+
+	storageLayout->addWidget(new QLabel(tr("Async:")), 2, 0);
+	asyncList = new QComboBox;
+	asyncList->addItem("Table", ASYNC_TABLE);
+	asyncList->addItem("Datasets", ASYNC_DATASETS);
+	asyncList->setToolTip("Table appends asynchronous data to one Samples table with an Index, "
+			"Datasets writes one dataset per event like older versions");
+	storageLayout->addWidget(asyncList, 2, 1);
+	QObject::connect(asyncList,SIGNAL(activated(int)),this,SLOT(updateAsyncLayout(int)));
+
+	storageLayout->addWidget(new QLabel(tr("Rotate:")), 2, 2);
+	rotateList = new QComboBox;
+	rotateList->addItem("Off", ROTATE_OFF);
+	rotateList->addItem("Size", ROTATE_SIZE);
+	rotateList->addItem("Duration", ROTATE_DURATION);
+	rotateList->addItem("Trials", ROTATE_TRIALS);
+	rotateList->setToolTip("Continue the recording in a new numbered file once this one is large or old enough, "
+			"or holds enough trials. The .manifest file lists the files in order");
+	storageLayout->addWidget(rotateList, 2, 3);
+	rotateSpin = new QSpinBox(this);
+	rotateSpin->setMinimum(1);
+	rotateSpin->setMaximum(1000000);
+	storageLayout->addWidget(rotateSpin, 2, 4, 1, 2);
+	QObject::connect(rotateList,SIGNAL(activated(int)),this,SLOT(updateRotation(void)));
+	QObject::connect(rotateSpin,SIGNAL(valueChanged(int)),this,SLOT(updateRotation(void)));
+	updateRotation();
+
+	swmrCheck = new QCheckBox(tr("SWMR, readable while writing"));
+	swmrCheck->setToolTip("Write HDF5 trials so that SWMR readers, like rtxi_hdf_reader --follow, can read them "
+			"while they are recorded. Appending only works to files created this way");
+#if !H5_VERSION_GE(1,10,0)
+	swmrCheck->setEnabled(false);
+#endif
+	storageLayout->addWidget(swmrCheck, 3, 0, 1, 4);
+	QObject::connect(swmrCheck,SIGNAL(toggled(bool)),this,SLOT(updateSwmr(bool)));
+
+	storageLayout->addWidget(new QLabel(tr("Layout:")), 3, 4);
+	layoutList = new QComboBox;
+	layoutList->addItem("Rows", LAYOUT_ROWS);
+	layoutList->addItem("Columns", LAYOUT_COLUMNS);
+	layoutList->setToolTip("Rows stores a row of every channel per sample in Channel Data, Columns gives each "
+			"channel its own dataset, so reading one channel does not read the others");
+	storageLayout->addWidget(layoutList, 3, 5);
+	QObject::connect(layoutList,SIGNAL(activated(int)),this,SLOT(updateChannelLayout(int)));
+
+	timestampCheck = new QCheckBox(tr("Timestamps"));
+	timestampCheck->setToolTip("Record when every tick ran, as a few bytes per tick, so late and lost ticks "
+			"show in the HDF5 file");
+	storageLayout->addWidget(timestampCheck, 4, 0, 1, 4);
+	QObject::connect(timestampCheck,SIGNAL(toggled(bool)),this,SLOT(updateTimestamps(bool)));
+
+	storageLayout->addWidget(new QLabel(tr("Priority:")), 4, 4);
+	priorityList = new QComboBox;
+	priorityList->addItem("High", WriterPool::HIGH);
+	priorityList->addItem("Normal", WriterPool::NORMAL);
+	priorityList->addItem("Low", WriterPool::LOW);
+	priorityList->setCurrentIndex(1);
+	priorityList->setToolTip("Data Recorders share their writer threads, those with a higher priority are "
+			"written first and in larger slices when the disk can't keep up with all of them");
+	storageLayout->addWidget(priorityList, 4, 5);
+	QObject::connect(priorityList,SIGNAL(activated(int)),this,SLOT(updatePriority(int)));
+
+	storageLayout->addWidget(new QLabel(tr("Ratio:")), 0, 4);
+	compressionRatio = new QLabel("-");
+	storageLayout->addWidget(compressionRatio, 0, 5);
+	storageLayout->addWidget(new QLabel(tr("Write (MB/s):")), 1, 4);
+	writeBandwidth = new QLabel("-");
+	storageLayout->addWidget(writeBandwidth, 1, 5);
+
+	// Attach layout to child
+	storageGroup->setLayout(storageLayout);
+
 	// Create child widget and layout
 	listGroup = new QGroupBox(tr("Currently Recording"));
 	QVBoxLayout *listLayout = new QVBoxLayout;
@@ -511,6 +728,67 @@ DataRecorder::Panel::Panel(QWidget *parent, size_t buffersize) :
 	// Attach layout to child
 	listGroup->setLayout(listLayout);
 
+	// Create child widget and layout for triggered recording
+	triggerGroup = new QGroupBox(tr("Trigger"));
+	QGridLayout *triggerLayout = new QGridLayout;
+
+	// Create elements for trigger options
+	triggerLayout->addWidget(new QLabel(tr("Source:")), 0, 0);
+	triggerSourceList = new QComboBox;
+	triggerSourceList->addItem("Off", TRIGGER_OFF);
+	triggerSourceList->addItem("Event", TRIGGER_EVENT);
+	triggerSourceList->addItem("Threshold", TRIGGER_THRESHOLD);
+	triggerSourceList->addItem("DIO Edge", TRIGGER_DIO);
+	triggerSourceList->setToolTip("Off records continuously, the other sources write a trial around each trigger");
+	triggerLayout->addWidget(triggerSourceList, 0, 1);
+
+	triggerLayout->addWidget(new QLabel(tr("Event:")), 0, 2);
+	triggerEventEdit = new QLineEdit(Event::THRESHOLD_CROSSING_EVENT);
+	triggerEventEdit->setToolTip("Name of the event that triggers");
+	triggerLayout->addWidget(triggerEventEdit, 0, 3, 1, 3);
+
+	triggerLayout->addWidget(new QLabel(tr("Channel:")), 1, 0);
+	triggerChannelList = new QComboBox;
+	triggerChannelList->setModel(selectionBox->model());
+	triggerChannelList->setToolTip("Recorded channel watched by the threshold and DIO edge triggers");
+	triggerLayout->addWidget(triggerChannelList, 1, 1);
+
+	triggerLayout->addWidget(new QLabel(tr("Level:")), 1, 2);
+	triggerLevelSpin = new QDoubleSpinBox(this);
+	triggerLevelSpin->setRange(-1e6, 1e6);
+	triggerLevelSpin->setDecimals(4);
+	triggerLevelSpin->setToolTip("Threshold crossed by the channel, DIO edges cross 0.5");
+	triggerLayout->addWidget(triggerLevelSpin, 1, 3);
+
+	triggerLayout->addWidget(new QLabel(tr("Edge:")), 1, 4);
+	triggerEdgeList = new QComboBox;
+	triggerEdgeList->addItem("Rising", EDGE_RISING);
+	triggerEdgeList->addItem("Falling", EDGE_FALLING);
+	triggerEdgeList->addItem("Both", EDGE_BOTH);
+	triggerLayout->addWidget(triggerEdgeList, 1, 5);
+
+	triggerLayout->addWidget(new QLabel(tr("Pre (ms):")), 2, 0);
+	preSpin = new QSpinBox(this);
+	preSpin->setMaximum(TRIGGER_MAX_WINDOW);
+	preSpin->setToolTip("Data kept in memory and written before each trigger");
+	triggerLayout->addWidget(preSpin, 2, 1);
+	triggerLayout->addWidget(new QLabel(tr("Post (ms):")), 2, 2);
+	postSpin = new QSpinBox(this);
+	postSpin->setMaximum(TRIGGER_MAX_WINDOW);
+	postSpin->setToolTip("Data written after each trigger");
+	triggerLayout->addWidget(postSpin, 2, 3);
+
+	QObject::connect(triggerSourceList,SIGNAL(activated(int)),this,SLOT(updateTrigger(void)));
+	QObject::connect(triggerEventEdit,SIGNAL(editingFinished(void)),this,SLOT(updateTrigger(void)));
+	QObject::connect(triggerChannelList,SIGNAL(currentIndexChanged(int)),this,SLOT(updateTrigger(void)));
+	QObject::connect(triggerLevelSpin,SIGNAL(valueChanged(double)),this,SLOT(updateTrigger(void)));
+	QObject::connect(triggerEdgeList,SIGNAL(activated(int)),this,SLOT(updateTrigger(void)));
+	QObject::connect(preSpin,SIGNAL(valueChanged(int)),this,SLOT(updateTrigger(void)));
+	QObject::connect(postSpin,SIGNAL(valueChanged(int)),this,SLOT(updateTrigger(void)));
+
+	// Attach layout to child
+	triggerGroup->setLayout(triggerLayout);
+
 	// Creat child widget and layout for buttons
 	buttonGroup = new QGroupBox;
 	QHBoxLayout *buttonLayout = new QHBoxLayout;
@@ -540,11 +818,14 @@ DataRecorder::Panel::Panel(QWidget *parent, size_t buffersize) :
 	layout->addWidget(channelGroup, 0, 0, 2, 2);
 	layout->addWidget(listGroup, 0, 2, 2, 4);
 	layout->addWidget(fileGroup, 3, 0, 1, 6);
-	layout->addWidget(sampleGroup, 4, 0, 1, 6);
-	layout->addWidget(buttonGroup, 5, 0, 1, 6);
+	layout->addWidget(storageGroup, 4, 0, 1, 6);
+	layout->addWidget(triggerGroup, 5, 0, 1, 6);
+	layout->addWidget(sampleGroup, 6, 0, 1, 6);
+	layout->addWidget(buttonGroup, 7, 0, 1, 6);
 
 	setLayout(layout);
 	setWindowTitle(QString::number(getID()) + " Data Recorder");
+	nameFifos();
 
 	// Set layout to Mdi
 	subWindow->setWidget(this);
@@ -561,24 +842,23 @@ DataRecorder::Panel::Panel(QWidget *parent, size_t buffersize) :
 	for (std::vector<IO::Block *>::const_iterator i = blockPtrList.begin(), end = blockPtrList.end(); i != end; ++i)
 		blockList->addItem(QString::fromStdString((*i)->getName()) + " " + QString::number((*i)->getID()));
 
-	// Setup thread sleep 
-	sleep.tv_sec = 0;
-	sleep.tv_nsec = RT::System::getInstance()->getPeriod();
-
 	// Check if FIFO is truly atomic for hardware architecture
-	if(!fifo.isLockFree())
+	if(!fifo.isLockFree() || !eventFifo.isLockFree())
 		ERROR_MSG("DataRecorder::Panel: WARNING: Atomic FIFO is not lock free\n");
 
+	// Let the writer pool wait on the FIFO instead of polling it
+	fifo.enableNotification(std::min(buffersize / 4, static_cast<size_t>(WRITER_WATERMARK)));
+
 	// Build initial channel list
 	buildChannelList();
 
-	// Launch Recording Thread
-	pthread_create(&thread, 0, bounce, this);
-	counter = 0;
 	downsample_rate = 1;
 	prev_input = 0.0;
 	count = 0;
 	setActive(true);
+
+	// Let the shared writer threads drain the FIFO
+	WriterPool::getInstance()->insertClient(this, writerPriority);
 }
 
 // Destructor for Panel
@@ -586,9 +866,16 @@ DataRecorder::Panel::~Panel(void)
 {
 	Plugin::getInstance()->removeDataRecorderPanel(this);
 	setActive(false);
-	DoneEvent RTevent(fifo);
+	DoneEvent RTevent(*this);
 	while (RT::System::getInstance()->postEvent(&RTevent));
-	pthread_join(thread, 0);
+
+	// Nobody answers a pending question about an existing file any more
+	mutex.lock();
+	closing = true;
+	openReply = OPEN_CANCEL;
+	mutex.unlock();
+	WriterPool::getInstance()->release(this);
+	WriterPool::getInstance()->removeClient(this);
 	for (RT::List<Channel>::iterator i = channels.begin(), end = channels.end(); i!= end;)
 		delete &*(i++);
 }
@@ -602,28 +889,122 @@ void DataRecorder::Panel::goodbye(void)
 // Execute loop
 void DataRecorder::Panel::execute(void)
 {
-	if (recording && !counter++)
+	// Every tick is staged, downsampling happens on the writer thread
+	if (recording)
 	{
-		data_token_t token;
-		double data[channels.size()];
-
+		double *f = frame.load(std::memory_order_acquire) + packed * tickWidth();
 		size_t n = 0;
-		token.type = SYNC;
-		token.size = channels.size() * sizeof(double);
 		for (RT::List<Channel>::iterator i = channels.begin(), end = channels.end(); i != end; ++i)
 			if (i->block)
-				data[n++] = i->block->getValue(i->type, i->index);
+				f[n++] = i->block->getValue(i->type, i->index);
+		if (stampTicks)
+		{
+			long long now = RT::OS::getTime();
+			memcpy(&f[channels.size()], &now, sizeof(now));
+		}
 
-		fifo.write(&token, sizeof(token));
-		fifo.write(data, sizeof(data));
+		// The TRIGGER token follows the tick that triggered
+		++packed;
+		if (triggerSource != TRIGGER_OFF && detectTrigger(f))
+		{
+			data_token_t token;
+			commitFrame();
+			token.type = DataRecorder::TRIGGER;
+			token.size = 0;
+			token.time = RT::OS::getTime();
+			queueToken(token);
+		}
+		else if (packed == packRows)
+			commitFrame();
 	}
 	count++;
-	counter %= downsample_rate;
+}
+
+// Check the tick just staged for a trigger, called from the realtime thread
+bool DataRecorder::Panel::detectTrigger(const double *tick)
+{
+	if (triggerSource == TRIGGER_EVENT)
+		return triggerPending.exchange(false);
+	if (triggerChannel >= channels.size())
+		return false;
+
+	// triggerPrev is NaN on the first tick, which never crosses
+	double x = tick[triggerChannel];
+	double prev = triggerPrev;
+	triggerPrev = x;
+	bool rising = prev < triggerLevel && x >= triggerLevel;
+	bool falling = prev >= triggerLevel && x < triggerLevel;
+	return (triggerEdge != EDGE_FALLING && rising) || (triggerEdge != EDGE_RISING && falling);
+}
+
+// Start staging ticks, called from the realtime thread
+void DataRecorder::Panel::startRecordingRT(void)
+{
+	data_token_t token;
+	recording = true;
+	packed = 0;
+	triggerPending = false;
+	triggerPrev = NAN;
+	packRows = std::max(1ll, std::min(static_cast<long long>(packTicks), PACK_MAX_LATENCY / RT::System::getInstance()->getPeriod()));
+	token.type = DataRecorder::START;
+	token.size = 0;
+	token.time = RT::OS::getTime();
+	queueToken(token);
+}
+
+// Queue the ticks still staged ahead of the STOP token, called from the
+// realtime thread
+void DataRecorder::Panel::stopRecordingRT(void)
+{
+	data_token_t token;
+	recording = false;
+	if (packed)
+		commitFrame();
+	token.type = DataRecorder::STOP;
+	token.size = 0;
+	token.time = RT::OS::getTime();
+	queueToken(token);
+}
+
+// Queue a token other than SYNC and wake the writer, called from the
+// realtime thread. Events posted from now on wait for it to be handled
+void DataRecorder::Panel::queueToken(const data_token_t &token, const void *payload)
+{
+	if (fifo.write(&token, sizeof(token)))
+	{
+		if (token.size)
+			fifo.write(payload, token.size);
+		++marksQueued;
+	}
+	fifo.notify();
+}
+
+// Queue asynchronous data or a parameter change behind the tokens queued so
+// far, called from the realtime thread
+bool DataRecorder::Panel::queueEvent(const data_token_t &token, const void *payload)
+{
+	event_token_t event = { token, marksQueued, };
+	return eventFifo.write(&event, sizeof(event), payload, token.size);
+}
+
+// Queue the staged ticks as one token
+void DataRecorder::Panel::commitFrame(void)
+{
+	data_token_t token;
+	token.type = SYNC;
+	token.size = packed * tickWidth() * sizeof(double);
+	token.time = RT::OS::getTime();
+	fifo.write(&token, sizeof(token));
+	fifo.write(frame.load(std::memory_order_acquire), token.size);
+	packed = 0;
 }
 
 // Event handler
 void DataRecorder::Panel::receiveEvent(const Event::Object *event)
 {
+	if (recording && triggerSource == TRIGGER_EVENT && triggerEvent == event->getName())
+		triggerPending = true;
+
 	if (event->getName() == Event::IO_BLOCK_INSERT_EVENT)
 	{
 		IO::Block *block = reinterpret_cast<IO::Block *> (event->getParam("block"));
@@ -649,27 +1030,27 @@ void DataRecorder::Panel::receiveEvent(const Event::Object *event)
 	else if (event->getName() == Event::OPEN_FILE_EVENT)
 	{
 		QString filename(reinterpret_cast<char*> (event->getParam("filename")));
-		OpenFileEvent RTevent(filename, fifo);
+		OpenFileEvent RTevent(filename, *this);
 		RT::System::getInstance()->postEvent(&RTevent);
 	}
 	else if (event->getName() == Event::START_RECORDING_EVENT)
 	{
-		StartRecordingEvent RTevent(recording, fifo);
+		StartRecordingEvent RTevent(*this);
 		RT::System::getInstance()->postEvent(&RTevent);
 	}
 	else if (event->getName() == Event::STOP_RECORDING_EVENT)
 	{
-		StopRecordingEvent RTevent(recording, fifo);
+		StopRecordingEvent RTevent(*this);
 		RT::System::getInstance()->postEvent(&RTevent);
 	}
 	else if (event->getName() == Event::ASYNC_DATA_EVENT)
 	{
-		AsyncDataEvent RTevent(reinterpret_cast<double *> (event->getParam("data")),*reinterpret_cast<size_t *> (event->getParam("size")), fifo);
+		AsyncDataEvent RTevent(reinterpret_cast<double *> (event->getParam("data")),*reinterpret_cast<size_t *> (event->getParam("size")),
+				reinterpret_cast<size_t *> (event->getParam("dropped")), *this);
 		RT::System::getInstance()->postEvent(&RTevent);
 	}
 	else if( event->getName() == Event::RT_POSTPERIOD_EVENT )
 	{
-		sleep.tv_nsec = RT::System::getInstance()->getPeriod(); // Update recording thread sleep time
 		buildChannelList();
 	}
 }
@@ -677,6 +1058,9 @@ void DataRecorder::Panel::receiveEvent(const Event::Object *event)
 // RT Event Handler
 void DataRecorder::Panel::receiveEventRT(const Event::Object *event)
 {
+	if (recording && triggerSource == TRIGGER_EVENT && triggerEvent == event->getName())
+		triggerPending = true;
+
 	if (event->getName() == Event::OPEN_FILE_EVENT)
 	{
 		QString filename = QString(reinterpret_cast<char*> (event->getParam("filename")));
@@ -684,27 +1068,12 @@ void DataRecorder::Panel::receiveEventRT(const Event::Object *event)
 		token.type = DataRecorder::OPEN;
 		token.size = filename.length() + 1;
 		token.time = RT::OS::getTime();
-		fifo.write(&token, sizeof(token));
-		fifo.write(filename.toLatin1().constData(), token.size);
+		queueToken(token, filename.toLatin1().constData());
 	}
 	else if (event->getName() == Event::START_RECORDING_EVENT)
-	{
-		data_token_t token;
-		recording = true;
-		token.type = DataRecorder::START;
-		token.size = 0;
-		token.time = RT::OS::getTime();
-		fifo.write(&token, sizeof(token));
-	}
+		startRecordingRT();
 	else if (event->getName() == Event::STOP_RECORDING_EVENT)
-	{
-		data_token_t token;
-		recording = false;
-		token.type = DataRecorder::STOP;
-		token.size = 0;
-		token.time = RT::OS::getTime();
-		fifo.write(&token, sizeof(token));
-	}
+		stopRecordingRT();
 	else if (event->getName() == Event::ASYNC_DATA_EVENT)
 	{
 		size_t size = *reinterpret_cast<size_t *> (event->getParam("size"));
@@ -712,8 +1081,9 @@ void DataRecorder::Panel::receiveEventRT(const Event::Object *event)
 		token.type = DataRecorder::ASYNC;
 		token.size = size * sizeof(double);
 		token.time = RT::OS::getTime();
-		fifo.write(&token, sizeof(token));
-		fifo.write(event->getParam("data"), token.size);
+		size_t *dropped = reinterpret_cast<size_t *> (event->getParam("dropped"));
+		if (!queueEvent(token, event->getParam("data")) && dropped)
+			++*dropped;
 	}
 	else if (event->getName() == Event::WORKSPACE_PARAMETER_CHANGE_EVENT)
 	{
@@ -726,12 +1096,7 @@ void DataRecorder::Panel::receiveEventRT(const Event::Object *event)
 		data.index = reinterpret_cast<size_t> (event->getParam("index"));
 		data.step = file.idx;
 		data.value = *reinterpret_cast<double *> (event->getParam("value"));
-		fifo.write(&token, sizeof(token));
-		fifo.write(&data, sizeof(data));
-	}
-	else if( event->getName() == Event::RT_POSTPERIOD_EVENT )
-	{
-		sleep.tv_nsec = RT::System::getInstance()->getPeriod(); // Update recording thread sleep time
+		queueEvent(token, &data);
 	}
 }
 
@@ -814,6 +1179,7 @@ void DataRecorder::Panel::changeDataFile(void)
 
 	QStringList filterList;
 	filterList.push_back("HDF5 files (*.h5)");
+	filterList.push_back("RTXI raw capture (*.raw)");
 	filterList.push_back("All files (*.*)");
 	fileDialog.setFilters(filterList);
 	fileDialog.selectNameFilter("HDF5 files (*.h5)");
@@ -828,17 +1194,67 @@ void DataRecorder::Panel::changeDataFile(void)
 	else
 		filename = files[0];
 
-	if (!filename.toLower().endsWith(QString(".h5")))
+	if (fileDialog.selectedNameFilter().contains("*.raw"))
+	{
+		if (!filename.toLower().endsWith(QString(".raw")))
+			filename += ".raw";
+	}
+	else if (!filename.toLower().endsWith(QString(".h5")) && !filename.toLower().endsWith(QString(".raw")))
 		filename += ".h5";
 
 	// Write this directory to the user prefs as most recently used
 	userprefs.setValue("/dirs/data", fileDialog.directory().path());
 
 	// Post to event queue
-	OpenFileEvent RTevent(filename, fifo);
+	OpenFileEvent RTevent(filename, *this);
 	RT::System::getInstance()->postEvent(&RTevent);
 }
 
+// Make sure the realtime frame holds ticks samples of n channels. The frame
+// only grows, and the pointer is published before the channel insertion event
+// is posted, so the realtime thread never sees a frame smaller than the
+// channel list. Packing only changes while nothing is recorded.
+bool DataRecorder::Panel::reserveFrame(size_t n, size_t ticks)
+{
+	if (n * ticks <= frameCapacity)
+		return true;
+
+	size_t capacity = std::max(std::max(n * ticks, 2 * frameCapacity), static_cast<size_t>(FRAME_MIN_CHANNELS));
+	double *f = arena.allocateArray<double>(capacity);
+	if (!f)
+		f = arena.allocateArray<double>(capacity = n * ticks);
+	if (!f)
+	{
+		ERROR_MSG("DataRecorder::Panel::reserveFrame : out of frame memory for %lu ticks of %lu channels\n",
+				static_cast<unsigned long>(ticks), static_cast<unsigned long>(n));
+		return false;
+	}
+
+	frame.store(f, std::memory_order_release);
+	frameCapacity = capacity;
+	return true;
+}
+
+// Tell channels apart by the rate and storage they are recorded with
+static QString channelSuffix(size_t decimation, int storage, double minimum, double maximum)
+{
+	QString suffix;
+	if (decimation)
+		suffix += " (1/" + QString::number(decimation) + ")";
+	switch (storage) {
+		case SampleStorage::FLOAT32:
+			suffix += " [float32]";
+			break;
+		case SampleStorage::INT16:
+			suffix += " [int16 " + QString::number(minimum) + ":" + QString::number(maximum) + "]";
+			break;
+		case SampleStorage::BIT:
+			suffix += " [bit]";
+			break;
+	}
+	return suffix;
+}
+
 // Insert channel to record into list
 void DataRecorder::Panel::insertChannel(void)
 {
@@ -869,11 +1285,22 @@ void DataRecorder::Panel::insertChannel(void)
 			channel->type = Workspace::INPUT;
 	}
 	channel->index = channelList->currentIndex();
+	channel->decimation = rateSpin->value();
+	channel->storage = sampleTypeList->itemData(sampleTypeList->currentIndex()).toInt();
+	channel->minimum = rangeMinSpin->value();
+	channel->maximum = rangeMaxSpin->value();
+	if (channel->storage == SampleStorage::INT16 && channel->minimum >= channel->maximum)
+	{
+		ERROR_MSG("DataRecorder::Panel::insertChannel : the Int16 range is empty\n");
+		delete channel;
+		return;
+	}
 
 	channel->name.sprintf("%s %ld : %s", channel->block->getName().c_str(),
 			channel->block->getID(), channel->block->getName(channel->type, channel->index).c_str());
+	channel->name += channelSuffix(channel->decimation, channel->storage, channel->minimum, channel->maximum);
 
-	if(selectionBox->findItems(QString(channel->name), Qt::MatchExactly).isEmpty())
+	if(selectionBox->findItems(QString(channel->name), Qt::MatchExactly).isEmpty() && reserveFrame(tickWidth() + 1, packTicks))
 	{
 		InsertChannelEvent RTevent(recording, channels, channels.end(), *channel);
 		if (!RT::System::getInstance()->postEvent(&RTevent))
@@ -937,14 +1364,14 @@ void DataRecorder::Panel::startRecordClicked(void)
 		return;
 	}
 
-	StartRecordingEvent RTevent(recording, fifo);
+	StartRecordingEvent RTevent(*this);
 	RT::System::getInstance()->postEvent(&RTevent);
 }
 
 // Stop recording slot
 void DataRecorder::Panel::stopRecordClicked(void)
 {
-	StopRecordingEvent RTevent(recording, fifo);
+	StopRecordingEvent RTevent(*this);
 	RT::System::getInstance()->postEvent(&RTevent);
 }
 
@@ -954,24 +1381,119 @@ void DataRecorder::Panel::updateDownsampleRate(int r)
 	downsample_rate = r;
 }
 
+// Update chunk size, zero picks one when the trial starts
+void DataRecorder::Panel::updateChunkSize(int r)
+{
+	chunkSize = r;
+}
+
+// Update compression filter
+void DataRecorder::Panel::updateCompression(int i)
+{
+	compression = compressionList->itemData(i).toInt();
+}
+
+// Update the raw capture sync interval, zero syncs at the end of each trial
+void DataRecorder::Panel::updateSyncInterval(int r)
+{
+	syncInterval = r;
+}
+
+// Update the number of ticks packed into one token
+void DataRecorder::Panel::updatePackTicks(int r)
+{
+	if (reserveFrame(std::max(tickWidth(), static_cast<size_t>(1)), r))
+		packTicks = r;
+	else
+		packSpin->setValue(packTicks);
+}
+
+// Update the layout of Asynchronous Data in the next trials
+void DataRecorder::Panel::updateAsyncLayout(int index)
+{
+	asyncLayout = asyncList->itemData(index).toInt();
+}
+
+// Update the layout of Channel Data in the next trials
+void DataRecorder::Panel::updateChannelLayout(int index)
+{
+	channelLayout = layoutList->itemData(index).toInt();
+}
+
+// Update the file rotation limit, its unit follows the mode
+void DataRecorder::Panel::updateRotation(void)
+{
+	rotateMode = rotateList->itemData(rotateList->currentIndex()).toInt();
+	rotateLimit = rotateSpin->value();
+	rotateSpin->setEnabled(rotateMode != ROTATE_OFF);
+	if (rotateMode == ROTATE_SIZE)
+		rotateSpin->setSuffix(" MB");
+	else if (rotateMode == ROTATE_DURATION)
+		rotateSpin->setSuffix(" min");
+	else if (rotateMode == ROTATE_TRIALS)
+		rotateSpin->setSuffix(" trials");
+	else
+		rotateSpin->setSuffix("");
+}
+
+// Update tick timestamps, the frame needs room for them
+void DataRecorder::Panel::updateTimestamps(bool on)
+{
+	if (!on || reserveFrame(channels.size() + 1, packTicks))
+		stampTicks = on;
+	else
+		timestampCheck->setChecked(false);
+}
+
+// Only Int16 storage goes by the range
+void DataRecorder::Panel::updateSampleType(int index)
+{
+	bool scaled = sampleTypeList->itemData(index).toInt() == SampleStorage::INT16;
+	rangeMinSpin->setEnabled(scaled);
+	rangeMaxSpin->setEnabled(scaled);
+}
+
+// Update the share of the writer threads this panel gets
+void DataRecorder::Panel::updatePriority(int index)
+{
+	writerPriority = priorityList->itemData(index).toInt();
+	WriterPool::getInstance()->setPriority(this, writerPriority);
+}
+
+// Update SWMR writing, it applies to the files opened afterwards
+void DataRecorder::Panel::updateSwmr(bool on)
+{
+	swmr = on;
+}
+
+// Copy the trigger options, they only change while the panel is not recording
+void DataRecorder::Panel::updateTrigger(void)
+{
+	triggerSource = triggerSourceList->itemData(triggerSourceList->currentIndex()).toInt();
+	triggerEdge = triggerEdgeList->itemData(triggerEdgeList->currentIndex()).toInt();
+	triggerChannel = std::max(triggerChannelList->currentIndex(), 0);
+	triggerLevel = triggerSource == TRIGGER_DIO ? 0.5 : triggerLevelSpin->value();
+	triggerEvent = triggerEventEdit->text().toStdString();
+	preTime = preSpin->value();
+	postTime = postSpin->value();
+}
+
 // Custom event handler
 void DataRecorder::Panel::customEvent(QEvent *e)
 {
 	if (e->type() == QFileExistsEvent)
 	{
-		mutex.lock();
-		CustomEvent * event = static_cast<CustomEvent *>(e);
-		FileExistsEventData *data = reinterpret_cast<FileExistsEventData *> (event->getData());
-		data->response = QMessageBox::question(this, "File exists",
+		int reply = QMessageBox::question(this, "File exists",
 				"The file already exists. What would you like to do?",
 				"Append", "Overwrite", "Cancel", 0, 2);
 		recordStatus->setText("Not Recording");
-		data->done.wakeAll();
+		mutex.lock();
+		openReply = reply;
 		mutex.unlock();
+		WriterPool::getInstance()->release(this);
 	}
 	else if (e->type() == QSetFileNameEditEvent)
 	{
-		mutex.lock();
 		CustomEvent * event = static_cast<CustomEvent *>(e);
 		SetFileNameEditEventData *data = reinterpret_cast<SetFileNameEditEventData *> (event->getData());
 		fileNameEdit->setText(data->filename);
@@ -981,8 +1503,7 @@ void DataRecorder::Panel::customEvent(QEvent *e)
 			startRecordButton->setEnabled(true);
 			Plugin::getInstance()->recStatus = true;
 		}
-		data->done.wakeAll();
-		mutex.unlock();
+		delete data;
 	}
 	else if (e->type() == QDisableGroupsEvent) 
 	{
@@ -991,7 +1512,9 @@ void DataRecorder::Panel::customEvent(QEvent *e)
 		closeButton->setEnabled(false);
 		channelGroup->setEnabled(false);
 		sampleGroup->setEnabled(false);
-		recordStatus->setText("Recording...");
+		storageGroup->setEnabled(false);
+		triggerGroup->setEnabled(false);
+		recordStatus->setText(triggerSource == TRIGGER_OFF ? "Recording..." : "Armed...");
 	}
 	else if (e->type() == QEnableGroupsEvent)
 	{
@@ -1000,9 +1523,19 @@ void DataRecorder::Panel::customEvent(QEvent *e)
 		closeButton->setEnabled(true);
 		channelGroup->setEnabled(true);
 		sampleGroup->setEnabled(true);
+		storageGroup->setEnabled(true);
+		triggerGroup->setEnabled(true);
 		recordStatus->setText("Ready.");
 		fileSize->setNum(int(QFile(fileNameEdit->text()).size()) / 1024);
 		trialLength->setNum(double(RT::System::getInstance()->getPeriod()*1e-9* fixedcount));
+		if (storedBytes)
+			compressionRatio->setText(QString::number(double(writeBytes) / storedBytes, 'f', 2));
+		else
+			compressionRatio->setText("-");
+		if (writeTime)
+			writeBandwidth->setText(QString::number(writeBytes * 1e3 / writeTime, 'f', 1));
+		else
+			writeBandwidth->setText("-");
 		count = 0;
 	}
 }
@@ -1023,22 +1556,78 @@ void DataRecorder::Panel::doDeferred(const Settings::Object::State &s)
 		channel->block = block;
 		channel->type = s.loadInteger(str.str() + " type");
 		channel->index = s.loadInteger(str.str() + " index");
+		channel->decimation = s.loadInteger(str.str() + " decimation");
+		channel->storage = s.loadInteger(str.str() + " storage");
+		channel->minimum = s.loadDouble(str.str() + " minimum");
+		channel->maximum = s.loadDouble(str.str() + " maximum");
 		channel->name.sprintf("%s %ld : %s", channel->block->getName().c_str(),
 				channel->block->getID(), channel->block->getName(channel->type,	channel->index).c_str());
+		channel->name += channelSuffix(channel->decimation, channel->storage, channel->minimum, channel->maximum);
+
+		if (!reserveFrame(tickWidth() + 1, packTicks)) {
+			delete channel;
+			break;
+		}
 
 		channels.insert(channels.end(), *channel);
 		selectionBox->addItem(channel->name);
 	}
+
+	// The trigger channel is one of the channels restored above
+	if (s.loadInteger("Trigger Channel") < triggerChannelList->count())
+		triggerChannelList->setCurrentIndex(s.loadInteger("Trigger Channel"));
+}
+
+// Tell the FIFOs of different panels apart in the FIFO monitor
+void DataRecorder::Panel::nameFifos(void)
+{
+	std::string prefix = "Data Recorder " + std::to_string(getID());
+	fifo.setName(prefix + " samples");
+	eventFifo.setName(prefix + " events");
 }
 
 void DataRecorder::Panel::doLoad(const Settings::Object::State &s)
 {
+	// The panel may have taken the ID it was saved with
+	nameFifos();
+
 	if (s.loadInteger("Maximized"))
 		showMaximized();
 	else if (s.loadInteger("Minimized"))
 		showMinimized();
 
 	downsampleSpin->setValue(s.loadInteger("Downsample"));
+	chunkSpin->setValue(s.loadInteger("Chunk Size"));
+	int i = compressionList->findData(static_cast<int>(s.loadInteger("Compression")));
+	compressionList->setCurrentIndex(i < 0 ? 0 : i);
+	updateCompression(compressionList->currentIndex());
+	syncSpin->setValue(s.loadInteger("Sync Interval"));
+	i = asyncList->findData(static_cast<int>(s.loadInteger("Async Layout")));
+	asyncList->setCurrentIndex(i < 0 ? 0 : i);
+	updateAsyncLayout(asyncList->currentIndex());
+	i = layoutList->findData(static_cast<int>(s.loadInteger("Channel Layout")));
+	layoutList->setCurrentIndex(i < 0 ? 0 : i);
+	updateChannelLayout(layoutList->currentIndex());
+	i = rotateList->findData(static_cast<int>(s.loadInteger("Rotate Mode")));
+	rotateList->setCurrentIndex(i < 0 ? 0 : i);
+	rotateSpin->setValue(s.loadInteger("Rotate Limit"));
+	updateRotation();
+	swmrCheck->setChecked(s.loadInteger("SWMR"));
+	timestampCheck->setChecked(s.loadInteger("Timestamps"));
+	i = priorityList->findData(static_cast<int>(s.loadInteger("Writer Priority")));
+	priorityList->setCurrentIndex(i < 0 ? 1 : i);
+	updatePriority(priorityList->currentIndex());
+	i = triggerSourceList->findData(static_cast<int>(s.loadInteger("Trigger Source")));
+	triggerSourceList->setCurrentIndex(i < 0 ? 0 : i);
+	i = triggerEdgeList->findData(static_cast<int>(s.loadInteger("Trigger Edge")));
+	triggerEdgeList->setCurrentIndex(i < 0 ? 0 : i);
+	if (!s.loadString("Trigger Event").empty())
+		triggerEventEdit->setText(QString::fromStdString(s.loadString("Trigger Event")));
+	triggerLevelSpin->setValue(s.loadDouble("Trigger Level"));
+	preSpin->setValue(s.loadInteger("Pre-Trigger (ms)"));
+	postSpin->setValue(s.loadInteger("Post-Trigger (ms)"));
+	updateTrigger();
+	packSpin->setValue(std::max(1, s.loadInteger("Pack Ticks")));
 	resize(s.loadInteger("W"), s.loadInteger("H"));
 	parentWidget()->move(s.loadInteger("X"), s.loadInteger("Y"));
 }
@@ -1057,6 +1646,24 @@ void DataRecorder::Panel::doSave(Settings::Object::State &s) const
 	s.saveInteger("H", height());
 
 	s.saveInteger("Downsample", downsampleSpin->value());
+	s.saveInteger("Chunk Size", chunkSpin->value());
+	s.saveInteger("Compression", compression);
+	s.saveInteger("Sync Interval", syncSpin->value());
+	s.saveInteger("Async Layout", asyncLayout);
+	s.saveInteger("Channel Layout", channelLayout);
+	s.saveInteger("Rotate Mode", rotateMode);
+	s.saveInteger("Rotate Limit", rotateLimit);
+	s.saveInteger("SWMR", swmr);
+	s.saveInteger("Timestamps", stampTicks);
+	s.saveInteger("Writer Priority", writerPriority);
+	s.saveInteger("Trigger Source", triggerSource);
+	s.saveInteger("Trigger Edge", triggerEdge);
+	s.saveInteger("Trigger Channel", triggerChannel);
+	s.saveString("Trigger Event", triggerEvent);
+	s.saveDouble("Trigger Level", triggerLevelSpin->value());
+	s.saveInteger("Pre-Trigger (ms)", preTime);
+	s.saveInteger("Post-Trigger (ms)", postTime);
+	s.saveInteger("Pack Ticks", packTicks);
 	s.saveInteger("Num Channels", channels.size());
 	size_t n = 0;
 	for (RT::List<Channel>::const_iterator i = channels.begin(), end = channels.end(); i != end; ++i) {
@@ -1066,258 +1673,1098 @@ void DataRecorder::Panel::doSave(Settings::Object::State &s) const
 		s.saveInteger(str.str() + " ID", i->block->getID());
 		s.saveInteger(str.str() + " type", i->type);
 		s.saveInteger(str.str() + " index", i->index);
+		s.saveInteger(str.str() + " decimation", i->decimation);
+		s.saveInteger(str.str() + " storage", i->storage);
+		s.saveDouble(str.str() + " minimum", i->minimum);
+		s.saveDouble(str.str() + " maximum", i->maximum);
 	}
 }
 
-void *DataRecorder::Panel::bounce(void *param)
-{
-	Panel *that = reinterpret_cast<Panel *> (param);
-	if (that)
-	{
-		that->processData();
-	}
-	return 0;
-}
-
-void DataRecorder::Panel::processData(void)
+// Handle the tokens queued by the realtime thread, about budget bytes of
+// them, called by a writer pool worker. Flush appends what is staged once
+// caught up, so that the partial batches of every panel are written together
+bool DataRecorder::Panel::service(size_t budget, bool flush)
 {
-	enum {
-		CLOSED, OPENED, RECORD,
-	} state = CLOSED;
-
-	tokenRetrieved = false;
-	for (;;) {
+	for (size_t handled = 0; handled < budget; handled += sizeof(_token) + _token.size) {
 		if(!tokenRetrieved) {
 			// Returns true if data was available and retrieved
 			if(fifo.read(&_token, sizeof(_token))) 
 				tokenRetrieved = true;
 			else
 			{ 
-				// Sleep loop then restart if no token was retrieved
-				nanosleep(&sleep, NULL);
-				continue;
+				// Caught up, give the worker back
+				if (flush && batchPending())
+					flushBatch();
+				processEvents(writerState == RECORD || triggerTrial);
+				return true;
 			}
 		}
+
+		// Handle the asynchronous data and parameter changes posted before
+		// this token, in the trial that was active when they were posted
+		processEvents(writerState == RECORD || triggerTrial);
+
 		if (_token.type == SYNC)
 		{
-			if (state == RECORD)
+			if (writerState == ARMED)
 			{
-				double data[_token.size / sizeof(double)];
-				if(!fifo.read(data, _token.size))
-					continue; // Restart loop if data is not available
-				H5PTappend(file.cdata, 1, data);
-				++file.idx;
+				// Whole ticks of every channel, held until a trigger wants them
+				size_t width = tickWidth() * sizeof(double);
+				size_t rows = width ? _token.size / width : 0;
+				if (!rows || rows > packRows || _token.size % width)
+				{
+					std::vector<char> data(_token.size);
+					if(!fifo.read(data.data(), _token.size))
+						return true; // Handled again once the rest is queued
+					tokenRetrieved = false;
+					continue;
+				}
+
+				if(!fifo.read(&row[0], _token.size))
+					return true; // Handled again once the rest is queued
+				holdTicks(&row[0], rows);
+				if (triggerTrial && rotationDue(_token.time, false))
+					rotateFile(trialStart + trialTicks * RT::System::getInstance()->getPeriod(), true);
 			}
-		}
-		else if (_token.type == ASYNC)
-		{
-			if (state == RECORD)
+			else if (writerState == RECORD)
 			{
-				double data[_token.size / sizeof(double)];
-				if(!fifo.read(data, _token.size))
-					continue; // Restart loop if data is not available
-				if (data)
+				// Tokens carry whole ticks of every channel
+				size_t width = (decimate ? row.size() / packRows : batchWidth) * sizeof(double);
+				size_t rows = width ? _token.size / width : 0;
+				if (!width || !rows || rows > packRows || _token.size % width)
 				{
-					hsize_t array_size[] = { _token.size / sizeof(double) };
-					hid_t array_space = H5Screate_simple(1, array_size,	array_size);
-					hid_t array_type = H5Tarray_create(H5T_IEEE_F64LE, 1,	array_size);
-
-					QString data_name = QString::number(static_cast<unsigned long long> (_token.time));
-					hid_t adata = H5Dcreate(file.adata, data_name.toLatin1().constData(),
-							array_type, array_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-					H5Dwrite(adata, array_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
-
-					H5Dclose(adata);
-					H5Tclose(array_type);
-					H5Sclose(array_space);
+					// Not a row of this trial, skip over it
+					std::vector<char> data(_token.size);
+					if(!fifo.read(data.data(), _token.size))
+						return true; // Handled again once the rest is queued
+					tokenRetrieved = false;
+					continue;
 				}
+
+				if (decimate)
+				{
+					if(!fifo.read(&row[0], _token.size))
+						return true; // Handled again once the rest is queued
+					for (size_t i = 0; i < rows; ++i)
+						decimateRow(&row[i * width / sizeof(double)]);
+				}
+				else
+				{
+					// Stage the rows, the batch is appended once it is full, once it
+					// is stale or before any other token is handled
+					if (batchRows + rows > batchLimit)
+						flushBatch();
+					if(!fifo.read(&batch[batchRows * batchWidth], _token.size))
+						return true; // Handled again once the rest is queued
+					commitRows(rows);
+				}
+				trialTicks += rows;
+
+				// A trial that outgrows its segment continues in the next one
+				if (rotationDue(_token.time, false))
+					rotateFile(_token.time, true);
 			}
 		}
+		else if (_token.type == TRIGGER)
+		{
+			if (writerState == ARMED)
+				handleTrigger(_token.time);
+		}
 		else if (_token.type == OPEN)
 		{
-			if (state == RECORD)
-				stopRecording(_token.time);
-			if (state != CLOSED)
-				closeFile();
-			char filename_string[_token.size];
-			if(!fifo.read(filename_string, _token.size))
-				continue; // Restart loop if data is not available
-			QString filename = filename_string;
-			if (openFile(filename))
-				state = CLOSED;
+			int reply = OPEN_OVERWRITE;
+			if (!openPending)
+			{
+				if (writerState == RECORD)
+					stopRecording(_token.time);
+				else if (triggerTrial)
+					stopTriggeredTrial();
+				if (writerState != CLOSED)
+					closeFile();
+				writerState = CLOSED;
+				char filename_string[_token.size];
+				if(!fifo.read(filename_string, _token.size))
+					return true; // Handled again once the rest is queued
+				openName = filename_string;
+
+				// Ask whether to append to a file that exists, the worker is
+				// given back until the GUI answers
+				if (QFile::exists(openName))
+				{
+					mutex.lock();
+					openReply = closing ? OPEN_CANCEL : OPEN_PENDING;
+					if (!closing)
+						WriterPool::getInstance()->hold(this);
+					mutex.unlock();
+					openPending = true;
+					QApplication::postEvent(this, new CustomEvent(static_cast<QEvent::Type>QFileExistsEvent));
+					return true;
+				}
+			}
+			else
+			{
+				mutex.lock();
+				reply = openReply;
+				mutex.unlock();
+				if (reply == OPEN_PENDING)
+					return true;
+				openPending = false;
+			}
+
+			if (reply == OPEN_CANCEL || openFile(openName, reply == OPEN_APPEND))
+				writerState = CLOSED;
 			else
-				state = OPENED;
+				writerState = OPENED;
 		}
 		else if (_token.type == CLOSE)
 		{
-			if (state == RECORD)
+			if (writerState == RECORD)
 				stopRecording(RT::OS::getTime());
-			if (state != CLOSED) 
+			else if (triggerTrial)
+				stopTriggeredTrial();
+			if (writerState != CLOSED) 
 				closeFile();
-			state = CLOSED;
+			writerState = CLOSED;
 		}
 		else if (_token.type == START)
 		{
-			if (state == OPENED)
+			if (writerState == OPENED)
 			{
 				count = 0;
-				startRecording(_token.time);
-				state = RECORD;
+				if (triggerSource == TRIGGER_OFF)
+				{
+					if (rotationDue(_token.time, true))
+						rotateFile(_token.time, false);
+					++trialCount;
+					startRecording(_token.time);
+					writerState = RECORD;
+				}
+				else
+				{
+					armTrigger();
+					writerState = ARMED;
+				}
 				QEvent *event = new QEvent(static_cast<QEvent::Type>QDisableGroupsEvent);
 				QApplication::postEvent(this, event);
 			}
 		}
 		else if (_token.type == STOP)
 		{
-			if (state == RECORD)
+			if (writerState == RECORD || writerState == ARMED)
 			{
-				stopRecording(_token.time);
-				state = OPENED;
-				fixedcount = count;
+				if (writerState == RECORD)
+					stopRecording(_token.time);
+				else if (triggerTrial)
+					stopTriggeredTrial();
+				writerState = OPENED;
 				QEvent *event = new QEvent(static_cast<QEvent::Type>QEnableGroupsEvent);
 				QApplication::postEvent(this, event);
 			}
 		}
 		else if (_token.type == DONE)
 		{
-			if (state == RECORD)
+			if (writerState == RECORD)
 				stopRecording(_token.time, true);
-			if (state != CLOSED)
+			else if (triggerTrial)
+				stopTriggeredTrial();
+			if (writerState != CLOSED)
 				closeFile(true);
-			break;
-		}
-		else if (_token.type == PARAM)
-		{
-			param_change_t data;
-			if(!fifo.read(&data, sizeof(data)))
-				continue; // Restart loop if data is not available
-
-			IO::Block	*block = dynamic_cast<IO::Block *> (Settings::Manager::getInstance()->getObject(data.id));
-
-			if (block && state == RECORD)
-			{
-				param_hdf_t param = { data.step, data.value, };
-
-				hid_t param_type;
-				param_type = H5Tcreate(H5T_COMPOUND, sizeof(param_hdf_t));
-				H5Tinsert(param_type, "index", HOFFSET(param_hdf_t,index),
-						H5T_STD_I64LE);
-				H5Tinsert(param_type, "value", HOFFSET(param_hdf_t,value),
-						H5T_IEEE_F64LE);
-
-				QString parameter_name = QString::number(block->getID()) + " "
-					+ QString::fromStdString(block->getName()) + " : "
-					+ QString::fromStdString(block->getName(Workspace::PARAMETER, data.index));
-
-				hid_t data = H5PTopen(file.pdata, parameter_name.toLatin1().constData());
-				H5PTappend(data, 1, &param);
-				H5PTclose(data);
-				H5Tclose(param_type);
-			}
+			writerState = CLOSED;
+			tokenRetrieved = false;
+			return false;
 		}
 		tokenRetrieved = false;
+		if (_token.type != SYNC)
+			++marksHandled;
 	}
+
+	return true;
 }
 
-int DataRecorder::Panel::openFile(QString &filename)
+// File access of HDF5 recordings, files written for SWMR readers need the
+// latest file format
+static hid_t fileAccess(bool swmr)
 {
-#ifdef DEBUG
-	if(!pthread_equal(pthread_self(),thread))
-	{
-		ERROR_MSG("DataRecorder::Panel::openFile : called by invalid thread\n");
-		PRINT_BACKTRACE();
-	}
+	hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+#if H5_VERSION_GE(1,10,0)
+	if (swmr)
+		H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
 #endif
+	return fapl;
+}
 
-	if (QFile::exists(filename)) {
-		CustomEvent *event = new CustomEvent(static_cast<QEvent::Type>QFileExistsEvent);
-		FileExistsEventData data;
+// Write a scalar of the trial. Files written for SWMR readers have them
+// created when the trial starts, nothing can be created afterwards
+static void writeScalar(hid_t trial, const char *name, long long value)
+{
+	hid_t data;
+	if (H5Lexists(trial, name, H5P_DEFAULT) > 0)
+		data = H5Dopen(trial, name, H5P_DEFAULT);
+	else {
+		hid_t scalar_space = H5Screate(H5S_SCALAR);
+		data = H5Dcreate(trial, name, H5T_STD_U64LE, scalar_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+		H5Sclose(scalar_space);
+	}
+	H5Dwrite(data, H5T_STD_U64LE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &value);
+	H5Dclose(data);
+}
 
-		event->setData(static_cast<void *>(&data));
-		data.filename = filename;
+// Give back the blocks reserved for a segment that it did not use
+static void releaseReserve(const QString &name, off_t reserve)
+{
+	int fd = open(name.toLatin1().constData(), O_WRONLY);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (!fstat(fd, &st) && st.st_size < reserve)
+		fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, st.st_size, reserve - st.st_size);
+	close(fd);
+}
 
-		QApplication::postEvent(this, event);
-		data.done.wait(&mutex);
-		if (data.response == 0) { // append
-			file.id = H5Fopen(filename.toLatin1().constData(), H5F_ACC_RDWR, H5P_DEFAULT);
-			size_t trial_num;
-			QString trial_name;
-			H5Eset_auto(H5E_DEFAULT, NULL, NULL);
-			for (trial_num = 1;; ++trial_num) {
-				trial_name = "/Trial" + QString::number(trial_num);
-				file.trial = H5Gopen(file.id, trial_name.toLatin1().constData(), H5P_DEFAULT);
-				if (file.trial < 0) {
-					H5Eclear(H5E_DEFAULT);
-					break;
-				} else
-					H5Gclose(file.trial);
-			}
-			trialNum->setNum(int(trial_num)-1);
-		} else if (data.response == 1) { //overwrite
-			file.id = H5Fcreate(filename.toLatin1().constData(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-			trialNum->setText("0");
-		} else {
-			return -1;
-		}
-	} else {
-		file.id = H5Fcreate(filename.toLatin1().constData(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-		trialNum->setText("0");
-	}
-	if (file.id < 0) {
-		H5E_type_t error_type;
-		size_t error_size;
-		error_size = H5Eget_msg(file.id, &error_type, NULL, 0);
-		char error_msg[error_size + 1];
-		H5Eget_msg(file.id, &error_type, error_msg, error_size);
-		error_msg[error_size] = 0;
-		H5Eclear(file.id);
+// Name of segment n, the first segment is the file itself
+QString DataRecorder::Panel::segmentName(int n) const
+{
+	if (!n)
+		return segmentBase + segmentSuffix;
+	return segmentBase + QString("-%1").arg(n, 4, 10, QChar('0')) + segmentSuffix;
+}
 
-		ERROR_MSG("DataRecorder::Panel::processData : failed to open \"%s\" for writing with error : %s\n", filename.toStdString().c_str(),error_msg);
-		return -1;
-	}
+// Start the manifest of a newly opened file, which already holds trials
+void DataRecorder::Panel::openSegments(const QString &filename, long long trials)
+{
+	rotating = rotateMode != ROTATE_OFF;
+	segment = 0;
+	nextSegment = 0;
+	segmentReserve = 0;
+	segmentTrials = 0;
+	segmentStart = 0;
+	segmentSize = 0;
+	trialCount = trials;
+	if (!rotating)
+		return;
 
-	CustomEvent *event = new CustomEvent(static_cast<QEvent::Type>QSetFileNameEditEvent);
-	SetFileNameEditEventData data;
-	data.filename = filename;
-	event->setData(static_cast<void*>(&data));
+	QFileInfo info(filename);
+	segmentSuffix = info.suffix().isEmpty() ? QString() : "." + info.suffix();
+	segmentBase = filename.left(filename.length() - segmentSuffix.length());
 
-	QApplication::postEvent(this, event);
-	data.done.wait(&mutex);
+	FILE *manifest = fopen((segmentBase + ".manifest").toLatin1().constData(), "w");
+	if (!manifest) {
+		ERROR_MSG("DataRecorder::Panel::openSegments : failed to create the manifest of \"%s\"\n", filename.toStdString().c_str());
+		rotating = false;
+		return;
+	}
+	fprintf(manifest, "# file\tfirst trial\tcontinued\n");
+	fclose(manifest);
 
-	return 0;
+	appendManifest(filename, 1, false);
+	preopenSegment();
 }
 
-void DataRecorder::Panel::closeFile(bool shutdown)
+// Drop the segment created ahead of time, the recording ended before it
+void DataRecorder::Panel::closeSegments(void)
 {
-#ifdef DEBUG
-	if(!pthread_equal(pthread_self(),thread))
+	if (nextReady)
+	{
+		if (nextId >= 0)
+			H5Fclose(nextId);
+		nextId = -1;
+		unlink(segmentName(nextSegment).toLatin1().constData());
+		nextReady = false;
+	}
+	if (segmentReserve)
+		releaseReserve(segmentName(segment), segmentReserve);
+	segmentReserve = 0;
+	rotating = false;
+}
+
+// Create the next segment, skipping names that are taken. Rotating by size
+// reserves its blocks without changing its size, so the writes after the
+// switch don't wait on the allocator
+void DataRecorder::Panel::preopenSegment(void)
+{
+	nextReady = false;
+	if (!rotating)
+		return;
+
+	nextSegment = segment + 1;
+	while (QFile::exists(segmentName(nextSegment)))
+		++nextSegment;
+	QString name = segmentName(nextSegment);
+
+	int fd = -1;
+	if (file.raw.isOpen())
+		fd = open(name.toLatin1().constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	else {
+		hid_t fapl = fileAccess(file.swmr);
+		nextId = H5Fcreate(name.toLatin1().constData(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+		H5Pclose(fapl);
+		void *handle;
+		if (nextId >= 0 && H5Fget_vfd_handle(nextId, H5P_DEFAULT, &handle) >= 0)
+			fd = *static_cast<int *> (handle);
+	}
+	if (fd < 0) {
+		ERROR_MSG("DataRecorder::Panel::preopenSegment : failed to create \"%s\", the recording stays in \"%s\"\n",
+				name.toStdString().c_str(), segmentName(segment).toStdString().c_str());
+		if (nextId >= 0)
+			H5Fclose(nextId);
+		nextId = -1;
+		return;
+	}
+
+	nextReserve = 0;
+	if (rotateMode == ROTATE_SIZE && !fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(rotateLimit) << 20))
+		nextReserve = static_cast<off_t>(rotateLimit) << 20;
+	if (file.raw.isOpen())
+		close(fd);
+	nextReady = true;
+}
+
+// True once the segment is full. Size and duration limits split a trial,
+// trial limits only apply between trials
+bool DataRecorder::Panel::rotationDue(long long time, bool between) const
+{
+	if (!nextReady || !segmentTrials)
+		return false;
+	if (rotateMode == ROTATE_SIZE)
+		return segmentSize >= static_cast<long long>(rotateLimit) << 20;
+	if (rotateMode == ROTATE_DURATION)
+		return time - segmentStart >= rotateLimit * 60000000000ll;
+	if (rotateMode == ROTATE_TRIALS)
+		return between && segmentTrials >= rotateLimit;
+	return false;
+}
+
+// Switch to the segment created ahead of time. A split trial stops at time
+// and continues in the new segment, as the same trial of the recording
+void DataRecorder::Panel::rotateFile(long long time, bool split)
+{
+	long long post = postTicks;
+	bool raw = file.raw.isOpen();
+	if (split)
+		stopRecording(time);
+
+	if (raw)
+		file.raw.close();
+	else
+		H5Fclose(file.id);
+	if (segmentReserve)
+		releaseReserve(segmentName(segment), segmentReserve);
+
+	segment = nextSegment;
+	segmentReserve = nextReserve;
+	nextReady = false;
+	if (raw) {
+		file.start = 0;
+		file.trials = 0;
+		if (file.raw.open(segmentName(segment).toStdString(), 0, false))
+			ERROR_MSG("DataRecorder::Panel::rotateFile : failed to open \"%s\"\n", segmentName(segment).toStdString().c_str());
+	} else {
+		file.id = nextId;
+		file.swmrActive = false;
+		nextId = -1;
+	}
+	file.name = segmentName(segment);
+	segmentTrials = 0;
+	segmentStart = 0;
+	segmentSize = 0;
+
+	appendManifest(segmentName(segment), split ? trialCount : trialCount + 1, split);
+	if (split)
+	{
+		startRecording(time);
+		trialStart = time;
+		postTicks = post;
+	}
+	preopenSegment();
+}
+
+// One line per segment: its file name, the number of its first trial in the
+// whole recording, and whether that trial continues from the segment before
+void DataRecorder::Panel::appendManifest(const QString &name, long long trial, bool continued)
+{
+	FILE *manifest = fopen((segmentBase + ".manifest").toLatin1().constData(), "a");
+	if (!manifest) {
+		ERROR_MSG("DataRecorder::Panel::appendManifest : failed to add \"%s\" to the manifest\n", name.toStdString().c_str());
+		return;
+	}
+	fprintf(manifest, "%s\t%lld\t%d\n", QFileInfo(name).fileName().toLatin1().constData(), trial, continued ? 1 : 0);
+	fclose(manifest);
+}
+
+// Allocate the pre-trigger window, trials start with the triggers. The
+// window always holds at least the triggering tick
+void DataRecorder::Panel::armTrigger(void)
+{
+	long long period = RT::System::getInstance()->getPeriod();
+	ringCapacity = std::max(preTime * 1000000ll / period, 1ll);
+	ring.assign(ringCapacity * tickWidth(), 0.0);
+	row.resize(packRows * tickWidth());
+	ringStart = 0;
+	ringCount = 0;
+	postTicks = 0;
+	triggerTrial = false;
+}
+
+// Ticks inside the post-trigger window go to the trial, the others are held
+// in the ring. The trial ends once the held ticks fill it, when a trigger
+// could no longer join the trial without a gap
+void DataRecorder::Panel::holdTicks(const double *ticks, size_t n)
+{
+	size_t width = tickWidth();
+	while (n)
+	{
+		if (postTicks > 0)
+		{
+			size_t m = std::min(static_cast<long long>(n), postTicks);
+			writeTicks(ticks, m);
+			postTicks -= m;
+			ticks += m * width;
+			n -= m;
+			continue;
+		}
+
+		if (ringCount == ringCapacity)
+		{
+			if (triggerTrial)
+				stopTriggeredTrial();
+			ringStart = (ringStart + 1) % ringCapacity;
+			--ringCount;
+		}
+		size_t end = (ringStart + ringCount) % ringCapacity;
+		std::copy(ticks, ticks + width, &ring[end * width]);
+		++ringCount;
+		ticks += width;
+		--n;
+	}
+}
+
+// Write ticks of every channel to the current trial
+void DataRecorder::Panel::writeTicks(const double *ticks, size_t n)
+{
+	size_t width = tickWidth();
+	trialTicks += n;
+	if (decimate)
+	{
+		for (size_t k = 0; k < n; ++k)
+			decimateRow(ticks + k * width);
+		return;
+	}
+
+	while (n && width)
+	{
+		size_t m = std::min(n, batchLimit - batchRows);
+		memcpy(&batch[batchRows * batchWidth], ticks, m * width * sizeof(double));
+		commitRows(m);
+		ticks += m * width;
+		n -= m;
+	}
+}
+
+// Start a trial with the held ticks, the last of which triggered. A trial
+// that is still open takes the held ticks and a new post-trigger window
+void DataRecorder::Panel::handleTrigger(long long time)
+{
+	long long period = RT::System::getInstance()->getPeriod();
+	if (!triggerTrial)
+	{
+		trialStart = time - static_cast<long long>(ringCount ? ringCount - 1 : 0) * period;
+		if (rotationDue(trialStart, true))
+			rotateFile(trialStart, false);
+		++trialCount;
+		startRecording(trialStart);
+		triggerTrial = true;
+	}
+
+	size_t width = tickWidth();
+	size_t first = std::min(ringCount, ringCapacity - ringStart);
+	if (ringCount)
+	{
+		writeTicks(&ring[ringStart * width], first);
+		writeTicks(&ring[0], ringCount - first);
+	}
+	ringStart = 0;
+	ringCount = 0;
+	postTicks = postTime * 1000000ll / period;
+}
+
+// End the triggered trial after its last written tick
+void DataRecorder::Panel::stopTriggeredTrial(void)
+{
+	stopRecording(trialStart + trialTicks * RT::System::getInstance()->getPeriod());
+	triggerTrial = false;
+	postTicks = 0;
+}
+
+// Append the staged rows to Channel Data with a single call
+void DataRecorder::Panel::flushBatch(void)
+{
+	if (batchRows && batchWidth)
+	{
+		long long start = RT::OS::getTime();
+		size_t rowSize = rowLayout.size;
+		if (file.raw.isOpen())
+		{
+			rowSize = batchWidth * sizeof(double);
+			file.raw.write(&batch[0], batchRows * rowSize);
+		}
+		else if (columnTables.size())
+		{
+			rowSize = 0;
+			for (size_t c = 0; c < batchWidth; ++c)
+			{
+				const SampleStorage::layout_t &layout = columnLayouts[c];
+				packedRows.resize(batchRows * layout.size);
+				SampleStorage::pack(layout, &batch[c], batchRows, batchWidth, &packedRows[0]);
+				H5PTappend(columnTables[c], batchRows, &packedRows[0]);
+				rowSize += layout.size;
+			}
+		}
+		else if (rowLayout.narrow)
+		{
+			packedRows.resize(batchRows * rowSize);
+			SampleStorage::pack(rowLayout, &batch[0], batchRows, batchWidth, &packedRows[0]);
+			H5PTappend(file.cdata, batchRows, &packedRows[0]);
+		}
+		else
+			H5PTappend(file.cdata, batchRows, &batch[0]);
+		writeTime += RT::OS::getTime() - start;
+		writeBytes += batchRows * rowSize;
+	}
+	batchRows = 0;
+
+	for (size_t i = 0; groupRows && i < groups.size(); ++i)
+		flushGroup(i);
+
+	if (paramRows)
+	{
+		long long start = RT::OS::getTime();
+		for (std::map<param_key_t, param_table_t>::iterator i = paramTables.begin(), end = paramTables.end(); i != end; ++i)
+			if (i->second.pending.size())
+			{
+				H5PTappend(i->second.table, i->second.pending.size(), &i->second.pending[0]);
+				i->second.pending.clear();
+			}
+		writeTime += RT::OS::getTime() - start;
+	}
+	paramRows = 0;
+
+	if (asyncEntries.size())
+	{
+		long long start = RT::OS::getTime();
+		if (asyncData.size())
+			H5PTappend(asyncSamples, asyncData.size(), &asyncData[0]);
+		H5PTappend(asyncIndex, asyncEntries.size(), &asyncEntries[0]);
+		writeTime += RT::OS::getTime() - start;
+		asyncData.clear();
+		asyncEntries.clear();
+	}
+
+	if (jitter.size())
+	{
+		long long start = RT::OS::getTime();
+		H5PTappend(stampJitter, jitter.size(), &jitter[0]);
+		if (stampExceptions.size())
+			H5PTappend(stampExceptionTable, stampExceptions.size(), &stampExceptions[0]);
+		writeTime += RT::OS::getTime() - start;
+		writeBytes += jitter.size() * sizeof(short) + stampExceptions.size() * sizeof(stamp_exception_t);
+		jitter.clear();
+		stampExceptions.clear();
+	}
+
+	// SWMR readers only see the rows the flushed metadata points to
+	if (file.swmrActive && RT::OS::getTime() - swmrFlush >= SWMR_FLUSH_INTERVAL)
+	{
+		long long start = RT::OS::getTime();
+		H5Fflush(file.id, H5F_SCOPE_LOCAL);
+		swmrFlush = RT::OS::getTime();
+		writeTime += swmrFlush - start;
+	}
+
+	// Size rotation goes by what the segment holds so far
+	if (nextReady && rotateMode == ROTATE_SIZE)
+	{
+		hsize_t size;
+		if (file.raw.isOpen())
+			segmentSize = file.raw.tell();
+		else if (H5Fget_filesize(file.id, &size) >= 0)
+			segmentSize = size;
+	}
+}
+
+// Append the rows staged for a group to its table
+void DataRecorder::Panel::flushGroup(size_t index)
+{
+	group_t &group = groups[index];
+	if (!group.rows)
+		return;
+
+	long long start = RT::OS::getTime();
+	if (group.layout.narrow)
+	{
+		packedRows.resize(group.rows * group.layout.size);
+		SampleStorage::pack(group.layout, &group.data[0], group.rows, group.channels.size(), &packedRows[0]);
+		H5PTappend(group.table, group.rows, &packedRows[0]);
+	}
+	else
+		H5PTappend(group.table, group.rows, &group.data[0]);
+	writeTime += RT::OS::getTime() - start;
+	writeBytes += group.rows * group.layout.size;
+	groupRows -= group.rows;
+	group.rows = 0;
+}
+
+// Anything staged by the writer that is not in the file yet
+bool DataRecorder::Panel::batchPending(void) const
+{
+	return batchRows || groupRows || paramRows || asyncEntries.size() || jitter.size();
+}
+
+// Count staged Channel Data rows, the batch is appended once it is full,
+// once it is stale or before any other token is handled
+void DataRecorder::Panel::commitRows(size_t n)
+{
+	if (!batchPending())
+		batchTime = RT::OS::getTime();
+	batchRows += n;
+	file.idx += n;
+
+	if (batchRows >= batchLimit || RT::OS::getTime() - batchTime >= WRITER_FLUSH_INTERVAL)
+		flushBatch();
+}
+
+// Pick each channel's rate for the trial. Channel Data holds the channels at
+// the panel rate and the others are grouped by rate, in the order of their
+// first channel. Raw captures have no room for other rates
+void DataRecorder::Panel::setupDecimation(void)
+{
+	bool raw = file.raw.isOpen();
+
+	decimators.resize(channels.size());
+	row.resize(packRows * tickWidth());
+	columns.clear();
+	groups.clear();
+
+	size_t n = 0;
+	decimate = downsample_rate > 1;
+	for (RT::List<Channel>::iterator i = channels.begin(), end = channels.end(); i != end; ++i, ++n)
+	{
+		size_t rate = raw || !i->decimation ? downsample_rate : i->decimation;
+		decimators[n].setFactor(rate);
+		if (rate == downsample_rate)
+		{
+			columns.push_back(n);
+			continue;
+		}
+
+		std::vector<group_t>::iterator g = groups.begin();
+		while (g != groups.end() && g->rate != rate)
+			++g;
+		if (g == groups.end())
+		{
+			group_t group;
+			group.rate = rate;
+			group.table = -1;
+			group.rows = 0;
+			group.limit = 0;
+			g = groups.insert(groups.end(), group);
+		}
+		g->channels.push_back(n);
+		decimate = true;
+	}
+	batchWidth = columns.size();
+
+	// Ticks with a timestamp are wider than Channel Data rows
+	decimate = decimate || stampTicks;
+}
+
+// Lay out the stored rows of Channel Data, of its columns and of each group
+// from the storage picked for their channels
+void DataRecorder::Panel::setupStorage(void)
+{
+	std::vector<SampleStorage::column_t> stored;
+	for (RT::List<Channel>::iterator i = channels.begin(), end = channels.end(); i != end; ++i)
+	{
+		SampleStorage::column_t column = { i->storage, 1.0, 0.0, };
+		if (i->storage == SampleStorage::INT16)
+			column = SampleStorage::int16Column(i->minimum, i->maximum);
+		stored.push_back(column);
+	}
+
+	std::vector<SampleStorage::column_t> selected;
+	columnLayouts.resize(columns.size());
+	for (size_t i = 0; i < columns.size(); ++i)
+	{
+		selected.push_back(stored[columns[i]]);
+		SampleStorage::setup(columnLayouts[i], std::vector<SampleStorage::column_t>(1, stored[columns[i]]));
+	}
+	SampleStorage::setup(rowLayout, selected);
+
+	for (std::vector<group_t>::iterator g = groups.begin(), end = groups.end(); g != end; ++g)
+	{
+		selected.clear();
+		for (size_t i = 0; i < g->channels.size(); ++i)
+			selected.push_back(stored[g->channels[i]]);
+		SampleStorage::setup(g->layout, selected);
+	}
+}
+
+// Run one tick of every channel through its decimator
+void DataRecorder::Panel::decimateRow(const double *tick)
+{
+	if (stampJitter >= 0)
+		stampTick(&tick[channels.size()]);
+
+	// Channel Data columns share a rate, so they all have a sample on the same tick
+	bool ready = false;
+	double *out = &batch[batchRows * batchWidth];
+	for (size_t i = 0; i < columns.size(); ++i)
+		ready = decimators[columns[i]].push(tick[columns[i]], out[i]);
+
+	// So do the channels of a group. A full group is appended on its own, the
+	// stale rows of every group go with the next flush
+	for (size_t g = 0; g < groups.size(); ++g)
+	{
+		group_t &group = groups[g];
+		size_t width = group.channels.size();
+		bool sampled = false;
+		double *out = &group.data[group.rows * width];
+		for (size_t i = 0; i < width; ++i)
+			sampled = decimators[group.channels[i]].push(tick[group.channels[i]], out[i]);
+		if (!sampled)
+			continue;
+
+		if (!batchPending())
+			batchTime = RT::OS::getTime();
+		++group.rows;
+		++groupRows;
+		if (group.rows == group.limit)
+			flushGroup(g);
+	}
+
+	if (ready)
+		commitRows(1);
+	else if (groupRows && RT::OS::getTime() - batchTime >= WRITER_FLUSH_INTERVAL)
+		flushBatch();
+}
+
+// Stage the jitter of a tick's time, or an exception when it doesn't fit
+void DataRecorder::Panel::stampTick(const double *slot)
+{
+	long long time;
+	memcpy(&time, slot, sizeof(time));
+
+	if (!batchPending())
+		batchTime = RT::OS::getTime();
+	long long delta = time - lastStamp - stampPeriod;
+	if (!stampCount || delta < -STAMP_MAX_JITTER || delta > STAMP_MAX_JITTER)
+	{
+		stamp_exception_t exception = { stampCount, time, };
+		stampExceptions.push_back(exception);
+		delta = 0;
+	}
+	jitter.push_back(delta);
+	lastStamp = time;
+	++stampCount;
+}
+
+// Stage the samples the decimators still hold at the end of the trial
+void DataRecorder::Panel::finishDecimation(void)
+{
+	if (!decimate)
+		return;
+
+	for (size_t g = 0; g < groups.size(); ++g)
+	{
+		group_t &group = groups[g];
+		size_t width = group.channels.size();
+		std::vector<std::vector<double> > tails(width);
+		for (size_t i = 0; i < width; ++i)
+			decimators[group.channels[i]].finish(tails[i]);
+		for (size_t k = 0; k < tails[0].size(); ++k)
+		{
+			if (group.rows == group.limit)
+				flushGroup(g);
+			for (size_t i = 0; i < width; ++i)
+				group.data[group.rows * width + i] = tails[i][k];
+			++group.rows;
+			++groupRows;
+		}
+	}
+
+	std::vector<std::vector<double> > tails(columns.size());
+	for (size_t i = 0; i < columns.size(); ++i)
+		decimators[columns[i]].finish(tails[i]);
+	for (size_t k = 0; columns.size() && k < tails[0].size(); ++k)
+	{
+		for (size_t i = 0; i < columns.size(); ++i)
+			batch[batchRows * batchWidth + i] = tails[i][k];
+		commitRows(1);
+	}
+}
+
+// Handle the events posted before the next token still to be handled,
+// record is whether the trial they belong to is being written
+void DataRecorder::Panel::processEvents(bool record)
+{
+	for (;;)
+	{
+		if (eventNext == eventCount)
+		{
+			eventNext = 0;
+			eventCount = eventFifo.read(&eventBuffer[0], EVENT_READ_SLOTS, &eventSizes[0]);
+			if (!eventCount)
+				return;
+		}
+
+		char *item = &eventBuffer[eventNext * eventFifo.getSlotSize()];
+		event_token_t event;
+		memcpy(&event, item, sizeof(event));
+		if (event.marks > marksHandled)
+			return; // Posted after a token that is still queued
+
+		const data_token_t &token = event.token;
+		size_t size = eventSizes[eventNext++];
+		if (!record || size != sizeof(event) + token.size)
+			continue;
+
+		if (token.type == ASYNC)
+			writeAsyncData(token, reinterpret_cast<double *> (item + sizeof(event)));
+		else if (token.type == PARAM)
+		{
+			param_change_t data;
+			memcpy(&data, item + sizeof(event), sizeof(data));
+			writeParameterChange(data);
+		}
+	}
+}
+
+void DataRecorder::Panel::writeAsyncData(const data_token_t &token, const double *data)
+{
+	if (file.raw.isOpen()) {
+		appendRecord(file.async, RawCapture::ASYNC, token.time, data, token.size);
+		return;
+	}
+
+	size_t size = token.size / sizeof(double);
+	if (asyncIndex >= 0)
+	{
+		long long period = RT::System::getInstance()->getPeriod();
+		async_index_t entry = { token.time, (token.time - file.timestamp) / period, asyncOffset, size, };
+
+		if (!batchPending())
+			batchTime = RT::OS::getTime();
+		asyncData.insert(asyncData.end(), data, data + size);
+		asyncEntries.push_back(entry);
+		asyncOffset += size;
+		if (asyncEntries.size() >= WRITER_EVENT_ROWS || asyncData.size() * sizeof(double) >= WRITER_BATCH_BYTES)
+			flushBatch();
+		return;
+	}
+
+	hsize_t array_size[] = { size };
+	hid_t array_space = H5Screate_simple(1, array_size,	array_size);
+	hid_t array_type = H5Tarray_create(H5T_IEEE_F64LE, 1,	array_size);
+
+	QString data_name = QString::number(static_cast<unsigned long long> (token.time));
+	hid_t adata = H5Dcreate(file.adata, data_name.toLatin1().constData(),
+			array_type, array_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	H5Dwrite(adata, array_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
+
+	H5Dclose(adata);
+	H5Tclose(array_type);
+	H5Sclose(array_space);
+}
+
+void DataRecorder::Panel::writeParameterChange(const param_change_t &data)
+{
+	param_hdf_t param = { data.step, data.value, };
+
+	if (file.raw.isOpen()) {
+		IO::Block	*block = dynamic_cast<IO::Block *> (Settings::Manager::getInstance()->getObject(data.id));
+		if (!block)
+			return;
+
+		QString parameter_name = QString::number(block->getID()) + " "
+			+ QString::fromStdString(block->getName()) + " : "
+			+ QString::fromStdString(block->getName(Workspace::PARAMETER, data.index));
+		RawCapture::param_record_t record = { param.index, param.value, };
+		appendRecord(file.params, RawCapture::PARAM, RT::OS::getTime(), &record, sizeof(record), parameter_name.toLatin1().constData());
+		return;
+	}
+
+	// Tables stay open for the trial, changes are appended in batches
+	std::map<param_key_t, param_table_t>::iterator i = paramTables.find(param_key_t(data.id, data.index));
+	if (i == paramTables.end())
+		return;
+
+	if (!batchPending())
+		batchTime = RT::OS::getTime();
+	i->second.pending.push_back(param);
+	if (++paramRows >= WRITER_EVENT_ROWS)
+		flushBatch();
+}
+
+int DataRecorder::Panel::openFile(const QString &filename, bool append)
+{
+#ifdef DEBUG
+	if(!WriterPool::getInstance()->isServicing(this))
+	{
+		ERROR_MSG("DataRecorder::Panel::openFile : called by invalid thread\n");
+		PRINT_BACKTRACE();
+	}
+#endif
+
+	// Files ending in .raw get the raw capture format
+	long long trials = 0;
+	file.name = filename;
+	file.swmr = swmr && !filename.toLower().endsWith(".raw");
+	file.swmrActive = false;
+	if (filename.toLower().endsWith(".raw")) {
+		if (openRawFile(filename, append))
+			return -1;
+		trials = file.trials;
+	} else if (append) {
+		hid_t fapl = fileAccess(file.swmr);
+		file.id = H5Fopen(filename.toLatin1().constData(), H5F_ACC_RDWR, fapl);
+		H5Pclose(fapl);
+		size_t trial_num;
+		QString trial_name;
+		H5Eset_auto(H5E_DEFAULT, NULL, NULL);
+		for (trial_num = 1;; ++trial_num) {
+			trial_name = "/Trial" + QString::number(trial_num);
+			file.trial = H5Gopen(file.id, trial_name.toLatin1().constData(), H5P_DEFAULT);
+			if (file.trial < 0) {
+				H5Eclear(H5E_DEFAULT);
+				break;
+			} else
+				H5Gclose(file.trial);
+		}
+		trialNum->setNum(int(trial_num)-1);
+		trials = trial_num - 1;
+	} else {
+		hid_t fapl = fileAccess(file.swmr);
+		file.id = H5Fcreate(filename.toLatin1().constData(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+		H5Pclose(fapl);
+		trialNum->setText("0");
+	}
+	if (!file.raw.isOpen() && file.id < 0) {
+		H5E_type_t error_type;
+		size_t error_size;
+		error_size = H5Eget_msg(file.id, &error_type, NULL, 0);
+		char error_msg[error_size + 1];
+		H5Eget_msg(file.id, &error_type, error_msg, error_size);
+		error_msg[error_size] = 0;
+		H5Eclear(file.id);
+
+		ERROR_MSG("DataRecorder::Panel::processData : failed to open \"%s\" for writing with error : %s\n", filename.toStdString().c_str(),error_msg);
+		return -1;
+	}
+	openSegments(filename, trials);
+
+	CustomEvent *event = new CustomEvent(static_cast<QEvent::Type>QSetFileNameEditEvent);
+	SetFileNameEditEventData *data = new SetFileNameEditEventData;
+	data->filename = filename;
+	event->setData(static_cast<void*>(data));
+	QApplication::postEvent(this, event);
+
+	return 0;
+}
+
+// Open a raw capture, new trials go after the ones already in the file
+int DataRecorder::Panel::openRawFile(const QString &filename, bool append)
+{
+	file.start = 0;
+	file.trials = 0;
+
+	int fd = append ? open(filename.toLatin1().constData(), O_RDONLY) : -1;
+	if (fd >= 0) {
+		off_t size = lseek(fd, 0, SEEK_END);
+		RawCapture::trial_header_t header;
+		while (file.start < size && !RawCapture::readTrial(fd, file.start, size, header)) {
+			file.start += header.trialSize;
+			++file.trials;
+		}
+		if (file.start < size) {
+			ERROR_MSG("DataRecorder::Panel::openRawFile : \"%s\" ends with unknown data, appending after it\n", filename.toStdString().c_str());
+			file.start = size;
+		}
+		file.start = RawCapture::align(file.start);
+		close(fd);
+	}
+
+	// Trials bypass the page cache, see DirectWriter
+	if (file.raw.open(filename.toStdString(), file.start, !append)) {
+		ERROR_MSG("DataRecorder::Panel::openRawFile : failed to open \"%s\" for writing\n", filename.toStdString().c_str());
+		return -1;
+	}
+
+	trialNum->setNum(file.trials);
+	return 0;
+}
+
+void DataRecorder::Panel::closeFile(bool shutdown)
+{
+#ifdef DEBUG
+	if(!WriterPool::getInstance()->isServicing(this))
 	{
 		ERROR_MSG("DataRecorder::Panel::closeFile : called by invalid thread\n");
 		PRINT_BACKTRACE();
 	}
 #endif
 
-	H5Fclose(file.id);
+	if (file.raw.isOpen())
+		file.raw.close();
+	else
+		H5Fclose(file.id);
+	file.swmrActive = false;
+	closeSegments();
 	if (!shutdown) {
 		CustomEvent *event = new CustomEvent(static_cast<QEvent::Type>QSetFileNameEditEvent);
-		SetFileNameEditEventData data;
-		data.filename = "";
-		event->setData(static_cast<void*>(&data));
-
+		SetFileNameEditEventData *data = new SetFileNameEditEventData;
+		event->setData(static_cast<void*>(data));
 		QApplication::postEvent(this, event);
-		data.done.wait(&mutex);
 	}
 }
 
 int DataRecorder::Panel::startRecording(long long timestamp)
 {
 #ifdef DEBUG
-	if(!pthread_equal(pthread_self(),thread)) {
+	if(!WriterPool::getInstance()->isServicing(this)) {
 		ERROR_MSG("DataRecorder::Panel::startRecording : called by invalid thread\n");
 		PRINT_BACKTRACE();
 	}
 #endif
 
+	trialTicks = 0;
+	if (!segmentTrials++)
+		segmentStart = timestamp;
+
+	setupDecimation();
+	setupStorage();
+	if (file.raw.isOpen()) {
+		startRawTrial(timestamp);
+		resetBatch();
+		return 0;
+	}
+
+	// Nothing can be created in a file written in SWMR mode, it is reopened
+	// for the new trial. Readers still attached must not keep it locked
+	if (file.swmrActive)
+	{
+		H5Fclose(file.id);
+		file.swmrActive = false;
+		hid_t fapl = fileAccess(true);
+#if H5_VERSION_GE(1,12,1) || (H5_VERSION_GE(1,10,7) && !H5_VERSION_GE(1,11,0))
+		H5Pset_file_locking(fapl, false, true);
+#endif
+		file.id = H5Fopen(file.name.toLatin1().constData(), H5F_ACC_RDWR, fapl);
+		H5Pclose(fapl);
+		if (file.id < 0) {
+			ERROR_MSG("DataRecorder::Panel::startRecording : failed to reopen \"%s\" for the next trial\n", file.name.toStdString().c_str());
+			return -1;
+		}
+	}
+
 	size_t trial_num;
 	QString trial_name;
 
@@ -1342,6 +2789,21 @@ int DataRecorder::Panel::startRecording(long long timestamp)
 	file.pdata = H5Gcreate(file.trial, "Parameters", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
 	file.adata = H5Gcreate(file.trial, "Asynchronous Data", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
 	file.sdata = H5Gcreate(file.trial, "Synchronous Data", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	file.timestamp = timestamp;
+
+	// One dataset per event would need objects created during the trial
+	asyncOffset = 0;
+	if (asyncLayout == ASYNC_TABLE || file.swmr)
+	{
+		hid_t index_type = H5Tcreate(H5T_COMPOUND, sizeof(async_index_t));
+		H5Tinsert(index_type, "time", HOFFSET(async_index_t,time), H5T_STD_I64LE);
+		H5Tinsert(index_type, "tick", HOFFSET(async_index_t,tick), H5T_STD_I64LE);
+		H5Tinsert(index_type, "offset", HOFFSET(async_index_t,offset), H5T_STD_U64LE);
+		H5Tinsert(index_type, "length", HOFFSET(async_index_t,length), H5T_STD_U64LE);
+		asyncSamples = createTable(file.adata, "Samples", H5T_IEEE_F64LE, ASYNC_CHUNK_SAMPLES);
+		asyncIndex = createTable(file.adata, "Index", index_type, ASYNC_CHUNK_ENTRIES);
+		H5Tclose(index_type);
+	}
 
 	hid_t scalar_space = H5Screate(H5S_SCALAR);
 	hid_t string_type = H5Tcopy(H5T_C_S1);
@@ -1366,6 +2828,12 @@ int DataRecorder::Panel::startRecording(long long timestamp)
 	H5Dwrite(data, H5T_STD_U64LE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &timestamp);
 	H5Dclose(data);
 
+	if (file.swmr)
+	{
+		writeScalar(file.trial, "Timestamp Stop (ns)", 0);
+		writeScalar(file.trial, "Trial Length (ns)", 0);
+	}
+
 	data = H5Dcreate(file.trial, "Date", string_type,
 			scalar_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
 	std::string nowDateTime = std::string(QDateTime::currentDateTime().toString(Qt::ISODate).toLatin1());
@@ -1382,12 +2850,16 @@ int DataRecorder::Panel::startRecording(long long timestamp)
 		IO::Block *block = i->block;
 		for (size_t j = 0; j < block->getCount(Workspace::PARAMETER); ++j)
 		{
+			param_key_t key(block->getID(), j);
+			if (paramTables.count(key))
+				continue;
+
 			QString parameter_name = QString::number(block->getID()) + " "
 				+ QString::fromStdString(block->getName()) + " : " + QString::fromStdString(block->getName(Workspace::PARAMETER, j));
 			data = H5PTcreate_fl(file.pdata, parameter_name.toLatin1().constData(),	param_type, sizeof(param_hdf_t), -1);
 			struct param_hdf_t value = { 0, block->getValue(Workspace::PARAMETER, j),};
 			H5PTappend(data, 1, &value);
-			H5PTclose(data);
+			paramTables[key].table = data;
 		}
 		for (size_t j = 0; j < block->getCount(Workspace::COMMENT); ++j)
 		{
@@ -1403,55 +2875,337 @@ int DataRecorder::Panel::startRecording(long long timestamp)
 
 	H5Tclose(param_type);
 
+	// Only the channels in Channel Data are numbered, in column order
 	size_t count = 0;
-	for (RT::List<Channel>::iterator i = channels.begin(), end = channels.end(); i != end; ++i)
+	size_t n = 0;
+	for (RT::List<Channel>::iterator i = channels.begin(), end = channels.end(); i != end; ++i, ++n)
 	{
+		if (count == columns.size() || columns[count] != n)
+			continue;
 		std::string rec_chan_name = std::to_string(++count) + ": " + i->name.toStdString();
 		hid_t data = H5Dcreate(file.sdata, rec_chan_name.c_str(), string_type, scalar_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
 		H5Dwrite(data, string_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, rec_chan_name.c_str());
 		H5Dclose(data);
 	}
 
+	// Columns are numbered like the channel names
+	if (batchWidth && channelLayout == LAYOUT_COLUMNS)
+	{
+		hid_t cols = H5Gcreate(file.sdata, "Channel Columns", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+		for (size_t i = 0; i < batchWidth; ++i)
+		{
+			std::string column_name = std::to_string(i + 1);
+			hid_t column_type = SampleStorage::columnType(columnLayouts[i].columns[0].type);
+			columnTables.push_back(createSampleTable(cols, column_name.c_str(), column_type, downsample_rate));
+			H5Tclose(column_type);
+			SampleStorage::writeAttributes(cols, column_name.c_str(), columnLayouts[i]);
+		}
+		H5Gclose(cols);
+	}
+	else if (batchWidth)
+	{
+		hid_t row_type = SampleStorage::rowType(rowLayout);
+		file.cdata = createSampleTable(file.sdata, "Channel Data", row_type, downsample_rate);
+		H5Tclose(row_type);
+		SampleStorage::writeAttributes(file.sdata, "Channel Data", rowLayout);
+	}
+
+	// Each group of channels at their own rate is laid out like Synchronous
+	// Data, with its rate, its numbered channel names and its Channel Data
+	if (groups.size())
+	{
+		hid_t ddata = H5Gcreate(file.sdata, "Decimated Data", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+		for (std::vector<group_t>::iterator g = groups.begin(), end = groups.end(); g != end; ++g)
+		{
+			std::string group_name = "Rate " + std::to_string(g->rate);
+			hid_t gdata = H5Gcreate(ddata, group_name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+			writeScalar(gdata, "Downsampling Rate", g->rate);
+
+			for (size_t k = 0; k < g->channels.size(); ++k)
+			{
+				RT::List<Channel>::iterator i = channels.begin();
+				for (size_t m = 0; m < g->channels[k]; ++m)
+					++i;
+				std::string rec_chan_name = std::to_string(k + 1) + ": " + i->name.toStdString();
+				hid_t data = H5Dcreate(gdata, rec_chan_name.c_str(), string_type, scalar_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+				H5Dwrite(data, string_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, rec_chan_name.c_str());
+				H5Dclose(data);
+			}
+
+			hid_t row_type = SampleStorage::rowType(g->layout);
+			g->table = createSampleTable(gdata, "Channel Data", row_type, g->rate);
+			H5Tclose(row_type);
+			SampleStorage::writeAttributes(gdata, "Channel Data", g->layout);
+			H5Gclose(gdata);
+		}
+		H5Gclose(ddata);
+	}
+
 	H5Tclose(string_type);
 	H5Sclose(scalar_space);
 
-	if (channels.size())
+	// Readers rebuild the tick times from the period, the jitter and the
+	// exceptions
+	stampCount = 0;
+	stampPeriod = period;
+	if (stampTicks)
 	{
-		hsize_t array_size[] = { channels.size() };
-		hid_t array_type = H5Tarray_create(H5T_IEEE_F64LE, 1, array_size);
-		file.cdata = H5PTcreate_fl(file.sdata, "Channel Data", array_type, (hsize_t) 64, 1);
-		H5Tclose(array_type);
+		hid_t tdata = H5Gcreate(file.sdata, "Timestamps", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+		hid_t exception_type = H5Tcreate(H5T_COMPOUND, sizeof(stamp_exception_t));
+		H5Tinsert(exception_type, "tick", HOFFSET(stamp_exception_t,tick), H5T_STD_I64LE);
+		H5Tinsert(exception_type, "time", HOFFSET(stamp_exception_t,time), H5T_STD_I64LE);
+		stampJitter = createTable(tdata, "Jitter (ns)", H5T_STD_I16LE, static_cast<hsize_t>(STAMP_CHUNK_TICKS));
+		stampExceptionTable = createTable(tdata, "Exceptions", exception_type, static_cast<hsize_t>(STAMP_CHUNK_EXCEPTIONS));
+		H5Tclose(exception_type);
+		H5Gclose(tdata);
 	}
 
-	file.idx = 0;
+	// From here on the trial only grows, SWMR readers can follow it
+	if (file.swmr)
+	{
+#if H5_VERSION_GE(1,10,0)
+		if (H5Fstart_swmr_write(file.id) >= 0)
+		{
+			file.swmrActive = true;
+			swmrFlush = RT::OS::getTime();
+		}
+		else
+#endif
+		{
+			ERROR_MSG("DataRecorder::Panel::startRecording : \"%s\" is written without SWMR, it was not created for it\n",
+					file.name.toStdString().c_str());
+			file.swmr = false;
+		}
+	}
+
+	resetBatch();
 
 	return 0;
 }
 
+// Create a packet table of rows of type, recorded at 1/rate of the real-time
+// rate, with the chunk size and filters picked in the panel
+hid_t DataRecorder::Panel::createSampleTable(hid_t group, const char *name, hid_t type, size_t rate)
+{
+	// Pick a chunk that holds about CHUNK_TARGET_BYTES, but no more than
+	// one second of samples, so slow recordings still get flushed chunks
+	hsize_t chunk = chunkSize;
+	if (!chunk)
+	{
+		long long samples = 1000000000ll / (RT::System::getInstance()->getPeriod() * rate);
+		chunk = chunkRows(H5Tget_size(type), samples);
+	}
+
+	return createTable(group, name, type, chunk);
+}
+
+// Create a packet table with the panel's filters
+hid_t DataRecorder::Panel::createTable(hid_t group, const char *name, hid_t type, hsize_t chunk)
+{
+	// Filters run inside H5PTappend, on this thread
+	hid_t table;
+#if H5_VERSION_GE(1,10,0)
+	hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+	if (compression == COMPRESSION_SHUFFLE_DEFLATE)
+		H5Pset_shuffle(plist);
+	if (compression != COMPRESSION_NONE)
+		H5Pset_deflate(plist, DEFLATE_LEVEL);
+	table = H5PTcreate(group, name, type, chunk, plist);
+	H5Pclose(plist);
+#else
+	table = H5PTcreate_fl(group, name, type, chunk, compression == COMPRESSION_NONE ? -1 : DEFLATE_LEVEL);
+#endif
+
+	return table;
+}
+
+// Size the batch for this trial's Channel Data columns
+void DataRecorder::Panel::resetBatch(void)
+{
+	batchLimit = std::max(DataRecorder::batchLimit(batchWidth), packRows); // a packed token always fits
+	batch.resize(std::max(static_cast<size_t>(1), batchLimit * batchWidth));
+	batchRows = 0;
+	for (std::vector<group_t>::iterator g = groups.begin(), end = groups.end(); g != end; ++g)
+	{
+		g->limit = DataRecorder::batchLimit(g->channels.size());
+		g->data.resize(g->limit * g->channels.size());
+		g->rows = 0;
+	}
+	groupRows = 0;
+	paramRows = 0;
+	writeTime = 0;
+	writeBytes = 0;
+	storedBytes = 0;
+
+	file.idx = 0;
+}
+
+// Write the header of a raw capture trial, the frames follow it directly
+void DataRecorder::Panel::startRawTrial(long long timestamp)
+{
+	RawCapture::trial_header_t &header = file.header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RAW_CAPTURE_MAGIC, sizeof(RAW_CAPTURE_MAGIC));
+	header.version = RAW_CAPTURE_VERSION;
+	header.channelCount = channels.size();
+	header.headerSize = RawCapture::headerSize(header.channelCount);
+	header.frameSize = header.channelCount * sizeof(double);
+	header.period = RT::System::getInstance()->getPeriod();
+	header.downsample = downsample_rate;
+	header.startTime = timestamp;
+	strncpy(header.date, QDateTime::currentDateTime().toString(Qt::ISODate).toLatin1().constData(), sizeof(header.date) - 1);
+
+	// Parameters and comments at the start of the trial, the HDF5
+	// layout keeps them in the Parameters group
+	file.async.clear();
+	file.params.clear();
+	for (RT::List<Channel>::iterator i = channels.begin(), end = channels.end(); i != end; ++i)
+	{
+		IO::Block *block = i->block;
+		for (size_t j = 0; j < block->getCount(Workspace::PARAMETER); ++j)
+		{
+			QString parameter_name = QString::number(block->getID()) + " "
+				+ QString::fromStdString(block->getName()) + " : " + QString::fromStdString(block->getName(Workspace::PARAMETER, j));
+			RawCapture::param_record_t record = { 0, block->getValue(Workspace::PARAMETER, j), };
+			appendRecord(file.params, RawCapture::PARAM, timestamp, &record, sizeof(record), parameter_name.toLatin1().constData());
+		}
+		for (size_t j = 0; j < block->getCount(Workspace::COMMENT); ++j)
+		{
+			QString comment_name = QString::number(block->getID()) + " "
+				+ QString::fromStdString(block->getName()) + " : " + QString::fromStdString(block->getName(Workspace::COMMENT, j));
+			appendRecord(file.params, RawCapture::COMMENT, timestamp, 0, 0, comment_name.toLatin1().constData(),
+					dynamic_cast<Workspace::Instance *> (block)->getValueString(Workspace::COMMENT, j).c_str());
+		}
+	}
+
+	// The header block is kept, it is written again when the trial stops
+	std::vector<char> &buffer = file.headerBlock;
+	buffer.assign(header.headerSize, 0);
+	memcpy(&buffer[0], &header, sizeof(header));
+	RawCapture::channel_t *names = reinterpret_cast<RawCapture::channel_t *> (&buffer[sizeof(header)]);
+	for (RT::List<Channel>::iterator i = channels.begin(), end = channels.end(); i != end; ++i, ++names)
+		strncpy(names->name, i->name.toLatin1().constData(), sizeof(names->name) - 1);
+
+	file.raw.setSyncInterval(syncInterval * 1000000000ll);
+	file.raw.write(&buffer[0], buffer.size());
+	trialNum->setNum(++file.trials);
+}
+
+// Write the sections after the frames, then complete the header
+void DataRecorder::Panel::stopRawTrial(long long timestamp)
+{
+	RawCapture::trial_header_t &header = file.header;
+	header.stopTime = timestamp;
+	header.trialLength = RT::System::getInstance()->getPeriod() * fixedcount;
+	header.frameCount = header.channelCount ? file.idx : 0;
+	header.asyncOffset = header.headerSize + header.frameCount * header.frameSize;
+	header.asyncSize = file.async.size();
+	header.paramOffset = header.asyncOffset + header.asyncSize;
+	header.paramSize = file.params.size();
+	header.trialSize = RawCapture::align(header.paramOffset + header.paramSize);
+
+	if (header.asyncSize)
+		file.raw.write(&file.async[0], header.asyncSize);
+	if (header.paramSize)
+		file.raw.write(&file.params[0], header.paramSize);
+	file.raw.pad(RAW_CAPTURE_ALIGN);
+
+	// Rewrite the whole header block, O_DIRECT only writes aligned blocks
+	memcpy(&file.headerBlock[0], &header, sizeof(header));
+	file.raw.writeAt(file.start, &file.headerBlock[0], header.headerSize);
+
+	file.start += header.trialSize;
+	file.async.clear();
+	file.params.clear();
+	storedBytes = writeBytes;
+
+	if (file.raw.sync())
+		ERROR_MSG("DataRecorder::Panel::stopRawTrial : failed to write the trial to disk\n");
+}
+
+// Append a record and its payload to a raw capture section
+void DataRecorder::Panel::appendRecord(std::vector<char> &section, RawCapture::record_type_t type, long long time,
+		const void *data, size_t size, const char *name, const char *text)
+{
+	size_t nameSize = name ? strlen(name) + 1 : 0;
+	size_t textSize = text ? strlen(text) + 1 : 0;
+	RawCapture::record_t record = { static_cast<uint32_t> (type), static_cast<uint32_t> (size + nameSize + textSize), time, };
+
+	const char *r = reinterpret_cast<const char *> (&record);
+	section.insert(section.end(), r, r + sizeof(record));
+	if (size)
+		section.insert(section.end(), reinterpret_cast<const char *> (data), reinterpret_cast<const char *> (data) + size);
+	section.insert(section.end(), name, name + nameSize);
+	section.insert(section.end(), text, text + textSize);
+}
+
 void DataRecorder::Panel::stopRecording(long long timestamp, bool shutdown)
 {
 #ifdef DEBUG
-	if(!pthread_equal(pthread_self(),thread)) {
+	if(!WriterPool::getInstance()->isServicing(this)) {
 		ERROR_MSG("DataRecorder::Panel::stopRecording : called by invalid thread\n");
 		PRINT_BACKTRACE();
 	}
 #endif
 
-	fixedcount = count;
-	hid_t scalar_space = H5Screate(H5S_SCALAR);
-	hid_t data = H5Dcreate(file.trial, "Timestamp Stop (ns)", H5T_STD_U64LE,
-			scalar_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-	H5Dwrite(data, H5T_STD_U64LE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &timestamp);
-	H5Dclose(data);
+	finishDecimation();
+	flushBatch();
+
+	fixedcount = trialTicks;
+	if (file.raw.isOpen()) {
+		stopRawTrial(timestamp);
+		return;
+	}
 
+	for (size_t i = 0; i < columnTables.size(); ++i)
+	{
+		std::string name = "Channel Columns/" + std::to_string(i + 1);
+		hid_t data = H5Dopen(file.sdata, name.c_str(), H5P_DEFAULT);
+		storedBytes += H5Dget_storage_size(data);
+		H5Dclose(data);
+		H5PTclose(columnTables[i]);
+	}
+	if (columnTables.size())
+		columnTables.clear();
+	else if (batchWidth)
+	{
+		hid_t cdata = H5Dopen(file.sdata, "Channel Data", H5P_DEFAULT);
+		storedBytes = H5Dget_storage_size(cdata);
+		H5Dclose(cdata);
+		H5PTclose(file.cdata);
+	}
+	for (std::vector<group_t>::iterator g = groups.begin(), end = groups.end(); g != end; ++g)
+	{
+		std::string name = "Decimated Data/Rate " + std::to_string(g->rate) + "/Channel Data";
+		hid_t data = H5Dopen(file.sdata, name.c_str(), H5P_DEFAULT);
+		storedBytes += H5Dget_storage_size(data);
+		H5Dclose(data);
+		H5PTclose(g->table);
+	}
+	groups.clear();
+	for (std::map<param_key_t, param_table_t>::iterator i = paramTables.begin(), end = paramTables.end(); i != end; ++i)
+		H5PTclose(i->second.table);
+	paramTables.clear();
+	if (stampJitter >= 0)
+	{
+		H5PTclose(stampJitter);
+		H5PTclose(stampExceptionTable);
+		stampJitter = stampExceptionTable = -1;
+	}
+	if (asyncIndex >= 0)
+	{
+		H5PTclose(asyncSamples);
+		H5PTclose(asyncIndex);
+		asyncSamples = asyncIndex = -1;
+	}
+
+	// Followers stop once the stop timestamp is set, so every row is
+	// flushed before it and the length, and the stamp is flushed last
+	H5Fflush(file.id, H5F_SCOPE_LOCAL);
 	long long period = RT::System::getInstance()->getPeriod();
-	long long datalength = period * fixedcount;
-	data = H5Dcreate(file.trial, "Trial Length (ns)", H5T_STD_U64LE,
-			scalar_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-	H5Dwrite(data, H5T_STD_U64LE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &datalength);
-	H5Dclose(data);
-	H5Sclose(scalar_space);
-	H5PTclose(file.cdata);
+	writeScalar(file.trial, "Trial Length (ns)", period * fixedcount);
+	writeScalar(file.trial, "Timestamp Stop (ns)", timestamp);
+
 	H5Gclose(file.sdata);
 	H5Gclose(file.pdata);
 	H5Gclose(file.adata);
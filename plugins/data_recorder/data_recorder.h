@@ -20,11 +20,21 @@
 #define DATA_RECORDER_H
 
 #include <atomic_fifo.h>
+#include <decimator.h>
+#include <direct_writer.h>
+#include <mpsc_fifo.h>
 #include <event.h>
 #include <io.h>
 #include <mutex.h>
 #include <plugin.h>
+#include <raw_capture.h>
+#include <rt_arena.h>
+#include <sample_storage.h>
 #include <workspace.h>
+#include <writer_pool.h>
+#include <atomic>
+#include <map>
+#include <string>
 #include <vector>
 #include <time.h>
 
@@ -46,6 +56,7 @@ namespace DataRecorder
 		ASYNC,
 		DONE,
 		PARAM,
+		TRIGGER,
 	};
 
 	struct data_token_t {
@@ -54,6 +65,74 @@ namespace DataRecorder
 		long long time;
 	};
 
+	// Asynchronous data and parameter changes, marks is the number of
+	// tokens other than SYNC queued before them
+	struct event_token_t {
+		data_token_t token;
+		unsigned long long marks;
+	};
+
+	enum compression_t {
+		COMPRESSION_NONE,
+		COMPRESSION_DEFLATE,
+		COMPRESSION_SHUFFLE_DEFLATE,
+	};
+
+	enum trigger_source_t {
+		TRIGGER_OFF,
+		TRIGGER_EVENT,
+		TRIGGER_THRESHOLD,
+		TRIGGER_DIO,
+	};
+
+	enum trigger_edge_t {
+		EDGE_RISING,
+		EDGE_FALLING,
+		EDGE_BOTH,
+	};
+
+	enum rotate_mode_t {
+		ROTATE_OFF,
+		ROTATE_SIZE,
+		ROTATE_DURATION,
+		ROTATE_TRIALS,
+	};
+
+	enum channel_layout_t {
+		LAYOUT_ROWS,
+		LAYOUT_COLUMNS,
+	};
+
+	enum async_layout_t {
+		ASYNC_TABLE,
+		ASYNC_DATASETS,
+	};
+
+	// Where the writer is between the tokens of the realtime thread
+	enum writer_state_t {
+		CLOSED,
+		OPENED,
+		RECORD,
+		ARMED,
+	};
+
+	struct async_index_t {
+		long long time;
+		long long tick;
+		unsigned long long offset;
+		unsigned long long length;
+	};
+
+	struct stamp_exception_t {
+		long long tick;
+		long long time;
+	};
+
+	struct param_hdf_t {
+		long long index;
+		double value;
+	};
+
 	struct param_change_t {
 		Settings::Object::ID id;
 		size_t index;
@@ -64,7 +143,13 @@ namespace DataRecorder
 	void startRecording(void);
 	void stopRecording(void);
 	void openFile(const QString &);
-	void postAsyncData(const double *,size_t);
+	/*!
+	 * Record a block of samples in every open Data Recorder.
+	 *
+	 * \return False if a recorder had no room for it, either because its
+	 *   event ring was full or the block is larger than one of its slots.
+	 */
+	bool postAsyncData(const double *,size_t);
 
 	class CustomEvent : public QEvent
 	{
@@ -90,9 +175,13 @@ namespace DataRecorder
 		IO::Block *block;
 		IO::flags_t type;
 		size_t index;
+		size_t decimation; // 0 follows the panel's downsample rate
+		int storage; // SampleStorage::type_t
+		double minimum, maximum; // range of INT16 storage
 	}; // class Channel
 
-	class Panel : public QWidget, virtual public Settings::Object, public Event::Handler, public Event::RTHandler, public RT::Thread
+	class Panel : public QWidget, virtual public Settings::Object, public Event::Handler, public Event::RTHandler, public RT::Thread,
+		public WriterPool::Client
 	{
 		Q_OBJECT
 
@@ -103,11 +192,27 @@ namespace DataRecorder
 			void execute(void);
 			void receiveEvent(const Event::Object *);
 			void receiveEventRT(const Event::Object *);
+			void startRecordingRT(void);
+			void stopRecordingRT(void);
+			void queueToken(const data_token_t &,const void * =0);
+			bool queueEvent(const data_token_t &,const void *);
 
 			public slots:
 				void startRecordClicked(void);
 			void stopRecordClicked(void);
 			void updateDownsampleRate(int);
+			void updateChunkSize(int);
+			void updateCompression(int);
+			void updateSyncInterval(int);
+			void updatePackTicks(int);
+			void updateAsyncLayout(int);
+			void updateChannelLayout(int);
+			void updateTrigger(void);
+			void updateRotation(void);
+			void updateSwmr(bool);
+			void updateTimestamps(bool);
+			void updatePriority(int);
+			void updateSampleType(int);
 
 			private slots:
 				void buildChannelList(void);
@@ -123,40 +228,243 @@ namespace DataRecorder
 			virtual void doSave(Settings::Object::State &) const;
 
 		private:
-			static void *bounce(void *);
-			void processData(void);
-			int openFile(QString &);
+			AtomicFifo &getFifo(void) { return fifo; };
+			void nameFifos(void);
+			bool service(size_t,bool);
+			void processEvents(bool);
+			void flushBatch(void);
+			void flushGroup(size_t);
+			void commitRows(size_t);
+			void setupDecimation(void);
+			void setupStorage(void);
+			void decimateRow(const double *);
+			void finishDecimation(void);
+			void stampTick(const double *);
+			size_t tickWidth(void) const { return channels.size() + (stampTicks ? 1 : 0); };
+			hid_t createSampleTable(hid_t,const char *,hid_t,size_t);
+			hid_t createTable(hid_t,const char *,hid_t,hsize_t);
+			bool batchPending(void) const;
+			void writeAsyncData(const data_token_t &, const double *);
+			void writeParameterChange(const param_change_t &);
+			int openFile(const QString &,bool);
+			int openRawFile(const QString &,bool);
 			void closeFile(bool =false);
 			int startRecording(long long);
+			void startRawTrial(long long);
 			void stopRecording(long long,bool =false);
+			void stopRawTrial(long long);
+			void resetBatch(void);
+			void appendRecord(std::vector<char> &,RawCapture::record_type_t,long long,const void *,size_t,const char * =0,const char * =0);
+			bool reserveFrame(size_t,size_t);
+			void commitFrame(void);
+			bool detectTrigger(const double *);
+			void armTrigger(void);
+			void holdTicks(const double *,size_t);
+			void writeTicks(const double *,size_t);
+			void handleTrigger(long long);
+			void stopTriggeredTrial(void);
+			void openSegments(const QString &,long long);
+			void closeSegments(void);
+			void preopenSegment(void);
+			bool rotationDue(long long,bool) const;
+			void rotateFile(long long,bool);
+			void appendManifest(const QString &,long long,bool);
+			QString segmentName(int) const;
 			double prev_input;
-			size_t counter;
 			size_t downsample_rate;
 			long long count;
 			long long fixedcount;
 
 			QMutex mutex;
 
-			pthread_t thread;
 			AtomicFifo fifo;
+			MpscFifo eventFifo;
+			std::vector<char> eventBuffer;
+
+			// Events are handled once every token queued before them is, so
+			// they land in the trial they were posted in. eventNext of the
+			// eventCount events read into eventBuffer is handled next
+			unsigned long long marksQueued;
+			unsigned long long marksHandled;
+			std::vector<size_t> eventSizes;
+			size_t eventNext;
+			size_t eventCount;
+
+			// Staging block for packTicks samples of every channel, used in
+			// execute(). It is queued as one token once packRows ticks are in.
+			// The GUI thread swaps in a larger frame while execute() runs
+			RT::Arena arena;
+			std::atomic<double *> frame;
+			size_t frameCapacity;
+			size_t packTicks;
+			size_t packRows;
+			size_t packed;
 			data_token_t _token;
 			bool tokenRetrieved;
-			struct timespec sleep;
+			int writerState;
+			int writerPriority;
+
+			// Triggered recording. While armed the realtime thread queues every
+			// tick and follows the tick that triggers with a TRIGGER token. The
+			// writer holds the ticks it has not written in ring, up to the
+			// pre-trigger window, and writes a trial from the pre-trigger window
+			// to the end of the post-trigger window. A trigger before the held
+			// ticks fill the ring again extends the trial
+			int triggerSource;
+			int triggerEdge;
+			size_t triggerChannel;
+			double triggerLevel;
+			double triggerPrev;
+			std::string triggerEvent;
+			std::atomic<bool> triggerPending;
+			int preTime, postTime; // ms
+			std::vector<double> ring;
+			size_t ringStart, ringCount, ringCapacity;
+			long long postTicks;
+			long long trialTicks;
+			long long trialStart;
+			bool triggerTrial;
+
+			// Channel Data rows staged by the writer thread for one H5PTappend
+			std::vector<double> batch;
+			size_t batchWidth;
+			size_t batchLimit;
+			size_t batchRows;
+			long long batchTime;
+
+			// In the columnar layout every Channel Data column is appended to
+			// its own table, so one channel can be read without the others
+			int channelLayout;
+			std::vector<hid_t> columnTables;
+
+			// Anti-aliased decimation on the writer thread, one decimator per
+			// channel. Channels at the panel rate fill the Channel Data columns,
+			// the others are grouped by rate, and each group stages rows of its
+			// channels for its own table
+			struct group_t {
+				size_t rate;
+				std::vector<size_t> channels;
+				hid_t table;
+				std::vector<double> data;
+				size_t rows;
+				size_t limit;
+				SampleStorage::layout_t layout;
+			};
+			bool decimate;
+			std::vector<Decimator> decimators;
+			std::vector<double> row;
+			std::vector<size_t> columns;
+			std::vector<group_t> groups;
+			size_t groupRows;
+
+			// Storage of the channels in the HDF5 trial. Staged rows of doubles
+			// are converted into packedRows before they are appended to a table
+			// with narrower columns
+			SampleStorage::layout_t rowLayout;
+			std::vector<SampleStorage::layout_t> columnLayouts;
+			std::vector<char> packedRows;
+
+			// Parameter tables of the HDF5 trial, open until it stops and keyed
+			// by (object ID, parameter index)
+			typedef std::pair<Settings::Object::ID, size_t> param_key_t;
+			struct param_table_t {
+				hid_t table;
+				std::vector<param_hdf_t> pending;
+			};
+			std::map<param_key_t, param_table_t> paramTables;
+			size_t paramRows;
+
+			// Tick timestamps. The realtime thread puts each tick's time after
+			// its channels, as the bits of a long long. The HDF5 trial stores
+			// each tick's jitter against the tick before and the period, and
+			// lists the ticks whose time doesn't fit in the jitter, like the
+			// first one or those after a gap, as exceptions
+			bool stampTicks;
+			hid_t stampJitter;
+			hid_t stampExceptionTable;
+			std::vector<short> jitter;
+			std::vector<stamp_exception_t> stampExceptions;
+			long long stampCount;
+			long long lastStamp;
+			long long stampPeriod;
+
+			// Asynchronous Data of the HDF5 trial. Payloads are appended back to
+			// back to the Samples table and the Index table locates each one
+			int asyncLayout;
+			hid_t asyncSamples;
+			hid_t asyncIndex;
+			std::vector<double> asyncData;
+			std::vector<async_index_t> asyncEntries;
+			unsigned long long asyncOffset;
+
+			// Writer statistics of the current trial, shown once it stops
+			long long writeTime;
+			unsigned long long writeBytes;
+			unsigned long long storedBytes;
+
+			size_t chunkSize;
+			int compression;
+			int syncInterval;
+
+			// HDF5 files readable while writing. Trials are written in SWMR
+			// mode, which only allows appends, and the metadata readers go by
+			// is flushed every SWMR_FLUSH_INTERVAL
+			bool swmr;
+			long long swmrFlush;
+
+			// Rotation into numbered segments of the file. The next segment is
+			// created before the switch, with its space reserved when rotating
+			// by size, and the manifest lists the segments in order
+			int rotateMode;
+			int rotateLimit;
+			bool rotating;
+			QString segmentBase;
+			QString segmentSuffix;
+			int segment;
+			int nextSegment;
+			bool nextReady;
+			hid_t nextId;
+			off_t segmentReserve;
+			off_t nextReserve;
+			int segmentTrials;
+			long long segmentStart;
+			long long segmentSize;
+			long long trialCount;
 
 			struct file_t {
 				hid_t id;
 				hid_t trial;
 				hid_t adata, cdata, pdata, sdata;
 				long long idx;
+				long long timestamp;
+				QString name;
+				bool swmr, swmrActive;
+
+				// Raw capture, raw is closed when recording to HDF5
+				DirectWriter raw;
+				int trials;
+				off_t start;
+				RawCapture::trial_header_t header;
+				std::vector<char> headerBlock;
+				std::vector<char> async, params;
 			} file;
 
 			bool recording;
 
+			// An OPEN for a file that exists waits for the GUI to answer
+			// whether to append to it. The writer pool holds the panel
+			// meanwhile, instead of a worker waiting for the answer
+			QString openName;
+			bool openPending;
+			int openReply;              /*!< guarded by mutex */
+			bool closing;               /*!< guarded by mutex */
+
 			QMdiSubWindow *subWindow;
 
 			QGroupBox *channelGroup;
 			QGroupBox *sampleGroup;
 			QGroupBox *fileGroup;
+			QGroupBox *storageGroup;
 			QGroupBox *buttonGroup;
 			QGroupBox *listGroup;
 
@@ -169,6 +477,32 @@ namespace DataRecorder
 			QPushButton *lButton;
 
 			QSpinBox *downsampleSpin;
+			QSpinBox *rateSpin;
+			QComboBox *sampleTypeList;
+			QDoubleSpinBox *rangeMinSpin;
+			QDoubleSpinBox *rangeMaxSpin;
+			QSpinBox *chunkSpin;
+			QSpinBox *syncSpin;
+			QSpinBox *packSpin;
+			QComboBox *compressionList;
+			QComboBox *asyncList;
+			QComboBox *layoutList;
+			QComboBox *rotateList;
+			QSpinBox *rotateSpin;
+			QCheckBox *swmrCheck;
+			QCheckBox *timestampCheck;
+			QComboBox *priorityList;
+
+			QGroupBox *triggerGroup;
+			QComboBox *triggerSourceList;
+			QComboBox *triggerEdgeList;
+			QComboBox *triggerChannelList;
+			QLineEdit *triggerEventEdit;
+			QDoubleSpinBox *triggerLevelSpin;
+			QSpinBox *preSpin;
+			QSpinBox *postSpin;
+			QLabel *compressionRatio;
+			QLabel *writeBandwidth;
 
 			QLineEdit *fileNameEdit;
 			QLineEdit *fileFormatEdit;
@@ -0,0 +1,128 @@
+/*
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <map>
+#include <mutex.h>
+#include <decimator.h>
+#include <DSP/firideal.h>
+#include <DSP/kaiser.h>
+
+// The lowpass has DECIMATOR_TAPS_PER_FACTOR taps per unit of decimation,
+// about 80 dB of stopband, and its cutoff is this fraction of the new
+// Nyquist frequency
+#define DECIMATOR_TAPS_PER_FACTOR   32
+#define DECIMATOR_MAX_TAPS          16385
+#define DECIMATOR_KAISER_ALPHA      2.5
+#define DECIMATOR_CUTOFF            0.85
+
+// Designs are shared by every channel and panel decimating by the same factor
+static const std::vector<double> &design(size_t factor)
+{
+	static Mutex mutex;
+	static std::map<size_t, std::vector<double> > designs;
+
+	Mutex::Locker lock(&mutex);
+	std::vector<double> &taps = designs[factor];
+	if (!taps.empty())
+		return taps;
+
+	int n = std::min(DECIMATOR_TAPS_PER_FACTOR * factor + 1, static_cast<size_t>(DECIMATOR_MAX_TAPS)) | 1;
+	FirIdealFilter filter(n, DECIMATOR_CUTOFF / factor, 0.0, 0);
+	KaiserWindow window(n, DECIMATOR_KAISER_ALPHA);
+	filter.ApplyWindow(&window);
+
+	// Unity gain at DC
+	double *coeff = filter.GetCoefficients();
+	taps.assign(coeff, coeff + n);
+	double sum = 0.0;
+	for (int i = 0; i < n; ++i)
+		sum += taps[i];
+	for (int i = 0; i < n; ++i)
+		taps[i] /= sum;
+
+	return taps;
+}
+
+DataRecorder::Decimator::Decimator(void) :
+	factor(1), taps(0), position(0), inputs(0), next(0), last(0.0)
+{
+}
+
+void DataRecorder::Decimator::setFactor(size_t f)
+{
+	factor = std::max(f, static_cast<size_t>(1));
+	taps = factor > 1 ? &design(factor) : 0;
+
+	// Twice the filter length, so the newest taps samples are always
+	// contiguous in history
+	history.assign(taps ? 2 * taps->size() : 0, 0.0);
+	position = 0;
+	inputs = 0;
+	next = taps ? (taps->size() - 1) / 2 : 0;
+}
+
+bool DataRecorder::Decimator::push(double x, double &y)
+{
+	if (!taps)
+	{
+		y = x;
+		return true;
+	}
+
+	size_t n = taps->size();
+	if (!inputs)
+		std::fill(history.begin(), history.end(), x);
+	else
+	{
+		position = (position + 1) % n;
+		history[position] = history[position + n] = x;
+	}
+	last = x;
+
+	// The output for input k*factor needs the samples up to the filter delay after it
+	if (inputs++ != next)
+		return false;
+	next += factor;
+
+	const double *h = &(*taps)[0];
+	const double *s = &history[position + 1];
+	double sum = 0.0;
+	for (size_t i = 0; i < n; ++i)
+		sum += h[i] * s[i];
+	y = sum;
+
+	return true;
+}
+
+void DataRecorder::Decimator::finish(std::vector<double> &out)
+{
+	if (taps && inputs)
+	{
+		long long end = inputs;
+		long long delay = (taps->size() - 1) / 2;
+		double y;
+		while (next - delay < end)
+			if (push(last, y))
+				out.push_back(y);
+	}
+
+	inputs = 0;
+	position = 0;
+	next = taps ? (taps->size() - 1) / 2 : 0;
+}
@@ -0,0 +1,71 @@
+/*
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace DataRecorder
+{
+	//! Anti-aliased decimation of a single channel.
+	/*!
+	 * Samples go through a linear phase Kaiser windowed lowpass designed
+	 *   with the DSP library, and only every factor-th output is computed,
+	 *   which is the same amount of work as a polyphase decimator.
+	 *
+	 * Output k lines up with input k*factor, like keeping one sample out
+	 *   of factor would. The filter delay is taken out and the edges of
+	 *   the trial are extended with the first and last sample.
+	 */
+	class Decimator
+	{
+		public:
+			Decimator(void);
+
+			void setFactor(size_t);
+			size_t getFactor(void) const { return factor; };
+
+			/*!
+			 * Feed one input sample.
+			 *
+			 * \param x The sample.
+			 * \param y Set to the next output, if there is one.
+			 * \return True if y was set.
+			 */
+			bool push(double x,double &y);
+
+			/*!
+			 * Append the outputs still held back by the filter delay, and
+			 *   start over.
+			 */
+			void finish(std::vector<double> &out);
+
+		private:
+			size_t factor;
+			const std::vector<double> *taps;
+			std::vector<double> history;
+			size_t position;
+			long long inputs;
+			long long next;
+			double last;
+	}; // class Decimator
+}; // namespace DataRecorder
+
+#endif /* DECIMATOR_H */
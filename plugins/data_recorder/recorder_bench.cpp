@@ -0,0 +1,547 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * Measures how many channels at what rate the Data Recorder keeps up with.
+ *
+ * A synthetic producer on an RT::OS task stages ticks into an AtomicFifo
+ * the way Panel::execute() does, and a writer thread drains it the way a
+ * WriterPool worker drives Panel::service(), a slice of bytes per turn,
+ * batching rows into Channel Data or a raw capture. Each writer mode runs
+ * in turn and the results are printed as JSON.
+ *
+ * The Panel needs Qt and the RT system, so the service loop and the
+ * batching here are a simplified copy of Panel::service() and flushBatch():
+ * the sizes come from writer_limits.h like the Panel's, but events, async
+ * data, decimation and file rotation aren't exercised. Treat the numbers as
+ * an estimate of the Panel's throughput, and keep the two in step when
+ * either changes.
+ *
+ * With --virtual the producer doesn't wait for the period, it stages ticks
+ * as fast as the FIFO takes them, which gives the most the writer can do.
+ */
+
+#include <atomic_fifo.h>
+#include <debug.h>
+#include <direct_writer.h>
+#include <rt.h>
+#include <writer_limits.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <hdf5.h>
+#include <hdf5_hl.h>
+
+enum writer_mode_t {
+	MODE_BATCHED,
+	MODE_COMPRESSED,
+	MODE_RAW,
+	MODE_DIRECT,
+	MODE_COUNT,
+};
+
+static const char *mode_names[MODE_COUNT] = {
+	"batched", "compressed", "raw", "direct",
+};
+
+enum token_type_t {
+	SYNC,
+	STOP,
+};
+
+struct token_t {
+	token_type_t type;
+	size_t size;
+	long long time;
+};
+
+struct options {
+	int channels;
+	double rate;
+	double duration;
+	int pack;
+	size_t buffer;
+	int virtual_time;
+	int keep;
+	bool modes[MODE_COUNT];
+	std::string directory;
+};
+
+struct result_t {
+	int mode;
+	long long ticks;
+	long long tokens;
+	long long dropped;
+	long long bytes;
+	long long elapsed;
+	size_t highWater;
+	std::vector<long long> lag;
+	std::vector<long long> latency;
+	bool direct;
+	int failed;
+};
+
+// A run shared by the producer task and the writer thread
+struct run_t {
+	const struct options *opts;
+	RT::OS::Task task;
+	AtomicFifo *fifo;
+	long long period;
+	long long ticks;
+	long long dropped;
+};
+
+// The writer's side of a run, Channel Data rows are batched like the
+// recorder batches them
+struct writer_t {
+	int mode;
+	hid_t table;
+	DirectWriter raw;
+	size_t width;
+	std::vector<double> batch;
+	size_t batchLimit;
+	size_t batchRows;
+	long long batchTime;
+	std::vector<long long> pending;
+	std::vector<char> data;
+	token_t token;
+	bool tokenRetrieved;
+	struct result_t *result;
+};
+
+int getopts(int,char *[],struct options *);
+int run_mode(const struct options &,int,struct result_t &);
+void print_results(const struct options &,const std::vector<result_t> &);
+
+int main(int argc,char *argv[]) {
+	struct options opts;
+	opts.channels = 8;
+	opts.rate = 10000.0;
+	opts.duration = 10.0;
+	opts.pack = 1;
+	opts.buffer = 10*1048576;
+	opts.virtual_time = 0;
+	opts.keep = 0;
+	std::fill(opts.modes,opts.modes+MODE_COUNT,false);
+	opts.directory = "/tmp";
+
+	getopts(argc,argv,&opts);
+
+	if (RT::OS::initiate()) {
+		fprintf(stderr,"Failed to initialize the realtime backend.\n");
+		return -EPERM;
+	}
+	H5Eset_auto2(H5E_DEFAULT,NULL,NULL);
+
+	std::vector<result_t> results;
+	for (int mode = 0; mode < MODE_COUNT; ++mode)
+		if (opts.modes[mode]) {
+			results.push_back(result_t());
+			run_mode(opts,mode,results.back());
+		}
+
+	print_results(opts,results);
+	RT::OS::shutdown();
+
+	for (size_t i = 0; i < results.size(); ++i)
+		if (results[i].failed)
+			return -EIO;
+	return 0;
+}
+
+int getopts(int argc,char *argv[],struct options *options) {
+	int c;
+	int option_index = 0;
+	struct option long_options[] = {
+		{"buffer", 1, NULL, 'b'},
+		{"channels", 1, NULL, 'c'},
+		{"directory", 1, NULL, 'd'},
+		{"keep", 0, NULL, 'k'},
+		{"modes", 1, NULL, 'm'},
+		{"pack", 1, NULL, 'p'},
+		{"rate", 1, NULL, 'r'},
+		{"time", 1, NULL, 't'},
+		{"virtual", 0, NULL, 'v'},
+		{ 0, 0, 0, 0}
+	};
+
+	while (1) {
+		c = getopt_long(argc,argv,"b:c:d:km:p:r:t:v",long_options,&option_index);
+
+		if (c < 0)
+			break;
+
+		switch (c) {
+			case 'b':
+				options->buffer = strtol(optarg,NULL,10)*1048576;
+				break;
+			case 'c':
+				options->channels = strtol(optarg,NULL,10);
+				break;
+			case 'd':
+				options->directory = optarg;
+				break;
+			case 'k':
+				options->keep = 1;
+				break;
+			case 'm':
+				{
+					std::string list = optarg;
+					size_t start = 0;
+					while (start <= list.size()) {
+						size_t end = std::min(list.find(',',start),list.size());
+						std::string name = list.substr(start,end-start);
+						int mode = 0;
+						for (; mode < MODE_COUNT && name != mode_names[mode]; ++mode) ;
+						if (mode == MODE_COUNT) {
+							fprintf(stderr,"Unknown mode \"%s\", expected batched, compressed, raw or direct.\n",name.c_str());
+							exit(-EINVAL);
+						}
+						options->modes[mode] = true;
+						start = end+1;
+					}
+				}
+				break;
+			case 'p':
+				options->pack = strtol(optarg,NULL,10);
+				break;
+			case 'r':
+				options->rate = strtod(optarg,NULL);
+				break;
+			case 't':
+				options->duration = strtod(optarg,NULL);
+				break;
+			case 'v':
+				options->virtual_time = 1;
+				break;
+			default:
+				fprintf(stderr,"Usage: %s [-c channels] [-r rate (Hz)] [-t seconds] [-p ticks per token] [-b FIFO MB]\n"
+						"\t[-m batched,compressed,raw,direct] [-d directory] [-k] [-v]\n",argv[0]);
+				exit(-EINVAL);
+		};
+	};
+
+	if (options->channels < 1 || options->rate <= 0.0 || options->duration <= 0.0 || options->pack < 1 || !options->buffer) {
+		fprintf(stderr,"Channels, rate, time, pack and buffer must be positive.\n");
+		exit(-EINVAL);
+	}
+	if (std::find(options->modes,options->modes+MODE_COUNT,true) == options->modes+MODE_COUNT)
+		std::fill(options->modes,options->modes+MODE_COUNT,true);
+
+	return 0;
+}
+
+// Stage ticks of sine waves like Panel::execute(), a packed token at a time
+static void *produce(void *arg) {
+	run_t *run = reinterpret_cast<run_t *>(arg);
+	const struct options &opts = *run->opts;
+	size_t width = opts.channels;
+
+	std::vector<char> frame(sizeof(token_t)+opts.pack*width*sizeof(double));
+	token_t *token = reinterpret_cast<token_t *>(&frame[0]);
+	double *ticks = reinterpret_cast<double *>(&frame[sizeof(token_t)]);
+
+	if (!opts.virtual_time)
+		RT::OS::setPeriod(run->task,run->period);
+
+	long long total = static_cast<long long>(opts.duration*opts.rate);
+	size_t packed = 0;
+	for (long long tick = 0; tick < total; ++tick) {
+		if (!opts.virtual_time)
+			RT::OS::sleepTimestep(run->task);
+
+		double t = tick/opts.rate;
+		double *f = ticks+packed*width;
+		for (size_t i = 0; i < width; ++i)
+			f[i] = sin(2.0*M_PI*(i+1)*t)+1e-3*(tick%7);
+
+		if (++packed < static_cast<size_t>(opts.pack) && tick+1 < total)
+			continue;
+
+		token->type = SYNC;
+		token->size = packed*width*sizeof(double);
+		token->time = RT::OS::getTime();
+		size_t size = sizeof(token_t)+token->size;
+
+		// In real time a full FIFO loses the token, like it does in the
+		// recorder, in virtual time the producer waits for the writer
+		if (opts.virtual_time)
+			while (opts.buffer-run->fifo->available() <= size)
+				sched_yield();
+		if (!run->fifo->write(&frame[0],size))
+			++run->dropped;
+		run->ticks += packed;
+		packed = 0;
+	}
+
+	token->type = STOP;
+	token->size = 0;
+	token->time = RT::OS::getTime();
+	while (!run->fifo->write(token,sizeof(token_t)))
+		sched_yield();
+	run->fifo->notify();
+
+	return 0;
+}
+
+static void percentile(std::vector<long long> &v,double p,long long &value) {
+	value = 0;
+	if (v.empty())
+		return;
+	size_t n = std::min(v.size()-1,static_cast<size_t>(p*v.size()));
+	std::nth_element(v.begin(),v.begin()+n,v.end());
+	value = v[n];
+}
+
+// Append the staged rows like Panel::flushBatch(), the lag of a token is
+// how long after it was queued its rows are in the file
+static void flush_batch(writer_t &w) {
+	if (!w.batchRows)
+		return;
+
+	size_t size = w.batchRows*w.width*sizeof(double);
+	long long start = RT::OS::getTime();
+	if (w.mode < MODE_RAW)
+		w.result->failed |= H5PTappend(w.table,w.batchRows,&w.batch[0]) < 0;
+	else
+		w.result->failed |= w.raw.write(&w.batch[0],size) < 0;
+	long long end = RT::OS::getTime();
+
+	w.result->latency.push_back(end-start);
+	for (size_t i = 0; i < w.pending.size(); ++i)
+		w.result->lag.push_back(end-w.pending[i]);
+	w.result->bytes += size;
+	w.pending.clear();
+	w.batchRows = 0;
+}
+
+// Handle about budget bytes of the FIFO like Panel::service(), returns
+// false once the producer stopped and sets idle when the FIFO ran dry
+static bool service(writer_t &w,AtomicFifo &fifo,size_t budget,bool flush,bool &idle) {
+	idle = false;
+	for (size_t handled = 0; handled < budget; handled += sizeof(w.token)+w.token.size) {
+		if (!w.tokenRetrieved) {
+			if (!fifo.read(&w.token,sizeof(w.token))) {
+				// Caught up, give the worker back
+				if (flush)
+					flush_batch(w);
+				idle = true;
+				return true;
+			}
+			w.tokenRetrieved = true;
+		}
+		if (w.token.type == STOP)
+			return false;
+
+		if (!fifo.read(&w.data[0],w.token.size)) {
+			idle = true;
+			return true; // Handled again once the rest is queued
+		}
+		w.tokenRetrieved = false;
+
+		// Like Panel::commitRows(), a full or old batch is appended
+		size_t rows = w.token.size/(w.width*sizeof(double));
+		if (w.batchRows+rows > w.batchLimit)
+			flush_batch(w);
+		if (!w.batchRows)
+			w.batchTime = RT::OS::getTime();
+		memcpy(&w.batch[w.batchRows*w.width],&w.data[0],w.token.size);
+		w.batchRows += rows;
+		w.pending.push_back(w.token.time);
+		++w.result->tokens;
+		if (w.batchRows == w.batchLimit || RT::OS::getTime()-w.batchTime >= WRITER_FLUSH_INTERVAL)
+			flush_batch(w);
+	}
+	return true;
+}
+
+// Run the producer and drain its FIFO like a WriterPool worker does
+int run_mode(const struct options &opts,int mode,struct result_t &result) {
+	size_t width = opts.channels;
+	size_t rowSize = width*sizeof(double);
+	std::string filename = opts.directory+"/recorder_bench_"+mode_names[mode]+(mode < MODE_RAW ? ".h5" : ".raw");
+
+	result.mode = mode;
+	result.ticks = result.tokens = result.dropped = result.bytes = result.elapsed = 0;
+	result.highWater = 0;
+	result.direct = false;
+	result.failed = 0;
+
+	writer_t w;
+	w.mode = mode;
+	w.table = -1;
+	w.width = width;
+	w.batchRows = 0;
+	w.batchTime = 0;
+	w.tokenRetrieved = false;
+	w.result = &result;
+
+	// Open the file like startRecording(), chunks are sized the same way
+	hid_t fid = -1;
+	if (mode < MODE_RAW) {
+		fid = H5Fcreate(filename.c_str(),H5F_ACC_TRUNC,H5P_DEFAULT,H5P_DEFAULT);
+		hsize_t array_size[] = { width };
+		hid_t array_type = H5Tarray_create(H5T_IEEE_F64LE,1,array_size);
+		hsize_t chunk = DataRecorder::chunkRows(rowSize,static_cast<long long>(opts.rate));
+#if H5_VERSION_GE(1,10,0)
+		hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+		if (mode == MODE_COMPRESSED)
+			H5Pset_deflate(plist,DEFLATE_LEVEL);
+		if (fid >= 0)
+			w.table = H5PTcreate(fid,"Channel Data",array_type,chunk,plist);
+		H5Pclose(plist);
+#else
+		if (fid >= 0)
+			w.table = H5PTcreate_fl(fid,"Channel Data",array_type,chunk,mode == MODE_COMPRESSED ? DEFLATE_LEVEL : -1);
+#endif
+		H5Tclose(array_type);
+		if (w.table < 0) {
+			fprintf(stderr,"Failed to create %s.\n",filename.c_str());
+			if (fid >= 0)
+				H5Fclose(fid);
+			result.failed = 1;
+			return -EIO;
+		}
+	} else {
+		if (w.raw.open(filename,0,true,mode == MODE_RAW ? DirectWriter::THREAD : DirectWriter::AUTO)) {
+			result.failed = 1;
+			return -EIO;
+		}
+		result.direct = w.raw.isDirect();
+	}
+
+	w.batchLimit = std::max(DataRecorder::batchLimit(width),static_cast<size_t>(opts.pack));
+	w.batch.resize(w.batchLimit*width);
+	w.pending.reserve(w.batchLimit);
+	w.data.resize(opts.pack*rowSize);
+
+	long long ticks = static_cast<long long>(opts.duration*opts.rate);
+	result.lag.reserve(ticks/opts.pack+1);
+	result.latency.reserve(ticks/w.batchLimit+static_cast<long long>(opts.duration*1e9/WRITER_POOL_FLUSH_INTERVAL)+16);
+
+	AtomicFifo fifo(opts.buffer,"Recorder benchmark");
+	fifo.enableNotification(std::min(opts.buffer/4,static_cast<size_t>(WRITER_WATERMARK)));
+
+	run_t run;
+	run.opts = &opts;
+	run.fifo = &fifo;
+	run.period = static_cast<long long>(1e9/opts.rate);
+	run.ticks = 0;
+	run.dropped = 0;
+
+	long long start = RT::OS::getTime();
+	if (RT::OS::createTask(&run.task,produce,&run,opts.virtual_time ? 0 : 99)) {
+		fprintf(stderr,"Failed to start the producer task.\n");
+		result.failed = 1;
+		return -EPERM;
+	}
+
+	// A NORMAL priority client, handled a slice at a time while it has data,
+	// and parked until the watermark, its timeout or the next pool flush
+	// once it ran dry
+	size_t budget = static_cast<size_t>(WRITER_POOL_SLICE) << 1;
+	long long lastFlush = start;
+	bool flush = false, idle;
+	while (service(w,fifo,budget,flush,idle)) {
+		flush = false;
+		long long now = RT::OS::getTime();
+		if (idle)
+			fifo.wait(std::max(std::min(static_cast<long long>(WRITER_POOL_TIMEOUT),lastFlush+WRITER_POOL_FLUSH_INTERVAL-now),0ll));
+		now = RT::OS::getTime();
+		if (now-lastFlush >= WRITER_POOL_FLUSH_INTERVAL) {
+			flush = true;
+			lastFlush = now;
+		}
+	}
+	flush_batch(w);
+
+	// Everything is written once the file is closed
+	if (mode < MODE_RAW) {
+		H5PTclose(w.table);
+		H5Fclose(fid);
+	} else
+		result.failed |= w.raw.close() < 0;
+	result.elapsed = RT::OS::getTime()-start;
+
+	RT::OS::deleteTask(run.task);
+	result.ticks = run.ticks;
+	result.dropped = run.dropped;
+
+	FifoMonitor::stats_t stats;
+	fifo.getStats(stats);
+	result.highWater = stats.highWater;
+
+	if (!opts.keep)
+		unlink(filename.c_str());
+
+	return result.failed ? -EIO : 0;
+}
+
+void print_results(const struct options &opts,const std::vector<result_t> &results) {
+	printf("{\n");
+	printf("  \"channels\": %d,\n",opts.channels);
+	printf("  \"rate\": %g,\n",opts.rate);
+	printf("  \"duration\": %g,\n",opts.duration);
+	printf("  \"pack\": %d,\n",opts.pack);
+	printf("  \"fifo_bytes\": %lu,\n",static_cast<unsigned long>(opts.buffer));
+	printf("  \"virtual\": %s,\n",opts.virtual_time ? "true" : "false");
+	printf("  \"runs\": [\n");
+	for (size_t i = 0; i < results.size(); ++i) {
+		result_t r = results[i];
+		long long lag_p50, lag_p99, lag_max, append_p50, append_p99, append_max;
+		percentile(r.lag,0.5,lag_p50);
+		percentile(r.lag,0.99,lag_p99);
+		percentile(r.lag,1.0,lag_max);
+		percentile(r.latency,0.5,append_p50);
+		percentile(r.latency,0.99,append_p99);
+		percentile(r.latency,1.0,append_max);
+
+		printf("    {\n");
+		printf("      \"mode\": \"%s\",\n",mode_names[r.mode]);
+		printf("      \"ok\": %s,\n",r.failed ? "false" : "true");
+		if (r.mode >= MODE_RAW)
+			printf("      \"o_direct\": %s,\n",r.direct ? "true" : "false");
+		printf("      \"ticks\": %lld,\n",r.ticks);
+		printf("      \"tokens\": %lld,\n",r.tokens);
+		printf("      \"dropped_tokens\": %lld,\n",r.dropped);
+		printf("      \"bytes\": %lld,\n",r.bytes);
+		printf("      \"seconds\": %.3f,\n",r.elapsed*1e-9);
+		printf("      \"mb_per_s\": %.3f,\n",r.elapsed ? r.bytes/(r.elapsed*1e-9)/1048576.0 : 0.0);
+		printf("      \"fifo_high_water\": %lu,\n",static_cast<unsigned long>(r.highWater));
+		printf("      \"writer_lag_ns\": { \"p50\": %lld, \"p99\": %lld, \"max\": %lld },\n",lag_p50,lag_p99,lag_max);
+		printf("      \"appends\": %lu,\n",static_cast<unsigned long>(r.latency.size()));
+		printf("      \"append_latency_ns\": { \"p50\": %lld, \"p99\": %lld, \"max\": %lld }\n",append_p50,append_p99,append_max);
+		printf("    }%s\n",i+1 < results.size() ? "," : "");
+	}
+	printf("  ]\n");
+	printf("}\n");
+}
@@ -0,0 +1,81 @@
+/*
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef WRITER_LIMITS_H
+#define WRITER_LIMITS_H
+
+#include <algorithm>
+#include <stddef.h>
+
+// The writer pool handles a panel once this many bytes are queued, or
+// after its timeout
+#define WRITER_WATERMARK            (64*1024)
+
+// Sample rows are appended to Channel Data in batches of up to this many
+// rows or bytes, a partial batch is flushed once it is this old
+#define WRITER_BATCH_ROWS           4096
+#define WRITER_BATCH_BYTES          (1024*1024)
+#define WRITER_FLUSH_INTERVAL       100000000ll // ns
+
+// Automatic Channel Data chunks hold about this many bytes, but no more
+// than one second of samples, compression uses this deflate level
+#define CHUNK_TARGET_BYTES          (256*1024)
+#define CHUNK_MIN_ROWS              64
+#define CHUNK_MAX_ROWS              1048576
+#define DEFLATE_LEVEL               4
+
+// Workers shared by every panel
+#define WRITER_POOL_THREADS         2
+
+// Bytes a LOW client handles per turn, doubled for each priority above
+#define WRITER_POOL_SLICE           (256*1024)
+
+// Clients with nothing queued are still handled this often, for the
+// asynchronous data and parameter changes posted to them
+#define WRITER_POOL_TIMEOUT         20000000ll // ns
+
+// Partial batches of every client are appended together this often
+#define WRITER_POOL_FLUSH_INTERVAL  100000000ll // ns
+
+// Shared by the recorder and recorder_bench, which must not pull in Qt
+namespace DataRecorder
+{
+	/*!
+	 * Rows of width doubles that make up a full batch.
+	 */
+	inline size_t batchLimit(size_t width)
+	{
+		if (!width)
+			return WRITER_BATCH_ROWS;
+		return std::max(static_cast<size_t>(1),
+				std::min(static_cast<size_t>(WRITER_BATCH_ROWS), WRITER_BATCH_BYTES / (width * sizeof(double))));
+	}
+
+	/*!
+	 * Rows of rowSize bytes in an automatic chunk, for a table that gets
+	 *   samplesPerSecond rows a second.
+	 */
+	inline unsigned long long chunkRows(size_t rowSize, long long samplesPerSecond)
+	{
+		unsigned long long chunk = CHUNK_TARGET_BYTES / rowSize;
+		chunk = std::min(chunk, static_cast<unsigned long long>(std::max(samplesPerSecond, 1ll)));
+		return std::max(chunk, static_cast<unsigned long long>(CHUNK_MIN_ROWS));
+	}
+}; // namespace DataRecorder
+
+#endif /* WRITER_LIMITS_H */
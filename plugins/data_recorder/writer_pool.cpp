@@ -0,0 +1,336 @@
+/*
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <debug.h>
+#include <mutex.h>
+#include <rt.h>
+#include <writer_limits.h>
+#include <writer_pool.h>
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+DataRecorder::WriterPool::WriterPool(void) :
+	wakeFd(-1), polling(false), done(false), lastFlush(0)
+{
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&cond, 0);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeFd < 0)
+		ERROR_MSG("DataRecorder::WriterPool::WriterPool : failed to create eventfd\n");
+}
+
+DataRecorder::WriterPool::~WriterPool(void)
+{
+	if (wakeFd >= 0)
+		close(wakeFd);
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+void DataRecorder::WriterPool::insertClient(Client *client, int priority)
+{
+	if (!client)
+	{
+		ERROR_MSG("DataRecorder::WriterPool::insertClient : invalid client\n");
+		return;
+	}
+
+	pthread_mutex_lock(&mutex);
+	client_t c = { client, priority, true, false, false, false, false, pthread_t(), 0, };
+	clients.push_back(c);
+	if (workers.empty())
+	{
+		lastFlush = RT::OS::getTime();
+		for (int i = 0; i < WRITER_POOL_THREADS; ++i)
+		{
+			pthread_t thread;
+			if (pthread_create(&thread, 0, bounce, this))
+				ERROR_MSG("DataRecorder::WriterPool::insertClient : failed to create a worker\n");
+			else
+				workers.push_back(thread);
+		}
+	}
+	pthread_cond_broadcast(&cond);
+	wake();
+	pthread_mutex_unlock(&mutex);
+}
+
+void DataRecorder::WriterPool::removeClient(Client *client)
+{
+	pthread_mutex_lock(&mutex);
+	client_t *c = find(client);
+	if (!c)
+	{
+		pthread_mutex_unlock(&mutex);
+		ERROR_MSG("DataRecorder::WriterPool::removeClient : invalid client\n");
+		return;
+	}
+
+	while (!c->finished)
+		pthread_cond_wait(&cond, &mutex);
+	for (std::list<client_t>::iterator i = clients.begin(); i != clients.end(); ++i)
+		if (i->client == client)
+		{
+			clients.erase(i);
+			break;
+		}
+
+	if (!clients.empty())
+	{
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+	// Nothing left to write, the workers are started again by the next client
+	std::vector<pthread_t> threads;
+	threads.swap(workers);
+	done = true;
+	pthread_cond_broadcast(&cond);
+	wake();
+	pthread_mutex_unlock(&mutex);
+
+	for (size_t i = 0; i < threads.size(); ++i)
+		pthread_join(threads[i], 0);
+
+	pthread_mutex_lock(&mutex);
+	done = false;
+	pthread_mutex_unlock(&mutex);
+}
+
+void DataRecorder::WriterPool::setPriority(Client *client, int priority)
+{
+	pthread_mutex_lock(&mutex);
+	client_t *c = find(client);
+	if (c)
+		c->priority = priority;
+	pthread_mutex_unlock(&mutex);
+}
+
+bool DataRecorder::WriterPool::isServicing(const Client *client)
+{
+	pthread_mutex_lock(&mutex);
+	client_t *c = find(client);
+	bool servicing = c && c->busy && pthread_equal(c->worker, pthread_self());
+	pthread_mutex_unlock(&mutex);
+	return servicing;
+}
+
+void DataRecorder::WriterPool::hold(Client *client)
+{
+	pthread_mutex_lock(&mutex);
+	client_t *c = find(client);
+	if (c)
+		c->held = true;
+	pthread_mutex_unlock(&mutex);
+}
+
+void DataRecorder::WriterPool::release(Client *client)
+{
+	pthread_mutex_lock(&mutex);
+	client_t *c = find(client);
+	if (c && c->held)
+	{
+		c->held = false;
+		c->ready = true;
+		pthread_cond_broadcast(&cond);
+		wake();
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+DataRecorder::WriterPool::client_t *DataRecorder::WriterPool::find(const Client *client)
+{
+	for (std::list<client_t>::iterator i = clients.begin(), end = clients.end(); i != end; ++i)
+		if (i->client == client)
+			return &*i;
+	return 0;
+}
+
+void *DataRecorder::WriterPool::bounce(void *param)
+{
+	WriterPool *that = reinterpret_cast<WriterPool *> (param);
+	if (that)
+		that->run();
+	return 0;
+}
+
+// Handle the ready client with the highest priority, the one handled least
+// recently among equals. With none ready a worker polls, if no other does
+void DataRecorder::WriterPool::run(void)
+{
+	pthread_mutex_lock(&mutex);
+	while (!done)
+	{
+		std::list<client_t>::iterator next = clients.end();
+		for (std::list<client_t>::iterator i = clients.begin(), end = clients.end(); i != end; ++i)
+			if (i->ready && !i->busy && !i->finished && !i->held && (next == clients.end() || i->priority > next->priority))
+				next = i;
+
+		if (next == clients.end())
+		{
+			if (polling)
+				pthread_cond_wait(&cond, &mutex);
+			else
+				poll();
+			continue;
+		}
+
+		// Handled clients go to the back of their priority
+		clients.splice(clients.end(), clients, next);
+		client_t &c = clients.back();
+		c.ready = false;
+		c.busy = true;
+		c.worker = pthread_self();
+		bool flush = c.flush;
+		c.flush = false;
+		size_t budget = static_cast<size_t>(WRITER_POOL_SLICE) << (c.priority - LOW);
+		pthread_mutex_unlock(&mutex);
+
+		bool more = c.client->service(budget, flush);
+
+		pthread_mutex_lock(&mutex);
+		c.busy = false;
+		c.handled = RT::OS::getTime();
+		if (!more)
+			c.finished = true;
+		else if (c.client->getFifo().available())
+			c.ready = true;
+		pthread_cond_broadcast(&cond);
+
+		// Have the polling worker watch this client again
+		wake();
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+// Wait for the clients that have nothing to do, called with the mutex
+// held, which is released while waiting
+void DataRecorder::WriterPool::poll(void)
+{
+	polling = true;
+
+	std::vector<struct pollfd> fds;
+	std::vector<client_t *> parked, polled;
+	struct pollfd wakeup = { wakeFd, POLLIN, 0 };
+	fds.push_back(wakeup);
+	bool ready = false;
+	for (std::list<client_t>::iterator i = clients.begin(), end = clients.end(); i != end; ++i)
+	{
+		if (i->ready || i->busy || i->finished || i->held)
+			continue;
+		int fd = i->client->getFifo().park();
+		if (fd == -1)
+		{
+			i->ready = ready = true;
+			continue;
+		}
+		else if (fd < 0)
+		{
+			// No descriptor to watch, the client is only looked at on timeout
+			polled.push_back(&*i);
+			continue;
+		}
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		fds.push_back(pfd);
+		parked.push_back(&*i);
+	}
+
+	// Wake up for the first client that is due anyway, or for the flush
+	long long now = RT::OS::getTime();
+	long long timeout = lastFlush + WRITER_POOL_FLUSH_INTERVAL - now;
+	for (size_t i = 0; i < parked.size(); ++i)
+		timeout = std::min(timeout, parked[i]->handled + WRITER_POOL_TIMEOUT - now);
+	for (size_t i = 0; i < polled.size(); ++i)
+		timeout = std::min(timeout, polled[i]->handled + WRITER_POOL_TIMEOUT - now);
+	timeout = ready ? 0 : std::max(timeout, 0ll);
+	struct timespec ts = {
+		static_cast<time_t>(timeout / 1000000000ll),
+		static_cast<long>(timeout % 1000000000ll),
+	};
+
+	pthread_mutex_unlock(&mutex);
+	while (ppoll(&fds[0], fds.size(), &ts, NULL) < 0 && errno == EINTR);
+	pthread_mutex_lock(&mutex);
+
+	if (fds[0].revents & POLLIN)
+	{
+		uint64_t count;
+		ssize_t retval = ::read(wakeFd, &count, sizeof(count));
+		(void)retval;
+	}
+
+	// Clients are handled when they have data, and when they have waited
+	// for WRITER_POOL_TIMEOUT anyway
+	now = RT::OS::getTime();
+	for (size_t i = 0; i < parked.size(); ++i)
+	{
+		AtomicFifo &fifo = parked[i]->client->getFifo();
+		fifo.unpark();
+		if (fds[i + 1].revents & POLLIN || fifo.available() || now - parked[i]->handled >= WRITER_POOL_TIMEOUT)
+			parked[i]->ready = true;
+	}
+	for (size_t i = 0; i < polled.size(); ++i)
+		if (now - polled[i]->handled >= WRITER_POOL_TIMEOUT)
+			polled[i]->ready = true;
+	if (now - lastFlush >= WRITER_POOL_FLUSH_INTERVAL)
+	{
+		for (std::list<client_t>::iterator i = clients.begin(), end = clients.end(); i != end; ++i)
+			if (!i->finished)
+				i->ready = i->flush = true;
+		lastFlush = now;
+	}
+
+	polling = false;
+	pthread_cond_broadcast(&cond);
+}
+
+void DataRecorder::WriterPool::wake(void)
+{
+	if (wakeFd < 0)
+		return;
+	uint64_t one = 1;
+	ssize_t retval = ::write(wakeFd, &one, sizeof(one));
+	(void)retval;
+}
+
+static Mutex mutex;
+DataRecorder::WriterPool *DataRecorder::WriterPool::instance = 0;
+
+DataRecorder::WriterPool *DataRecorder::WriterPool::getInstance(void)
+{
+	if (instance)
+		return instance;
+
+	/*************************************************************************
+	 * Seems like alot of hoops to jump through, but static allocation isn't *
+	 *   thread-safe. So effort must be taken to ensure mutual exclusion.    *
+	 *************************************************************************/
+
+	Mutex::Locker lock(&::mutex);
+	if (!instance)
+	{
+		static WriterPool pool;
+		instance = &pool;
+	}
+
+	return instance;
+}
@@ -0,0 +1,146 @@
+/*
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef WRITER_POOL_H
+#define WRITER_POOL_H
+
+#include <atomic_fifo.h>
+#include <list>
+#include <pthread.h>
+#include <stddef.h>
+#include <vector>
+
+namespace DataRecorder
+{
+	//! Writer threads shared by every Data Recorder panel.
+	/*!
+	 * A few workers drain the FIFOs of all panels. One worker at a time
+	 *   polls the FIFOs that have nothing to do, the others handle the
+	 *   ones that do, higher priority first, a slice of bytes at a time.
+	 *   Partial batches of every panel are written together at one
+	 *   schedule, instead of each panel flushing on its own.
+	 *
+	 * A client is only ever handled by one worker at a time.
+	 */
+	class WriterPool
+	{
+		public:
+
+			enum priority_t {
+				LOW = -1,
+				NORMAL = 0,
+				HIGH = 1,
+			};
+
+			class Client
+			{
+				public:
+
+					virtual ~Client(void) {};
+
+					/*!
+					 * The FIFO the realtime thread fills.
+					 */
+					virtual AtomicFifo &getFifo(void)=0;
+
+					/*!
+					 * Handle what is queued, about budget bytes of it.
+					 *
+					 * \param budget Bytes to handle before giving the worker back.
+					 * \param flush Append partially staged data once caught up.
+					 * \return False once the client is done and can be removed.
+					 */
+					virtual bool service(size_t budget,bool flush)=0;
+			}; // class Client
+
+			/*!
+			 * WriterPool is a Singleton, which means that there can only be one instance.
+			 *   This function returns a pointer to that single instance.
+			 *
+			 * \return The instance of WriterPool.
+			 */
+			static WriterPool *getInstance(void);
+
+			/*!
+			 * Start handling a client, the workers are started with the first one.
+			 */
+			void insertClient(Client *,int priority =NORMAL);
+
+			/*!
+			 * Wait until the client's service() returned false, then forget
+			 *   it. The workers stop with the last one.
+			 */
+			void removeClient(Client *);
+
+			void setPriority(Client *,int);
+
+			/*!
+			 * \return True if called by the worker handling the client.
+			 */
+			bool isServicing(const Client *);
+
+			/*!
+			 * Stop handling a client until release(), e.g. while it waits
+			 *   for an answer from the GUI, without holding a worker.
+			 */
+			void hold(Client *);
+
+			/*!
+			 * Handle a held client again.
+			 */
+			void release(Client *);
+
+		private:
+
+			struct client_t {
+				Client *client;
+				int priority;
+				bool ready;
+				bool busy;
+				bool flush;
+				bool finished;
+				bool held;
+				pthread_t worker;
+				long long handled;
+			};
+
+			WriterPool(void);
+			~WriterPool(void);
+			WriterPool(const WriterPool &) {};
+			WriterPool &operator=(const WriterPool &) { return *getInstance(); };
+
+			static WriterPool *instance;
+
+			static void *bounce(void *);
+			void run(void);
+			void poll(void);
+			void wake(void);
+			client_t *find(const Client *);
+
+			pthread_mutex_t mutex;
+			pthread_cond_t cond;
+			std::list<client_t> clients;
+			std::vector<pthread_t> workers;
+			int wakeFd;
+			bool polling;
+			bool done;
+			long long lastFlush;
+	}; // class WriterPool
+}; // namespace DataRecorder
+
+#endif /* WRITER_POOL_H */
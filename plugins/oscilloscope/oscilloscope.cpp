@@ -966,7 +966,7 @@ void Oscilloscope::Panel::showDisplayTab(void) {
 }
 
 ////////// #Panel
-Oscilloscope::Panel::Panel(QWidget *parent) :	QWidget(parent), RT::Thread(0), fifo(10 * 1048576) {
+Oscilloscope::Panel::Panel(QWidget *parent) :	QWidget(parent), RT::Thread(0), fifo(10 * 1048576,"Oscilloscope") {
 
 	// Set default attribute
 	QWidget::setAttribute(Qt::WA_DeleteOnClose);
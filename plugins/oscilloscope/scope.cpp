@@ -18,6 +18,7 @@
 
 #include <rt.h>
 #include <debug.h>
+#include <algorithm>
 #include <cmath>
 #include <stdlib.h>
 #include <main_window.h>
@@ -71,6 +72,7 @@ Scope::Scope(QWidget *parent) :	QwtPlot(parent), legendItem(NULL) {
 	divY = 10;
 	data_idx = 0;
 	data_size = 100;
+	bucketSize = 0;
 	hScl = 1.0;
 	period = 1.0;
 	dtLabel = "1ms";
@@ -173,6 +175,7 @@ std::list<Scope::Channel>::iterator Scope::insertChannel(QString label,double sc
 	channel.curve->setRenderHint(QwtPlotItem::RenderAntialiased, false);
 	channel.curve->attach(this);
 	channels.push_back(channel);
+	buildEnvelope(channels.back());
 	return --channels.end();
 }
 
@@ -189,6 +192,7 @@ void *Scope::removeChannel(std::list<Scope::Channel>::iterator channel) {
 void Scope::resizeEvent(QResizeEvent *event) {
 	d_directPainter->reset();
 	QwtPlot::resizeEvent(event);
+	resetEnvelopes();
 }
 
 // Returns count of number of active channels
@@ -218,8 +222,10 @@ std::list<Scope::Channel>::const_iterator Scope::getChannelsEnd(void) const {
 
 // Zeros data
 void Scope::clearData(void) {
-	for(std::list<Channel>::iterator i = channels.begin(), end = channels.end();i != end;++i)
+	for(std::list<Channel>::iterator i = channels.begin(), end = channels.end();i != end;++i) {
 		i->data.assign(data_size, 0);
+		buildEnvelope(*i);
+	}
 }
 
 // Scales data based upon desired settings for the channel
@@ -236,6 +242,22 @@ void Scope::setData(double data[],size_t size) {
 	for(std::list<Channel>::iterator i = channels.begin(), end = channels.end();i != end;++i) {
 		i->data[data_idx] = data[index++];
 
+		// A bucket starts over when the newest sample enters it
+		if(bucketSize) {
+			Channel::bucket_t &bucket = i->envelope[data_idx/bucketSize];
+			double value = i->data[data_idx];
+			if(data_idx%bucketSize == 0) {
+				bucket.min = bucket.max = value;
+				bucket.minFirst = true;
+			} else if(value < bucket.min) {
+				bucket.min = value;
+				bucket.minFirst = false;
+			} else if(value > bucket.max) {
+				bucket.max = value;
+				bucket.minFirst = true;
+			}
+		}
+
 		if(triggering && i == triggerChannel &&
 				((triggerDirection == POS && i->data[data_idx-1] < triggerThreshold && i->data[data_idx] > triggerThreshold) ||
 				 (triggerDirection == NEG && i->data[data_idx-1] > triggerThreshold && i->data[data_idx] < triggerThreshold))) {
@@ -258,28 +280,8 @@ void Scope::setData(double data[],size_t size) {
 			if(!triggerHolding)
 				drawCurves();
 
-			for(std::list<Channel>::iterator i = channels.begin(), iend = channels.end();i != iend;++i) {
-				std::vector<double> x (i->data.size());
-				std::vector<double> y (i->data.size());
-				double *x_loc = x.data();
-				double *y_loc = y.data();
-
-				// Set scale map for channel
-				scaleMapX->setScaleInterval(0, hScl*divX);
-				scaleMapY->setScaleInterval(-i->scale*divY/2, i->scale*divY/2);
-
-				// Scale data to pixel coordinates
-				for(size_t j = 0; j < i->data.size(); ++j) {
-					*x_loc = scaleMapX->transform(j*period);
-					*y_loc = scaleMapY->transform(i->data[(data_idx+j)%i->data.size()]+i->offset);
-					++x_loc;
-					++y_loc;
-				}
-				// Append data to curve
-				// Makes deep copy - which is not optimal
-				// TODO: change to pointer based method
-				i->curve->setSamples(x.data(), y.data(), i->data.size());
-			}
+			for(std::list<Channel>::iterator i = channels.begin(), iend = channels.end();i != iend;++i)
+				plotChannel(*i);
 		}
 	}
 }
@@ -297,6 +299,7 @@ void Scope::setDataSize(size_t size) {
 	data_idx = 0;
 	data_size = size;
 	triggerQueue.clear();
+	resetEnvelopes();
 }
 
 Scope::trig_t Scope::getTriggerDirection(void) {
@@ -411,30 +414,115 @@ void Scope::drawCurves(void) {
 	if(isPaused || getChannelCount() == 0)
 		return;
 
-	for(std::list<Channel>::iterator i = channels.begin(), iend = channels.end(); i != iend;++i) {
-		// Set data for channel
-		std::vector<double> x (i->data.size());
-		std::vector<double> y (i->data.size());
-		double *x_loc = x.data();
-		double *y_loc = y.data();
+	for(std::list<Channel>::iterator i = channels.begin(), iend = channels.end(); i != iend;++i)
+		plotChannel(*i);
 
-		// Set scale map for channel
-		scaleMapX->setScaleInterval(0, hScl*divX);
-		scaleMapY->setScaleInterval(-i->scale*divY/2, i->scale*divY/2);
+	// Update plot
+	replot();
+}
+
+// Hand the samples of a channel to its curve, oldest first. With more
+// samples than the canvas has pixel columns, each bucket of samples is
+// drawn as its min and max, in the order they came in
+void Scope::plotChannel(Channel &channel) {
+	// Set scale map for channel
+	scaleMapX->setScaleInterval(0, hScl*divX);
+	scaleMapY->setScaleInterval(-channel.scale*divY/2, channel.scale*divY/2);
+
+	channel.x.clear();
+	channel.y.clear();
+	size_t size = channel.data.size();
 
+	if(!bucketSize) {
 		// Scale data to pixel coordinates
-		for(size_t j = 0; j < i->data.size(); ++j) {
-			*x_loc = scaleMapX->transform(j*period);
-			*y_loc = scaleMapY->transform(i->data[(data_idx+j)%i->data.size()]+i->offset);
-			++x_loc;
-			++y_loc;
+		for(size_t j = 0; j < size; ++j) {
+			channel.x.push_back(scaleMapX->transform(j*period));
+			channel.y.push_back(scaleMapY->transform(channel.data[(data_idx+j)%size]+channel.offset));
+		}
+	} else {
+		// The bucket being filled holds the newest samples up to data_idx,
+		// and the oldest ones from there on, which its envelope doesn't cover
+		size_t head = data_idx/bucketSize;
+		size_t split = data_idx%bucketSize ? head : size_t(-1);
+		if(split != size_t(-1)) {
+			size_t end = std::min((head+1)*bucketSize, size);
+			double min = channel.data[data_idx], max = min;
+			size_t minAt = data_idx, maxAt = data_idx;
+			for(size_t k = data_idx+1; k < end; ++k) {
+				if(channel.data[k] < min) {
+					min = channel.data[k];
+					minAt = k;
+				} else if(channel.data[k] > max) {
+					max = channel.data[k];
+					maxAt = k;
+				}
+			}
+			appendPoints(channel, 0, min, max, minAt <= maxAt);
+		}
+
+		size_t buckets = channel.envelope.size();
+		for(size_t n = 0; n < buckets; ++n) {
+			size_t k = (head+n+(split != size_t(-1)))%buckets;
+			if(k == split)
+				break;
+			const Channel::bucket_t &bucket = channel.envelope[k];
+			appendPoints(channel, (k*bucketSize+size-data_idx)%size, bucket.min, bucket.max, bucket.minFirst);
+		}
+
+		if(split != size_t(-1)) {
+			const Channel::bucket_t &bucket = channel.envelope[split];
+			appendPoints(channel, split*bucketSize+size-data_idx, bucket.min, bucket.max, bucket.minFirst);
 		}
-		// Append data to curve
-		// Makes deep copy - which is not optimal
-		// TODO: change to pointer based method
-		i->curve->setSamples(x.data(), y.data(), i->data.size());
 	}
 
-	// Update plot
-	replot();
+	// The curve draws straight from the channel's points
+	channel.curve->setRawSamples(channel.x.data(), channel.y.data(), channel.x.size());
+}
+
+// Add the min and max of a bucket that starts j samples into the trace
+void Scope::appendPoints(Channel &channel, size_t j, double min, double max, bool minFirst) {
+	double x = scaleMapX->transform(j*period);
+	channel.x.push_back(x);
+	channel.x.push_back(x);
+	channel.y.push_back(scaleMapY->transform((minFirst ? min : max)+channel.offset));
+	channel.y.push_back(scaleMapY->transform((minFirst ? max : min)+channel.offset));
+}
+
+// Pick the bucket size for the data size and the canvas width, about two
+// points per pixel column are drawn for each channel
+void Scope::resetEnvelopes(void) {
+	size_t columns = std::max(canvas()->width(), 1);
+	bucketSize = data_size > 2*columns ? (data_size+columns-1)/columns : 0;
+	for(std::list<Channel>::iterator i = channels.begin(), end = channels.end();i != end;++i)
+		buildEnvelope(*i);
+}
+
+// Compute the envelope of a channel's data from scratch
+void Scope::buildEnvelope(Channel &channel) {
+	channel.envelope.clear();
+	if(!bucketSize)
+		return;
+
+	size_t size = channel.data.size();
+	channel.envelope.resize((size+bucketSize-1)/bucketSize);
+	for(size_t k = 0; k < channel.envelope.size(); ++k) {
+		// Only the newest samples of the bucket being filled are in its envelope
+		size_t start = k*bucketSize;
+		size_t end = std::min(start+bucketSize, size);
+		if(data_idx > start && data_idx < end)
+			end = data_idx;
+
+		Channel::bucket_t &bucket = channel.envelope[k];
+		bucket.min = bucket.max = channel.data[start];
+		bucket.minFirst = true;
+		for(size_t j = start+1; j < end; ++j) {
+			if(channel.data[j] < bucket.min) {
+				bucket.min = channel.data[j];
+				bucket.minFirst = false;
+			} else if(channel.data[j] > bucket.max) {
+				bucket.max = channel.data[j];
+				bucket.minFirst = true;
+			}
+		}
+	}
 }
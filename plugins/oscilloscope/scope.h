@@ -72,11 +72,20 @@ class Scope : public QwtPlot {
 		QString getLabel(void) const;
 
 		private:
+		struct bucket_t {
+			double min;
+			double max;
+			bool minFirst;
+		};
+
 		QString label;
 		double scale;
 		double offset;
 		std::vector<double> prevdata;
 		std::vector<double> data;
+		std::vector<bucket_t> envelope; // min and max of each bucket of data
+		std::vector<double> x; // points handed to the curve
+		std::vector<double> y;
 		QwtPlotCurve *curve;
 		void *info;
 	}; // Channel
@@ -185,12 +194,17 @@ class Scope : public QwtPlot {
 
 	private:
 	void drawCurves(void);
+	void plotChannel(Channel &);
+	void resetEnvelopes(void);
+	void buildEnvelope(Channel &);
+	void appendPoints(Channel &,size_t,double,double,bool);
 	void incrementInterval();
 
 	size_t divX;
 	size_t divY;
 	size_t data_idx;
 	size_t data_size;
+	size_t bucketSize;  // samples per envelope bucket, 0 plots every sample
 	double hScl;        // horizontal scale for time (ms)
 	double period;      // real-time period of system (ms)
 	size_t refresh;
@@ -0,0 +1,339 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <debug.h>
+#include <main_window.h>
+#include <list>
+#include <map>
+#include <rt_monitor.h>
+
+namespace {
+
+	enum {
+		FIFO_NAME,
+		FIFO_CAPACITY,
+		FIFO_USED,
+		FIFO_PEAK,
+		FIFO_PEAK_PERCENT,
+		FIFO_FAILED,
+		FIFO_STALL,
+		FIFO_COLUMNS,
+	};
+
+	enum {
+		MEMORY_OWNER,
+		MEMORY_NAME,
+		MEMORY_SIZE,
+		MEMORY_USED,
+		MEMORY_FAILED,
+		MEMORY_HUGE,
+		MEMORY_LOCKED,
+		MEMORY_COLUMNS,
+	};
+
+	enum {
+		DIAG_OBJECT,
+		DIAG_ALLOCATIONS,
+		DIAG_FREES,
+		DIAG_BYTES,
+		DIAG_MINOR,
+		DIAG_MAJOR,
+		DIAG_COLUMNS,
+	};
+
+	struct arena_row_t {
+		std::string name;
+		RT::Arena::stats_t stats;
+	};
+
+	typedef std::map<std::string, std::list<arena_row_t> > arena_map_t;
+
+	void setRow(QTableWidget *table, int row, const QStringList &values, bool bold) {
+		for (int i = 0; i < values.size(); ++i) {
+			QTableWidgetItem *item = new QTableWidgetItem(values[i]);
+			if (bold) {
+				QFont font = item->font();
+				font.setBold(true);
+				item->setFont(font);
+			}
+			table->setItem(row, i, item);
+		}
+	}
+
+}; // namespace
+
+RTMonitor::Panel::Panel(QWidget *parent) : QWidget(parent) {
+
+	QWidget::setAttribute(Qt::WA_DeleteOnClose);
+
+	// Make Mdi
+	QMdiSubWindow *subWindow = new QMdiSubWindow;
+	subWindow->setWindowIcon(QIcon("/usr/local/lib/rtxi/RTXI-widget-icon.png"));
+	subWindow->setAttribute(Qt::WA_DeleteOnClose);
+	subWindow->setWindowFlags(Qt::CustomizeWindowHint);
+	subWindow->setWindowFlags(Qt::WindowCloseButtonHint);
+	subWindow->resize(640,320);
+	MainWindow::getInstance()->createMdi(subWindow);
+
+	// Create main layout
+	QVBoxLayout *layout = new QVBoxLayout;
+	tabs = new QTabWidget(this);
+	layout->addWidget(tabs);
+
+	// FIFO tab
+	QWidget *fifoTab = new QWidget;
+	QVBoxLayout *fifoLayout = new QVBoxLayout(fifoTab);
+
+	fifoTable = new QTableWidget(0, FIFO_COLUMNS, fifoTab);
+	fifoTable->setHorizontalHeaderLabels(QStringList() << "Name" << "Capacity (kB)" << "Used (kB)"
+			<< "Peak (kB)" << "Peak (%)" << "Failed Writes" << "Max Stall (ms)");
+	fifoTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	fifoTable->setSelectionMode(QAbstractItemView::NoSelection);
+	fifoTable->verticalHeader()->hide();
+	fifoTable->horizontalHeader()->setStretchLastSection(true);
+	fifoLayout->addWidget(fifoTable);
+
+	QPushButton *resetButton = new QPushButton("Reset", fifoTab);
+	fifoLayout->addWidget(resetButton, 0, Qt::AlignRight);
+	QObject::connect(resetButton,SIGNAL(released(void)),this,SLOT(resetFifos(void)));
+
+	tabs->addTab(fifoTab, "FIFOs");
+
+	// Memory tab, one row per RT::Arena or plugin image and a total per owner
+	memoryTable = new QTableWidget(0, MEMORY_COLUMNS);
+	memoryTable->setHorizontalHeaderLabels(QStringList() << "Owner" << "Arena" << "Size (kB)"
+			<< "Used (kB)" << "Failed Allocations" << "Huge Pages" << "Locked");
+	memoryTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	memoryTable->setSelectionMode(QAbstractItemView::NoSelection);
+	memoryTable->verticalHeader()->hide();
+	memoryTable->horizontalHeader()->setStretchLastSection(true);
+	tabs->addTab(memoryTable, "Memory");
+
+	// Diagnostics tab
+	QWidget *diagnosticsTab = new QWidget;
+	QVBoxLayout *diagnosticsLayout = new QVBoxLayout(diagnosticsTab);
+	QHBoxLayout *diagnosticsBar = new QHBoxLayout;
+
+	QCheckBox *traceBox = new QCheckBox("Trace page faults and heap use", diagnosticsTab);
+	traceBox->setChecked(RTDiagnostics::isEnabled());
+	traceBox->setToolTip("Adds a system call per object per tick, only enable while hunting a latency problem");
+	QObject::connect(traceBox,SIGNAL(toggled(bool)),this,SLOT(toggleDiagnostics(bool)));
+	diagnosticsBar->addWidget(traceBox);
+	diagnosticsBar->addStretch();
+
+	QPushButton *diagnosticsReset = new QPushButton("Reset", diagnosticsTab);
+	QObject::connect(diagnosticsReset,SIGNAL(released(void)),this,SLOT(resetDiagnostics(void)));
+	diagnosticsBar->addWidget(diagnosticsReset);
+	diagnosticsLayout->addLayout(diagnosticsBar);
+
+	tickLabel = new QLabel(diagnosticsTab);
+	diagnosticsLayout->addWidget(tickLabel);
+
+	diagnosticsTable = new QTableWidget(0, DIAG_COLUMNS, diagnosticsTab);
+	diagnosticsTable->setHorizontalHeaderLabels(QStringList() << "Object" << "Allocations" << "Frees"
+			<< "Bytes" << "Minor Faults" << "Major Faults");
+	diagnosticsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	diagnosticsTable->setSelectionMode(QAbstractItemView::NoSelection);
+	diagnosticsTable->verticalHeader()->hide();
+	diagnosticsTable->horizontalHeader()->setStretchLastSection(true);
+	diagnosticsLayout->addWidget(diagnosticsTable);
+
+	tabs->addTab(diagnosticsTab, "Diagnostics");
+
+	// Attach layout to Widget
+	setLayout(layout);
+	setWindowTitle(tr("RT Monitor"));
+
+	// Set layout to Mdi
+	subWindow->setWidget(this);
+	show();
+
+	updateStats();
+	QTimer *timer = new QTimer(this);
+	timer->start(1000);
+	QObject::connect(timer,SIGNAL(timeout(void)),this,SLOT(updateStats(void)));
+}
+
+RTMonitor::Panel::~Panel(void) {
+	Plugin::getInstance()->panel = 0;
+}
+
+void RTMonitor::Panel::resetFifos(void) {
+	FifoMonitor::Manager::getInstance()->resetAll();
+	updateStats();
+}
+
+void RTMonitor::Panel::toggleDiagnostics(bool state) {
+	RTDiagnostics::setEnabled(state);
+}
+
+void RTMonitor::Panel::resetDiagnostics(void) {
+	RTDiagnostics::reset();
+}
+
+void RTMonitor::Panel::appendFifo(FifoMonitor::Source *source,const FifoMonitor::stats_t &stats,void *param) {
+	QTableWidget *table = reinterpret_cast<QTableWidget *>(param);
+	int row = table->rowCount();
+	table->insertRow(row);
+
+	double percent = stats.capacity ? 100.0 * stats.highWater / stats.capacity : 0.0;
+
+	table->setItem(row, FIFO_NAME, new QTableWidgetItem(QString::fromStdString(source->getName())));
+	table->setItem(row, FIFO_CAPACITY, new QTableWidgetItem(QString::number(stats.capacity / 1024.0, 'f', 1)));
+	table->setItem(row, FIFO_USED, new QTableWidgetItem(QString::number(stats.used / 1024.0, 'f', 1)));
+	table->setItem(row, FIFO_PEAK, new QTableWidgetItem(QString::number(stats.highWater / 1024.0, 'f', 1)));
+	table->setItem(row, FIFO_PEAK_PERCENT, new QTableWidgetItem(QString::number(percent, 'f', 1)));
+	table->setItem(row, FIFO_FAILED, new QTableWidgetItem(QString::number(static_cast<qulonglong>(stats.failedWrites))));
+	table->setItem(row, FIFO_STALL, new QTableWidgetItem(QString::number(stats.maxStall * 1e-6, 'f', 2)));
+
+	// Anything that has lost data or came close to it deserves attention
+	if (stats.failedWrites || percent >= 90.0)
+		for (int i = 0; i < FIFO_COLUMNS; ++i)
+			table->item(row, i)->setForeground(Qt::red);
+}
+
+void RTMonitor::Panel::collectArena(RT::Arena *arena,void *param) {
+	arena_map_t *owners = reinterpret_cast<arena_map_t *>(param);
+	arena_row_t row;
+	row.name = arena->getName();
+	arena->getStats(row.stats);
+	(*owners)[arena->getOwner()].push_back(row);
+}
+
+void RTMonitor::Panel::collectPlugin(::Plugin::Object *plugin,void *param) {
+	if (!plugin->getImageSize())
+		return;
+
+	arena_map_t *owners = reinterpret_cast<arena_map_t *>(param);
+	arena_row_t row;
+	row.name = "library image";
+	row.stats.size = plugin->getImageSize();
+	row.stats.used = plugin->getImageSize();
+	row.stats.failed = 0;
+	row.stats.hugePages = false;
+	row.stats.locked = plugin->getLockedMemory() == plugin->getImageSize();
+	(*owners)[plugin->getLibrary()].push_back(row);
+}
+
+void RTMonitor::Panel::updateFifos(void) {
+	fifoTable->setRowCount(0);
+	FifoMonitor::Manager::getInstance()->foreachFifo(appendFifo, fifoTable);
+}
+
+void RTMonitor::Panel::updateMemory(void) {
+	arena_map_t owners;
+	RT::Arena::foreachArena(collectArena, &owners);
+	::Plugin::Manager::getInstance()->foreachPlugin(collectPlugin, &owners);
+
+	memoryTable->setRowCount(0);
+	for (arena_map_t::iterator i = owners.begin(), end = owners.end(); i != end; ++i) {
+		size_t size = 0, used = 0, failed = 0;
+
+		for (std::list<arena_row_t>::iterator j = i->second.begin(); j != i->second.end(); ++j) {
+			int row = memoryTable->rowCount();
+			memoryTable->insertRow(row);
+			setRow(memoryTable, row, QStringList() << QString::fromStdString(i->first) << QString::fromStdString(j->name)
+					<< QString::number(j->stats.size / 1024.0, 'f', 1) << QString::number(j->stats.used / 1024.0, 'f', 1)
+					<< QString::number(static_cast<qulonglong>(j->stats.failed))
+					<< (j->stats.hugePages ? "yes" : "no") << (j->stats.locked ? "yes" : "no"), false);
+
+			size += j->stats.size;
+			used += j->stats.used;
+			failed += j->stats.failed;
+		}
+
+		int row = memoryTable->rowCount();
+		memoryTable->insertRow(row);
+		setRow(memoryTable, row, QStringList() << QString::fromStdString(i->first) << "Total"
+				<< QString::number(size / 1024.0, 'f', 1) << QString::number(used / 1024.0, 'f', 1)
+				<< QString::number(static_cast<qulonglong>(failed)) << "" << "", true);
+	}
+}
+
+void RTMonitor::Panel::appendObject(const RTDiagnostics::object_stats_t &stats,void *param) {
+	QTableWidget *table = reinterpret_cast<QTableWidget *>(param);
+	int row = table->rowCount();
+	table->insertRow(row);
+
+	setRow(table, row, QStringList() << QString::fromStdString(RTDiagnostics::describe(stats))
+			<< QString::number(static_cast<qulonglong>(stats.allocations))
+			<< QString::number(static_cast<qulonglong>(stats.frees))
+			<< QString::number(static_cast<qulonglong>(stats.bytes))
+			<< QString::number(static_cast<qulonglong>(stats.minorFaults))
+			<< QString::number(static_cast<qulonglong>(stats.majorFaults)),
+			stats.allocations || stats.majorFaults);
+}
+
+void RTMonitor::Panel::updateDiagnostics(void) {
+	RTDiagnostics::tick_stats_t stats;
+	RTDiagnostics::getTickStats(stats);
+
+	tickLabel->setText(QString("%1 ticks traced, %2 with page faults, at most %3 faults in one tick, %4 heap calls in realtime")
+			.arg(static_cast<qulonglong>(stats.ticks)).arg(static_cast<qulonglong>(stats.faultTicks))
+			.arg(static_cast<qulonglong>(stats.maxFaults)).arg(static_cast<qulonglong>(stats.allocations)));
+
+	diagnosticsTable->setRowCount(0);
+	RTDiagnostics::foreachObject(appendObject, diagnosticsTable);
+}
+
+void RTMonitor::Panel::updateStats(void) {
+	updateFifos();
+	updateMemory();
+	updateDiagnostics();
+}
+
+extern "C" Plugin::Object * createRTXIPlugin(void *) {
+	return RTMonitor::Plugin::getInstance();
+}
+
+RTMonitor::Plugin::Plugin(void) : panel(0) {
+	MainWindow::getInstance()->createSystemMenuItem("RT Monitor",this,SLOT(createRTMonitorPanel(void)));
+}
+
+RTMonitor::Plugin::~Plugin(void) {
+	if (panel)
+		delete panel;
+	instance = 0;
+	panel = 0;
+}
+
+void RTMonitor::Plugin::createRTMonitorPanel(void) {
+	if (!panel)
+		panel = new Panel(MainWindow::getInstance()->centralWidget());
+	panel->show();
+}
+
+static Mutex mutex;
+RTMonitor::Plugin *RTMonitor::Plugin::instance = 0;
+
+RTMonitor::Plugin * RTMonitor::Plugin::getInstance(void) {
+	if (instance)
+		return instance;
+
+	/*************************************************************************
+	 * Seems like alot of hoops to jump through, but allocation isn't        *
+	 *   thread-safe. So effort must be taken to ensure mutual exclusion.    *
+	 *************************************************************************/
+
+	Mutex::Locker lock(&::mutex);
+	if (!instance)
+		instance = new Plugin();
+
+	return instance;
+}
@@ -0,0 +1,102 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RT_MONITOR_H
+#define RT_MONITOR_H
+
+#include <QtGui>
+
+#include <fifo_monitor.h>
+#include <plugin.h>
+#include <rt_arena.h>
+#include <rt_diagnostics.h>
+
+//! Live view of the telemetry kept by the realtime subsystems.
+namespace RTMonitor {
+
+	class Panel;
+
+	class Plugin : public QObject, public ::Plugin::Object {
+
+		Q_OBJECT
+			friend class Panel;
+
+		public:
+		static Plugin *getInstance(void);
+
+		public slots:
+			void createRTMonitorPanel(void);
+
+		private:
+		Plugin(void);
+		~Plugin(void);
+		Plugin(const Plugin &){};
+		Plugin & operator=(const Plugin &)
+		{
+			return *getInstance();
+		};
+		static Plugin *instance;
+		Panel *panel;
+	}; // class Plugin
+
+	class Panel : public QWidget {
+		Q_OBJECT
+
+		public:
+			Panel(QWidget *);
+			virtual
+				~Panel(void);
+
+			public slots:
+
+				/*!
+				 * Clears the peak, drop and stall counters of every FIFO
+				 */
+				void resetFifos(void);
+
+				/*!
+				 * Switches page fault and heap tracing of the realtime thread
+				 */
+				void toggleDiagnostics(bool);
+				void resetDiagnostics(void);
+
+			/*!
+			 * Updates the GUI with the latest values
+			 */
+			void updateStats(void);
+
+		private:
+
+			static void appendFifo(FifoMonitor::Source *,const FifoMonitor::stats_t &,void *);
+			static void collectArena(RT::Arena *,void *);
+			static void collectPlugin(::Plugin::Object *,void *);
+			static void appendObject(const RTDiagnostics::object_stats_t &,void *);
+
+			void updateFifos(void);
+			void updateMemory(void);
+			void updateDiagnostics(void);
+
+			QTabWidget *tabs;
+			QTableWidget *fifoTable;
+			QTableWidget *memoryTable;
+			QLabel *tickLabel;
+			QTableWidget *diagnosticsTable;
+	}; // class Panel
+}; // namespace RTMonitor
+#endif /* RT_MONITOR_H */
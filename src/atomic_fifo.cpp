@@ -19,15 +19,24 @@
 #include <debug.h>
 #include <iostream>
 #include <atomic_fifo.h>
+#include <rt.h>
 #include <string.h>
-
-AtomicFifo::AtomicFifo(size_t s)
-    : head(0), tail(0), fifoSize(s) {
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+AtomicFifo::AtomicFifo(size_t s, const std::string &name)
+    : FifoMonitor::Source(name), head(0), tail(0), fifoSize(s), eventFd(-1), watermark(0), parked(false) {
     data = new char[fifoSize];
 }
 
 AtomicFifo::~AtomicFifo(void) {
+    unregisterSource();
     if(data) delete[] data;
+    if(eventFd >= 0) close(eventFd);
 }
 
 bool AtomicFifo::write(const void *buffer,size_t itemSize) { // It is an absolute requirement only one thread calls write
@@ -36,6 +45,7 @@ bool AtomicFifo::write(const void *buffer,size_t itemSize) { // It is an absolut
     const auto current_tail = tail.load(std::memory_order_seq_cst);
 
     if( itemSize >= fifoSize - ((fifoSize + current_tail - head.load(std::memory_order_seq_cst)) % fifoSize) ){
+        counters.failed();
         ERROR_MSG("AtomicFifo::write : fifo full, data lost\n");
         return false;
     }
@@ -48,6 +58,11 @@ bool AtomicFifo::write(const void *buffer,size_t itemSize) { // It is an absolut
         memcpy(data + current_tail, buffer, itemSize);
 
     tail.store(increment(current_tail, itemSize));
+    counters.wrote(available());
+
+    // Only touch the eventfd when the consumer is actually parked
+    if(eventFd >= 0 && parked.load(std::memory_order_seq_cst))
+        signal();
 
     return true;
 }
@@ -72,6 +87,7 @@ bool AtomicFifo::read(void *buffer,size_t itemSize) { // It is an absolute requi
         memcpy(buffer, data + current_head, itemSize);
     
     head.store(increment(current_head, itemSize));
+    counters.consumed(available());
 
     return true;
 }
@@ -81,5 +97,107 @@ size_t AtomicFifo::increment(size_t current_ptr, size_t itemSize) const {
 }
 
 bool AtomicFifo::isLockFree() const {
-    return (tail.is_lock_free() && head.is_lock_free());
+    return (tail.is_lock_free() && head.is_lock_free() && parked.is_lock_free());
+}
+
+size_t AtomicFifo::available(void) const {
+    return (fifoSize + tail.load(std::memory_order_seq_cst) - head.load(std::memory_order_seq_cst)) % fifoSize;
+}
+
+void AtomicFifo::getStats(FifoMonitor::stats_t &stats) const {
+    stats.capacity = fifoSize;
+    stats.used = available();
+    counters.fill(stats);
+}
+
+void AtomicFifo::resetStats(void) {
+    counters.reset();
+}
+
+bool AtomicFifo::enableNotification(size_t w) {
+    if(eventFd < 0)
+        eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(eventFd < 0) {
+        ERROR_MSG("AtomicFifo::enableNotification : failed to create eventfd\n");
+        return false;
+    }
+
+    watermark = (w < fifoSize) ? w : fifoSize - 1;
+    return true;
+}
+
+void AtomicFifo::signal(void) { // Called by the producer only
+    if(available() < watermark || !RT::OS::canSyscall())
+        return;
+
+    // Whoever clears the flag first owns the wakeup, so a parked consumer
+    // is signaled at most once per wait()
+    if(parked.exchange(false, std::memory_order_seq_cst)) {
+        uint64_t one = 1;
+        ssize_t retval = ::write(eventFd, &one, sizeof(one));
+        (void)retval;
+    }
+}
+
+void AtomicFifo::notify(void) {
+    // The realtime task of Xenomai and RTAI leaves the consumer parked, it
+    // wakes up on its own timeout instead
+    if(!RT::OS::canSyscall())
+        return;
+
+    if(eventFd >= 0 && parked.exchange(false, std::memory_order_seq_cst)) {
+        uint64_t one = 1;
+        ssize_t retval = ::write(eventFd, &one, sizeof(one));
+        (void)retval;
+    }
+}
+
+bool AtomicFifo::wait(long long timeout) { // It is an absolute requirement only one thread calls wait
+    struct timespec ts = {
+        static_cast<time_t>(timeout / 1000000000ll),
+        static_cast<long>(timeout % 1000000000ll),
+    };
+
+    if(eventFd < 0) {
+        nanosleep(&ts, NULL);
+        return available() > 0;
+    }
+
+    int fd = park();
+    if(fd < 0)
+        return true;
+
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while(ppoll(&pfd, 1, &ts, NULL) < 0 && errno == EINTR);
+    unpark();
+
+    return available() > 0;
+}
+
+int AtomicFifo::park(void) { // Called by the consumer only
+    if(eventFd < 0)
+        return -2;
+
+    // Publish the parked flag before checking the fill level; together with
+    // the producer storing tail before loading the flag this rules out a lost
+    // wakeup.
+    parked.store(true, std::memory_order_seq_cst);
+    if(watermark && available() >= watermark) {
+        parked.store(false, std::memory_order_seq_cst);
+        return -1;
+    }
+
+    return eventFd;
+}
+
+void AtomicFifo::unpark(void) { // Called by the consumer only
+    if(eventFd < 0)
+        return;
+    parked.store(false, std::memory_order_seq_cst);
+
+    // The descriptor is non-blocking, so this only clears a wakeup that
+    // was signaled
+    uint64_t count;
+    ssize_t retval = ::read(eventFd, &count, sizeof(count));
+    (void)retval;
 }
@@ -0,0 +1,588 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <debug.h>
+#include <direct_writer.h>
+#include <rtxi_config.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#define SYNC_TAG (~0ull)
+
+static long long now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return 1000000000ll*ts.tv_sec+ts.tv_nsec;
+}
+
+static size_t alignUp(size_t n) {
+	return (n+DIRECT_WRITER_ALIGN-1) & ~static_cast<size_t>(DIRECT_WRITER_ALIGN-1);
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+static int enter(int fd,unsigned submit,unsigned complete,unsigned flags) {
+	return syscall(__NR_io_uring_enter,fd,submit,complete,flags,NULL,0);
+}
+#endif
+
+DirectWriter::DirectWriter(size_t size,size_t count)
+	: fd(-1), direct(false), backend(THREAD), failed(false), bufferSize(alignUp(std::max(size,static_cast<size_t>(1)))),
+	buffers(std::max(count,static_cast<size_t>(2))), current(0), position(0), syncInterval(0), lastSync(0), syncPending(false),
+	ringFd(-1), fixedBuffers(false), sqRing(0), cqRing(0), sqRingSize(0), cqRingSize(0), sqes(0), sqesSize(0), done(true) {
+		pthread_mutex_init(&mutex,0);
+		pthread_cond_init(&cond,0);
+
+		// Touch the buffers now, the writer should never fault them in
+		for (size_t i = 0; i < buffers.size(); ++i) {
+			void *p = 0;
+			if (posix_memalign(&p,DIRECT_WRITER_ALIGN,bufferSize)) {
+				ERROR_MSG("DirectWriter::DirectWriter : failed to allocate %lu bytes\n",static_cast<unsigned long>(bufferSize));
+				p = 0;
+			} else
+				memset(p,0,bufferSize);
+			buffers[i].data = reinterpret_cast<char *>(p);
+			buffers[i].offset = 0;
+			buffers[i].used = 0;
+			buffers[i].length = 0;
+			buffers[i].busy = false;
+			buffers[i].iov.iov_base = p;
+			buffers[i].iov.iov_len = bufferSize;
+		}
+	}
+
+DirectWriter::~DirectWriter(void) {
+	close();
+	for (size_t i = 0; i < buffers.size(); ++i)
+		free(buffers[i].data);
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+int DirectWriter::open(const std::string &name,off_t offset,bool truncate,backend_t b) {
+	if (fd >= 0)
+		close();
+
+	for (size_t i = 0; i < buffers.size(); ++i)
+		if (!buffers[i].data)
+			return -1;
+
+	// Filesystems like tmpfs refuse O_DIRECT, write through the page cache there
+	int flags = O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0);
+	fd = ::open(name.c_str(),flags | O_DIRECT,0644);
+	direct = fd >= 0;
+	if (fd < 0 && errno == EINVAL)
+		fd = ::open(name.c_str(),flags,0644);
+	if (fd < 0) {
+		ERROR_MSG("DirectWriter::open : failed to open %s : %s\n",name.c_str(),strerror(errno));
+		return -1;
+	}
+
+	failed = false;
+	position = alignUp(offset);
+	current = 0;
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		buffers[i].used = 0;
+		buffers[i].busy = false;
+	}
+	buffers[current].offset = position;
+	lastSync = now();
+	syncPending = false;
+
+	backend = THREAD;
+	if (direct && b != THREAD && !setupRing())
+		backend = URING;
+	else if (b == URING)
+		DEBUG_MSG("DirectWriter::open : io_uring is not available for %s, using a writer thread\n",name.c_str());
+
+	if (backend == THREAD) {
+		done = false;
+		queue.clear();
+		if (pthread_create(&thread,0,&DirectWriter::bounce,this)) {
+			ERROR_MSG("DirectWriter::open : failed to create the writer thread\n");
+			::close(fd);
+			fd = -1;
+			done = true;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int DirectWriter::close(void) {
+	if (fd < 0)
+		return 0;
+
+	int retval = sync();
+
+	if (backend == THREAD) {
+		pthread_mutex_lock(&mutex);
+		done = true;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&mutex);
+		pthread_join(thread,0);
+	} else
+		teardownRing();
+
+	// The last block was padded for O_DIRECT
+	if (ftruncate(fd,position)) {
+		ERROR_MSG("DirectWriter::close : failed to truncate the file : %s\n",strerror(errno));
+		retval = -1;
+	}
+	::close(fd);
+	fd = -1;
+
+	return failed ? -1 : retval;
+}
+
+int DirectWriter::write(const void *data,size_t size) {
+	if (fd < 0)
+		return -1;
+
+	const char *p = reinterpret_cast<const char *>(data);
+	while (size) {
+		buffer_t &buffer = buffers[current];
+		size_t n = std::min(size,bufferSize-buffer.used);
+		memcpy(buffer.data+buffer.used,p,n);
+		buffer.used += n;
+		position += n;
+		p += n;
+		size -= n;
+
+		if (buffer.used == bufferSize) {
+			if (submit(current))
+				return -1;
+
+			// Reuse the oldest buffer once its write has finished
+			size_t next = (current+1) % buffers.size();
+			if (wait(next))
+				return -1;
+			buffers[next].offset = buffer.offset+bufferSize;
+			buffers[next].used = 0;
+			current = next;
+		}
+	}
+
+	maybeSync();
+	return failed ? -1 : 0;
+}
+
+int DirectWriter::pad(size_t alignment) {
+	static const char zeros[DIRECT_WRITER_ALIGN] = { 0 };
+
+	size_t n = alignment ? (alignment-position%alignment)%alignment : 0;
+	while (n) {
+		size_t chunk = std::min(n,sizeof(zeros));
+		if (write(zeros,chunk))
+			return -1;
+		n -= chunk;
+	}
+	return 0;
+}
+
+int DirectWriter::writeAt(off_t offset,const void *data,size_t size) {
+	if (fd < 0)
+		return -1;
+	if (offset % DIRECT_WRITER_ALIGN || size % DIRECT_WRITER_ALIGN || offset+static_cast<off_t>(size) > position) {
+		ERROR_MSG("DirectWriter::writeAt : invalid range\n");
+		return -1;
+	}
+
+	if (flush())
+		return -1;
+
+	// Parts that are still buffered are patched in place
+	buffer_t &buffer = buffers[current];
+	const char *p = reinterpret_cast<const char *>(data);
+	if (offset+static_cast<off_t>(size) > buffer.offset) {
+		size_t skip = offset < buffer.offset ? buffer.offset-offset : 0;
+		memcpy(buffer.data+(offset+skip-buffer.offset),p+skip,size-skip);
+		size = skip;
+	}
+	if (!size)
+		return 0;
+
+	// O_DIRECT needs aligned memory as well
+	void *aligned = 0;
+	if (posix_memalign(&aligned,DIRECT_WRITER_ALIGN,size))
+		return -1;
+	memcpy(aligned,p,size);
+
+	int retval = 0;
+	size_t written = 0;
+	while (written < size) {
+		ssize_t n = pwrite(fd,reinterpret_cast<char *>(aligned)+written,size-written,offset+written);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			ERROR_MSG("DirectWriter::writeAt : write failed : %s\n",strerror(errno));
+			retval = -1;
+			break;
+		}
+		written += n;
+	}
+
+	free(aligned);
+	return retval;
+}
+
+int DirectWriter::flush(void) {
+	if (fd < 0)
+		return -1;
+
+	buffer_t &buffer = buffers[current];
+	if (buffer.used && (submit(current) || wait(current)))
+		return -1;
+	if (drain())
+		return -1;
+
+	// Keep the partial block, it is written again once it fills up
+	size_t keep = direct ? buffer.used % DIRECT_WRITER_ALIGN : 0;
+	size_t consumed = buffer.used-keep;
+	if (keep)
+		memmove(buffer.data,buffer.data+consumed,keep);
+	buffer.offset += consumed;
+	buffer.used = keep;
+
+	return failed ? -1 : 0;
+}
+
+int DirectWriter::sync(void) {
+	if (flush())
+		return -1;
+
+	if (fdatasync(fd)) {
+		ERROR_MSG("DirectWriter::sync : fdatasync failed : %s\n",strerror(errno));
+		return -1;
+	}
+	lastSync = now();
+
+	return 0;
+}
+
+// Queue a buffer for writing
+int DirectWriter::submit(size_t i) {
+	buffer_t &buffer = buffers[i];
+
+	// O_DIRECT writes whole blocks, the padding must not carry old data
+	buffer.length = direct ? alignUp(buffer.used) : buffer.used;
+	memset(buffer.data+buffer.used,0,buffer.length-buffer.used);
+	if (!buffer.length)
+		return 0;
+
+	if (backend == THREAD) {
+		pthread_mutex_lock(&mutex);
+		buffer.busy = true;
+		queue.push_back(i);
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+
+#ifdef HAVE_LINUX_IO_URING_H
+	unsigned tail = *sqTail;
+	unsigned index = tail & *sqMask;
+	struct io_uring_sqe *sqe = reinterpret_cast<struct io_uring_sqe *>(sqes)+index;
+
+	memset(sqe,0,sizeof(*sqe));
+	sqe->fd = fd;
+	sqe->off = buffer.offset;
+	sqe->user_data = i;
+	if (fixedBuffers) {
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->addr = reinterpret_cast<unsigned long>(buffer.data);
+		sqe->len = buffer.length;
+		sqe->buf_index = i;
+	} else {
+		buffer.iov.iov_len = buffer.length;
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr = reinterpret_cast<unsigned long>(&buffer.iov);
+		sqe->len = 1;
+	}
+	sqArray[index] = index;
+	__atomic_store_n(sqTail,tail+1,__ATOMIC_RELEASE);
+
+	buffer.busy = true;
+	while (enter(ringFd,1,0,0) < 0)
+		if (errno != EINTR && errno != EAGAIN) {
+			ERROR_MSG("DirectWriter::submit : io_uring_enter failed : %s\n",strerror(errno));
+			buffer.busy = false;
+			failed = true;
+			return -1;
+		}
+#endif
+
+	return 0;
+}
+
+// Wait until a buffer may be reused
+int DirectWriter::wait(size_t i) {
+	if (backend == THREAD) {
+		pthread_mutex_lock(&mutex);
+		while (buffers[i].busy)
+			pthread_cond_wait(&cond,&mutex);
+		pthread_mutex_unlock(&mutex);
+	} else
+		while (buffers[i].busy)
+			if (reap(true))
+				return -1;
+
+	return failed ? -1 : 0;
+}
+
+// Wait for every write and sync in flight
+int DirectWriter::drain(void) {
+	for (size_t i = 0; i < buffers.size(); ++i)
+		if (wait(i))
+			return -1;
+
+	if (backend == THREAD) {
+		pthread_mutex_lock(&mutex);
+		while (syncPending)
+			pthread_cond_wait(&cond,&mutex);
+		pthread_mutex_unlock(&mutex);
+	} else
+		while (syncPending)
+			if (reap(true))
+				return -1;
+
+	return failed ? -1 : 0;
+}
+
+void DirectWriter::complete(size_t i,ssize_t result) {
+	if (result != static_cast<ssize_t>(buffers[i].length)) {
+		ERROR_MSG("DirectWriter::complete : write of %lu bytes failed : %s\n",static_cast<unsigned long>(buffers[i].length),
+				result < 0 ? strerror(-result) : "short write");
+		failed = true;
+	}
+	buffers[i].busy = false;
+}
+
+// Sync in the background once the interval has passed
+void DirectWriter::maybeSync(void) {
+	if (!syncInterval || syncPending || now()-lastSync < syncInterval)
+		return;
+	lastSync = now();
+
+	if (backend == THREAD) {
+		pthread_mutex_lock(&mutex);
+		syncPending = true;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+#ifdef HAVE_LINUX_IO_URING_H
+	// Drain orders the sync after the writes already queued
+	unsigned tail = *sqTail;
+	unsigned index = tail & *sqMask;
+	struct io_uring_sqe *sqe = reinterpret_cast<struct io_uring_sqe *>(sqes)+index;
+
+	memset(sqe,0,sizeof(*sqe));
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->flags = IOSQE_IO_DRAIN;
+	sqe->fd = fd;
+	sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sqe->user_data = SYNC_TAG;
+	sqArray[index] = index;
+	__atomic_store_n(sqTail,tail+1,__ATOMIC_RELEASE);
+
+	syncPending = true;
+	while (enter(ringFd,1,0,0) < 0)
+		if (errno != EINTR && errno != EAGAIN) {
+			syncPending = false;
+			break;
+		}
+#endif
+}
+
+int DirectWriter::setupRing(void) {
+#ifdef HAVE_LINUX_IO_URING_H
+	struct io_uring_params params;
+	memset(&params,0,sizeof(params));
+
+	ringFd = syscall(__NR_io_uring_setup,buffers.size()+1,&params);
+	if (ringFd < 0)
+		return -1;
+
+	sqRingSize = params.sq_off.array+params.sq_entries*sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+	bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single)
+		sqRingSize = cqRingSize = std::max(sqRingSize,cqRingSize);
+
+	sqRing = mmap(0,sqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ringFd,IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED) {
+		sqRing = 0;
+		teardownRing();
+		return -1;
+	}
+
+	cqRing = single ? sqRing : mmap(0,cqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ringFd,IORING_OFF_CQ_RING);
+	if (cqRing == MAP_FAILED) {
+		cqRing = 0;
+		teardownRing();
+		return -1;
+	}
+
+	sqesSize = params.sq_entries*sizeof(struct io_uring_sqe);
+	sqes = mmap(0,sqesSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ringFd,IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		sqes = 0;
+		teardownRing();
+		return -1;
+	}
+
+	char *sq = reinterpret_cast<char *>(sqRing);
+	char *cq = reinterpret_cast<char *>(cqRing);
+	sqHead = reinterpret_cast<unsigned *>(sq+params.sq_off.head);
+	sqTail = reinterpret_cast<unsigned *>(sq+params.sq_off.tail);
+	sqMask = reinterpret_cast<unsigned *>(sq+params.sq_off.ring_mask);
+	sqArray = reinterpret_cast<unsigned *>(sq+params.sq_off.array);
+	cqHead = reinterpret_cast<unsigned *>(cq+params.cq_off.head);
+	cqTail = reinterpret_cast<unsigned *>(cq+params.cq_off.tail);
+	cqMask = reinterpret_cast<unsigned *>(cq+params.cq_off.ring_mask);
+	cqes = cq+params.cq_off.cqes;
+
+	// Registered buffers stay mapped in the kernel, that fails when
+	// they don't fit under RLIMIT_MEMLOCK
+	std::vector<struct iovec> iov(buffers.size());
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		iov[i].iov_base = buffers[i].data;
+		iov[i].iov_len = bufferSize;
+	}
+	fixedBuffers = !syscall(__NR_io_uring_register,ringFd,IORING_REGISTER_BUFFERS,&iov[0],iov.size());
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+void DirectWriter::teardownRing(void) {
+	if (sqes)
+		munmap(sqes,sqesSize);
+	if (cqRing && cqRing != sqRing)
+		munmap(cqRing,cqRingSize);
+	if (sqRing)
+		munmap(sqRing,sqRingSize);
+	if (ringFd >= 0)
+		::close(ringFd);
+
+	ringFd = -1;
+	fixedBuffers = false;
+	sqRing = cqRing = sqes = 0;
+}
+
+// Collect finished io_uring requests, optionally waiting for one
+int DirectWriter::reap(bool block) {
+#ifdef HAVE_LINUX_IO_URING_H
+	for (;;) {
+		unsigned head = *cqHead;
+		unsigned tail = __atomic_load_n(cqTail,__ATOMIC_ACQUIRE);
+		bool reaped = head != tail;
+
+		for (; head != tail; ++head) {
+			struct io_uring_cqe *cqe = reinterpret_cast<struct io_uring_cqe *>(cqes)+(head & *cqMask);
+			if (cqe->user_data == SYNC_TAG) {
+				if (cqe->res < 0)
+					ERROR_MSG("DirectWriter::reap : fdatasync failed : %s\n",strerror(-cqe->res));
+				syncPending = false;
+			} else
+				complete(cqe->user_data,cqe->res);
+		}
+		__atomic_store_n(cqHead,head,__ATOMIC_RELEASE);
+
+		if (reaped || !block)
+			return 0;
+
+		if (enter(ringFd,0,1,IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+			ERROR_MSG("DirectWriter::reap : io_uring_enter failed : %s\n",strerror(errno));
+			failed = true;
+			return -1;
+		}
+	}
+#else
+	return -1;
+#endif
+}
+
+void *DirectWriter::bounce(void *that) {
+	reinterpret_cast<DirectWriter *>(that)->processBuffers();
+	return 0;
+}
+
+// Background thread used when io_uring is not available
+void DirectWriter::processBuffers(void) {
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (queue.empty() && !syncPending && !done)
+			pthread_cond_wait(&cond,&mutex);
+
+		if (!queue.empty()) {
+			size_t i = queue.front();
+			queue.erase(queue.begin());
+			buffer_t &buffer = buffers[i];
+			pthread_mutex_unlock(&mutex);
+
+			ssize_t result = 0;
+			while (result < static_cast<ssize_t>(buffer.length)) {
+				ssize_t n = pwrite(fd,buffer.data+result,buffer.length-result,buffer.offset+result);
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n <= 0) {
+					result = n < 0 ? -errno : result;
+					break;
+				}
+				result += n;
+			}
+
+			// Without O_DIRECT, write the range back now and drop it from the cache
+			if (!direct && result > 0) {
+				sync_file_range(fd,buffer.offset,result,SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+				posix_fadvise(fd,buffer.offset,result,POSIX_FADV_DONTNEED);
+			}
+
+			pthread_mutex_lock(&mutex);
+			complete(i,result);
+			pthread_cond_broadcast(&cond);
+		} else if (syncPending) {
+			pthread_mutex_unlock(&mutex);
+			if (fdatasync(fd))
+				ERROR_MSG("DirectWriter::processBuffers : fdatasync failed : %s\n",strerror(errno));
+			pthread_mutex_lock(&mutex);
+			syncPending = false;
+			pthread_cond_broadcast(&cond);
+		} else if (done)
+			break;
+	}
+	pthread_mutex_unlock(&mutex);
+}
@@ -23,7 +23,8 @@
 
 #define AVAILABLE    ((size+wptr-rptr)%size)
 
-Fifo::Fifo(size_t s):rptr(0), wptr(0), size(s) {
+Fifo::Fifo(size_t s,const std::string &name)
+	: FifoMonitor::Source(name), rptr(0), wptr(0), size(s) {
 	data = new char[size];
 
 	pthread_mutex_init(&mutex,NULL);
@@ -31,6 +32,8 @@ Fifo::Fifo(size_t s):rptr(0), wptr(0), size(s) {
 }
 
 Fifo::~Fifo(void) {
+	unregisterSource();
+
 	if (data) delete[] data;
 
 	pthread_mutex_destroy(&mutex);
@@ -63,6 +66,7 @@ size_t Fifo::read(void *buffer,size_t n,bool blocking) {
 	} else
 		memcpy(buffer,data+rptr,n);
 	rptr = (rptr+n)%size;
+	counters.consumed(AVAILABLE);
 
 	pthread_mutex_unlock(&mutex);
 	return n;
@@ -70,6 +74,7 @@ size_t Fifo::read(void *buffer,size_t n,bool blocking) {
 
 size_t Fifo::write(const void *buffer,size_t n) {
 	if (n >= size-AVAILABLE) {
+		counters.failed();
 		ERROR_MSG("Fifo::write : fifo full, data lost\n");
 		return 0;
 	}
@@ -81,8 +86,19 @@ size_t Fifo::write(const void *buffer,size_t n) {
 	} else
 		memcpy(data+wptr,buffer,n);
 	wptr = (wptr+n)%size;
+	counters.wrote(AVAILABLE);
 
 	pthread_cond_signal(&data_available);
 
 	return n;
 }
+
+void Fifo::getStats(FifoMonitor::stats_t &stats) const {
+	stats.capacity = size;
+	stats.used = AVAILABLE;
+	counters.fill(stats);
+}
+
+void Fifo::resetStats(void) {
+	counters.reset();
+}
@@ -0,0 +1,153 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <debug.h>
+#include <fifo_monitor.h>
+#include <rt.h>
+
+FifoMonitor::Counters::Counters(void)
+	: highWater(0), failedWrites(0), maxStall(0), lastRead(-1) {}
+
+void FifoMonitor::Counters::reset(void) {
+	highWater.store(0,std::memory_order_relaxed);
+	failedWrites.store(0,std::memory_order_relaxed);
+	maxStall.store(0,std::memory_order_relaxed);
+}
+
+void FifoMonitor::Counters::wrote(size_t used) {
+	size_t peak = highWater.load(std::memory_order_relaxed);
+	while (used > peak && !highWater.compare_exchange_weak(peak,used,std::memory_order_relaxed));
+}
+
+void FifoMonitor::Counters::failed(void) {
+	failedWrites.fetch_add(1,std::memory_order_relaxed);
+}
+
+void FifoMonitor::Counters::consumed(size_t remaining) {
+	long long now = RT::OS::getTime();
+
+	/*
+	 * Only the gap after a read that left data behind counts as a stall,
+	 *   otherwise an idle consumer would look like a slow one.
+	 */
+	if (lastRead >= 0 && now-lastRead > maxStall.load(std::memory_order_relaxed))
+		maxStall.store(now-lastRead,std::memory_order_relaxed);
+
+	lastRead = remaining ? now : -1;
+}
+
+void FifoMonitor::Counters::fill(stats_t &stats) const {
+	stats.highWater = highWater.load(std::memory_order_relaxed);
+	stats.failedWrites = failedWrites.load(std::memory_order_relaxed);
+	stats.maxStall = maxStall.load(std::memory_order_relaxed);
+}
+
+FifoMonitor::Source::Source(const std::string &n)
+	: name(n), registered(true) {
+		Manager::getInstance()->insertSource(this);
+	}
+
+FifoMonitor::Source::~Source(void) {
+	unregisterSource();
+}
+
+std::string FifoMonitor::Source::getName(void) const {
+	Mutex::Locker lock(&Manager::getInstance()->mutex);
+	return name;
+}
+
+void FifoMonitor::Source::setName(const std::string &n) {
+	Mutex::Locker lock(&Manager::getInstance()->mutex);
+	name = n;
+}
+
+void FifoMonitor::Source::unregisterSource(void) {
+	if (!registered)
+		return;
+
+	Manager::getInstance()->removeSource(this);
+	registered = false;
+}
+
+void FifoMonitor::Manager::foreachFifo(void (*callback)(Source *,const stats_t &,void *),void *param) {
+	Mutex::Locker lock(&mutex);
+	for (std::list<Source *>::iterator i = sourceList.begin(),end = sourceList.end(); i != end; ++i) {
+		stats_t stats;
+		(*i)->getStats(stats);
+		callback(*i,stats,param);
+	}
+}
+
+bool FifoMonitor::Manager::getStats(const std::string &name,stats_t &stats) {
+	Mutex::Locker lock(&mutex);
+	for (std::list<Source *>::iterator i = sourceList.begin(),end = sourceList.end(); i != end; ++i)
+		if ((*i)->name == name) {
+			(*i)->getStats(stats);
+			return true;
+		}
+
+	return false;
+}
+
+void FifoMonitor::Manager::resetAll(void) {
+	Mutex::Locker lock(&mutex);
+	for (std::list<Source *>::iterator i = sourceList.begin(),end = sourceList.end(); i != end; ++i)
+		(*i)->resetStats();
+}
+
+void FifoMonitor::Manager::insertSource(Source *source) {
+	if (!source) {
+		ERROR_MSG("FifoMonitor::Manager::insertSource : invalid source\n");
+		return;
+	}
+
+	Mutex::Locker lock(&mutex);
+	sourceList.push_back(source);
+}
+
+void FifoMonitor::Manager::removeSource(Source *source) {
+	if (!source) {
+		ERROR_MSG("FifoMonitor::Manager::removeSource : invalid source\n");
+		return;
+	}
+
+	Mutex::Locker lock(&mutex);
+	sourceList.remove(source);
+}
+
+static Mutex mutex;
+FifoMonitor::Manager *FifoMonitor::Manager::instance = 0;
+
+FifoMonitor::Manager *FifoMonitor::Manager::getInstance(void) {
+	if (instance)
+		return instance;
+
+	/*************************************************************************
+	 * Seems like alot of hoops to jump through, but static allocation isn't *
+	 *   thread-safe. So effort must be taken to ensure mutual exclusion.    *
+	 *************************************************************************/
+
+	Mutex::Locker lock(&::mutex);
+	if (!instance) {
+		static Manager manager;
+		instance = &manager;
+	}
+
+	return instance;
+}
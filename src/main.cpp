@@ -34,16 +34,21 @@
 #include <debug.h>
 #include <main_window.h>
 #include <plugin.h>
+#include <rt_memory.h>
 
 #ifdef _RTUTILS_H
 #include <rtdk.h>
 #endif
 
+// Largest -s value accepted, in kB; it is clamped to the stack size anyway
+#define STACK_PREFAULT_MAX (1024*1024)
+
 static pid_t parentThread;
 
 struct cli_options_t {
 	std::string config_file;
 	std::string plugins_path;
+	long stack_prefault;
 };
 
 static bool parse_cli_options(int,char *[],cli_options_t *);
@@ -65,9 +70,13 @@ int main(int argc,char *argv[]) {
 
 	/* Handle Command-Line Options */
 	cli_options_t cli_options;
+	cli_options.stack_prefault = -1;
 	if (!parse_cli_options(argc,argv,&cli_options))
 		return -EINVAL;
 
+	if (cli_options.stack_prefault >= 0)
+		RTMemory::setStackDepth(cli_options.stack_prefault*1024);
+
 	/* Find Configuration File */
 	std::string config_file;
 	if (cli_options.config_file.length())
@@ -108,9 +117,10 @@ static void error_msg(const std::string &self) {
 static void help_msg(const std::string &self) {
 	std::cout << "Usage: " << self << " [options]\n";
 	std::cout << "  where options include:\n";
-	std::cout << "    --help,         -h  - Displays this message\n";
-	std::cout << "    --config-file,  -c  - Pick a custom configuration file\n";
-	std::cout << "    --plugins-path, -p  - Specify a plugins directory\n";
+	std::cout << "    --help,           -h  - Displays this message\n";
+	std::cout << "    --config-file,    -c  - Pick a custom configuration file\n";
+	std::cout << "    --plugins-path,   -p  - Specify a plugins directory\n";
+	std::cout << "    --stack-prefault, -s  - kB of realtime stack to fault in at start-up\n";
 }
 
 static bool parse_cli_options(int argc,char *argv[],cli_options_t *cli_options) {
@@ -121,11 +131,12 @@ static bool parse_cli_options(int argc,char *argv[],cli_options_t *cli_options)
 		{ "config-file", required_argument, 0, 'c' },
 		{ "plugins-path", required_argument, 0, 'p' },
 		{ "models-path",  required_argument, 0, 'm' },
+		{ "stack-prefault", required_argument, 0, 's' },
 		{ 0,0,0,0 }
 	};
 
 	for (;;) {
-		opt = getopt_long(argc,argv,"hc:p:m:",options,&index);
+		opt = getopt_long(argc,argv,"hc:p:m:s:",options,&index);
 
 		if (opt < 0) break;
 
@@ -139,6 +150,19 @@ static bool parse_cli_options(int argc,char *argv[],cli_options_t *cli_options)
 			case 'p':
 				cli_options->plugins_path = optarg;
 				break;
+			case 's': {
+				char *end;
+				errno = 0;
+				cli_options->stack_prefault = strtol(optarg,&end,10);
+				if (errno || end == optarg || *end || cli_options->stack_prefault < 0
+						|| cli_options->stack_prefault > STACK_PREFAULT_MAX) {
+					std::cout << argv[0] << ": invalid stack prefault \'" << optarg << "\', expected 0 to "
+						<< STACK_PREFAULT_MAX << " kB\n";
+					error_msg(argv[0]);
+					return false;
+				}
+				break;
+			}
 			default:
 				error_msg(argv[0]);
 				return false;
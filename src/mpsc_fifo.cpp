@@ -0,0 +1,155 @@
+/*
+ Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <debug.h>
+#include <mpsc_fifo.h>
+#include <new>
+#include <string.h>
+#include <stdint.h>
+
+MpscFifo::MpscFifo(size_t size, size_t count, const std::string &name)
+    : FifoMonitor::Source(name), slotSize(size), quiet(false), enqueuePos(0), dequeuePos(0) {
+    // Round the slot count up to a power of two so positions wrap with a mask
+    for(slotCount = 2; slotCount < count; slotCount <<= 1);
+    mask = slotCount - 1;
+
+    // Keep every slot header aligned for the atomic sequence number
+    slotStride = (sizeof(slot_t) + slotSize + alignof(slot_t) - 1) & ~(alignof(slot_t) - 1);
+
+    data = new char[slotStride * slotCount];
+    for(size_t i = 0; i < slotCount; ++i) {
+        slot_t *s = new (data + i * slotStride) slot_t;
+        s->sequence.store(i, std::memory_order_relaxed);
+        s->size = 0;
+    }
+}
+
+MpscFifo::~MpscFifo(void) {
+    unregisterSource();
+    if(data) delete[] data;
+}
+
+MpscFifo::slot_t *MpscFifo::getSlot(size_t pos) const {
+    return reinterpret_cast<slot_t *>(data + (pos & mask) * slotStride);
+}
+
+char *MpscFifo::getData(slot_t *s) const {
+    return reinterpret_cast<char *>(s) + sizeof(slot_t);
+}
+
+size_t MpscFifo::used(size_t enqueue) const {
+    size_t pending = enqueue - dequeuePos.load(std::memory_order_relaxed);
+    return (pending > slotCount ? slotCount : pending) * slotSize;
+}
+
+MpscFifo::slot_t *MpscFifo::claim(size_t itemSize) {
+    if(itemSize > slotSize) {
+        counters.failed();
+        if(!quiet)
+            ERROR_MSG("MpscFifo::write : item larger than slot, data lost\n");
+        return 0;
+    }
+
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for(;;) {
+        slot_t *s = getSlot(pos);
+        size_t seq = s->sequence.load(std::memory_order_acquire);
+        intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+        if(dif == 0) { // Slot is free, try to take the ticket
+            if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                counters.wrote(used(pos + 1));
+                return s;
+            }
+        } else if(dif < 0) { // Consumer has not released this slot yet
+            counters.failed();
+            if(!quiet)
+                ERROR_MSG("MpscFifo::write : fifo full, data lost\n");
+            return 0;
+        } else // Another producer took the ticket first
+            pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+}
+
+bool MpscFifo::write(const void *buffer, size_t itemSize) {
+    slot_t *s = claim(itemSize);
+    if(!s)
+        return false;
+
+    size_t pos = s->sequence.load(std::memory_order_relaxed);
+    memcpy(getData(s), buffer, itemSize);
+    s->size = itemSize;
+    s->sequence.store(pos + 1, std::memory_order_release); // Publish to the consumer
+
+    return true;
+}
+
+bool MpscFifo::write(const void *header, size_t headerSize, const void *payload, size_t payloadSize) {
+    slot_t *s = claim(headerSize + payloadSize);
+    if(!s)
+        return false;
+
+    size_t pos = s->sequence.load(std::memory_order_relaxed);
+    memcpy(getData(s), header, headerSize);
+    memcpy(getData(s) + headerSize, payload, payloadSize);
+    s->size = headerSize + payloadSize;
+    s->sequence.store(pos + 1, std::memory_order_release); // Publish to the consumer
+
+    return true;
+}
+
+size_t MpscFifo::read(void *buffer, size_t maxItems, size_t *sizes) { // It is an absolute requirement only one thread calls read
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    size_t n = 0;
+    for(; n < maxItems; ++n, ++pos) {
+        slot_t *s = getSlot(pos);
+
+        // Stop at the first slot that is not published yet, even if later
+        // slots are, so that producer ordering is preserved
+        if(s->sequence.load(std::memory_order_acquire) != pos + 1)
+            break;
+
+        memcpy(reinterpret_cast<char *>(buffer) + n * slotSize, getData(s), s->size);
+        if(sizes)
+            sizes[n] = s->size;
+
+        // Hand the slot back to producers one lap ahead
+        s->sequence.store(pos + slotCount, std::memory_order_release);
+    }
+
+    if(n) {
+        dequeuePos.store(pos, std::memory_order_relaxed);
+        counters.consumed(used(enqueuePos.load(std::memory_order_relaxed)));
+    }
+
+    return n;
+}
+
+void MpscFifo::getStats(FifoMonitor::stats_t &stats) const {
+    stats.capacity = slotSize * slotCount;
+    stats.used = used(enqueuePos.load(std::memory_order_relaxed));
+    counters.fill(stats);
+}
+
+void MpscFifo::resetStats(void) {
+    counters.reset();
+}
+
+bool MpscFifo::isLockFree() const {
+    return enqueuePos.is_lock_free() && getSlot(0)->sequence.is_lock_free();
+}
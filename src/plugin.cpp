@@ -22,8 +22,9 @@
 #include <dlfcn.h>
 #include <event.h>
 #include <plugin.h>
+#include <rt_memory.h>
 
-Plugin::Object::Object(void) : magic_number(Plugin::Object::MAGIC_NUMBER), handle(0) {
+Plugin::Object::Object(void) : magic_number(Plugin::Object::MAGIC_NUMBER), handle(0), imageSize(0), lockedMemory(0) {
 	Plugin::Manager::getInstance()->insertPlugin(this);
 }
 
@@ -35,6 +36,14 @@ std::string Plugin::Object::getLibrary(void) const {
 	return library;
 }
 
+size_t Plugin::Object::getImageSize(void) const {
+	return imageSize;
+}
+
+size_t Plugin::Object::getLockedMemory(void) const {
+	return lockedMemory;
+}
+
 void Plugin::Object::unload(void) {
 	Plugin::Manager::getInstance()->unload(this);
 }
@@ -52,6 +61,10 @@ Plugin::Object *Plugin::Manager::load(const QString &library) {
 		return 0;
 	}
 
+	// Fault in and lock the plugin before any of its code can run in realtime
+	RTMemory::region_stats_t image;
+	RTMemory::lockLibrary(handle,image);
+
 	/*********************************************************************************
 	 * Apparently ISO C++ forbids against casting object pointer -> function pointer *
 	 *   But what the hell do they know? It is probably safe here...                 *
@@ -78,6 +91,8 @@ Plugin::Object *Plugin::Manager::load(const QString &library) {
 
 	plugin->handle = handle;
 	plugin->library = library.toStdString();
+	plugin->imageSize = image.size;
+	plugin->lockedMemory = image.locked;
 
 	Event::Object event(Event::PLUGIN_INSERT_EVENT);
 	event.setParam("plugin",plugin);
@@ -21,6 +21,9 @@
 #include <event.h>
 #include <mutex.h>
 #include <rt.h>
+#include <rt_diagnostics.h>
+#include <rt_log.h>
+#include <rt_memory.h>
 //#include <native/task.h>
 
 //#define DEBUG_RT
@@ -145,7 +148,7 @@ void RT::Thread::setActive(bool state) {
 }
 
 RT::System::System(void)
-	: finished(false), eventFifo(100*sizeof(RT::Event *)) {
+	: finished(false), eventFifo(100*sizeof(RT::Event *),"RT::System events") {
 		period = 1000000; // 1 kHz
 
 		if (RT::OS::initiate()) {
@@ -153,6 +156,9 @@ RT::System::System(void)
 			return;
 		}
 
+		if (RTLog::start())
+			ERROR_MSG("RT::System::System : failed to start the realtime log, realtime messages will be lost\n");
+
 		if (RT::OS::createTask(&task,&System::bounce,this)) {
 			ERROR_MSG("RT::System::System : failed to create realtime thread\n");
 			return;
@@ -162,6 +168,7 @@ RT::System::System(void)
 RT::System::~System(void) {
 	finished = true;
 	RT::OS::deleteTask(task);
+	RTLog::stop();
 	RT::OS::shutdown();
 }
 
@@ -275,6 +282,10 @@ void *RT::System::bounce(void *param) {
 	rt_task_set_mode(0, T_WARNSW, NULL);
 #endif
 
+	// Fault in the stack now rather than in the first ticks
+	RTMemory::region_stats_t stack;
+	RTMemory::prefaultStack(stack);
+
 	RT::System *that = reinterpret_cast<RT::System *>(param);
 	if (that)
 		that->execute();
@@ -299,14 +310,32 @@ void RT::System::execute(void) {
 	while (!finished) {
 		RT::OS::sleepTimestep(task);
 
-		for (iDevice = devicesBegin; iDevice != devicesEnd; ++iDevice)
-			if (iDevice->getActive()) iDevice->read();
+		/*****************************************************************
+		 * Tracing hooks for RTDiagnostics, they record which object is  *
+		 *   running. Only taken while the diagnostics are switched on.  *
+		 *****************************************************************/
+
+		if (RTDiagnostics::beginTick()) {
+			for (iDevice = devicesBegin; iDevice != devicesEnd; ++iDevice)
+				if (iDevice->getActive()) { RTDiagnostics::enter(&*iDevice); iDevice->read(); }
+
+			for (iThread = threadListBegin; iThread != threadListEnd; ++iThread)
+				if (iThread->getActive()) { RTDiagnostics::enter(&*iThread); iThread->execute(); }
 
-		for (iThread = threadListBegin; iThread != threadListEnd; ++iThread)
-			if (iThread->getActive()) iThread->execute();
+			for (iDevice = devicesBegin; iDevice != devicesEnd; ++iDevice)
+				if (iDevice->getActive()) { RTDiagnostics::enter(&*iDevice); iDevice->write(); }
 
-		for (iDevice = devicesBegin; iDevice != devicesEnd; ++iDevice)
-			if (iDevice->getActive()) iDevice->write();
+			RTDiagnostics::leave();
+		} else {
+			for (iDevice = devicesBegin; iDevice != devicesEnd; ++iDevice)
+				if (iDevice->getActive()) iDevice->read();
+
+			for (iThread = threadListBegin; iThread != threadListEnd; ++iThread)
+				if (iThread->getActive()) iThread->execute();
+
+			for (iDevice = devicesBegin; iDevice != devicesEnd; ++iDevice)
+				if (iDevice->getActive()) iDevice->write();
+		}
 
 		if (eventFifo.read(&event,sizeof(RT::Event *),false)) {
 			do {
@@ -317,6 +346,8 @@ void RT::System::execute(void) {
 			devicesBegin = devices.begin();
 			threadListBegin = threadList.begin();
 		}
+
+		RTDiagnostics::endTick();
 	}
 }
 
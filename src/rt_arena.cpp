@@ -0,0 +1,127 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <debug.h>
+#include <mutex.h>
+#include <rt_arena.h>
+
+#include <list>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+namespace {
+
+	Mutex arenaMutex;
+	std::list<RT::Arena *> arenaList;
+
+}; // namespace
+
+RT::Arena::Arena(const std::string &o,const std::string &n,size_t s,bool huge)
+	: owner(o), name(n), base(0), size(0), mapped(0), hugePages(false), locked(false), used(0), failed(0) {
+		void *p = MAP_FAILED;
+		size_t pageSize = sysconf(_SC_PAGESIZE);
+
+#ifdef MAP_HUGETLB
+		if (huge) {
+			mapped = (s+HUGE_PAGE_SIZE-1) & ~static_cast<size_t>(HUGE_PAGE_SIZE-1);
+			p = mmap(0,mapped,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,-1,0);
+			if (p != MAP_FAILED)
+				hugePages = true;
+			else
+				DEBUG_MSG("RT::Arena::Arena : no huge pages available for %s, using normal pages\n",name.c_str());
+		}
+#endif
+
+		if (p == MAP_FAILED) {
+			mapped = (s+pageSize-1) & ~(pageSize-1);
+			p = mmap(0,mapped,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,-1,0);
+		}
+
+		if (p == MAP_FAILED) {
+			ERROR_MSG("RT::Arena::Arena : failed to map %lu bytes for %s\n",static_cast<unsigned long>(s),name.c_str());
+			mapped = 0;
+			return;
+		}
+
+#ifdef MADV_HUGEPAGE
+		if (huge && !hugePages)
+			madvise(p,mapped,MADV_HUGEPAGE);
+#endif
+
+		base = reinterpret_cast<char *>(p);
+		size = mapped;
+
+		// MAP_POPULATE is only a hint, write every page so none faults later
+		for (size_t i = 0; i < mapped; i += pageSize)
+			base[i] = 0;
+
+		if (!mlock(base,mapped))
+			locked = true;
+		else
+			ERROR_MSG("RT::Arena::Arena : failed to lock %s, check RLIMIT_MEMLOCK\n",name.c_str());
+
+		Mutex::Locker lock(&arenaMutex);
+		arenaList.push_back(this);
+	}
+
+RT::Arena::~Arena(void) {
+	if (!base)
+		return;
+
+	{
+		Mutex::Locker lock(&arenaMutex);
+		arenaList.remove(this);
+	}
+
+	if (locked)
+		munlock(base,mapped);
+	munmap(base,mapped);
+}
+
+void *RT::Arena::allocate(size_t n,size_t alignment) {
+	size_t offset = used.load(std::memory_order_relaxed);
+	size_t start;
+
+	do {
+		start = (offset+alignment-1) & ~(alignment-1);
+		if (!base || start+n > size) {
+			failed.fetch_add(1,std::memory_order_relaxed);
+			return 0;
+		}
+	} while (!used.compare_exchange_weak(offset,start+n,std::memory_order_relaxed));
+
+	return base+start;
+}
+
+void RT::Arena::getStats(stats_t &stats) const {
+	stats.size = size;
+	stats.used = used.load(std::memory_order_relaxed);
+	stats.failed = failed.load(std::memory_order_relaxed);
+	stats.hugePages = hugePages;
+	stats.locked = locked;
+}
+
+void RT::Arena::foreachArena(void (*callback)(Arena *,void *),void *param) {
+	Mutex::Locker lock(&arenaMutex);
+	for (std::list<Arena *>::iterator i = arenaList.begin(),end = arenaList.end(); i != end; ++i)
+		callback(*i,param);
+}
@@ -0,0 +1,376 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <debug.h>
+#include <io.h>
+#include <rt.h>
+#include <rt_diagnostics.h>
+
+#include <new>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <typeinfo>
+
+extern "C" {
+	void *__libc_malloc(size_t);
+	void *__libc_calloc(size_t,size_t);
+	void *__libc_realloc(void *,size_t);
+	void __libc_free(void *);
+}
+
+namespace {
+
+	/*********************************************************************
+	 * Everything here is either constant or zero initialized, so the    *
+	 *   allocation hooks are safe to run before static constructors.    *
+	 *********************************************************************/
+
+	struct entry_t {
+		const void *object;
+		RTDiagnostics::kind_t kind;
+		std::atomic<size_t> allocations;
+		std::atomic<size_t> frees;
+		std::atomic<size_t> bytes;
+		std::atomic<size_t> minorFaults;
+		std::atomic<size_t> majorFaults;
+	};
+
+	std::atomic<bool> enabled(false);
+	std::atomic<bool> resetPending(false);
+
+	// Written by the realtime thread only
+	entry_t entries[RTDIAG_MAX_OBJECTS];    // entries[0] is RT::System
+	std::atomic<size_t> nentries(1);
+	entry_t *current = entries;
+	bool tracing = false;
+	long lastMinor, lastMajor;
+	size_t tickFaults;
+
+	std::atomic<size_t> ticks(0);
+	std::atomic<size_t> faultTicks(0);
+	std::atomic<size_t> maxFaults(0);
+	std::atomic<size_t> allocations(0);
+
+	__thread bool inHook = false;
+
+	const char *kindName(RTDiagnostics::kind_t kind) {
+		switch (kind) {
+			case RTDiagnostics::DEVICE: return "RT::Device";
+			case RTDiagnostics::THREAD: return "RT::Thread";
+			default:                    return "RT::System";
+		}
+	}
+
+	void add(std::atomic<size_t> &counter,size_t n) {
+		counter.store(counter.load(std::memory_order_relaxed)+n,std::memory_order_relaxed);
+	}
+
+	void clear(void) {
+		for (size_t i = 0; i < RTDIAG_MAX_OBJECTS; ++i) {
+			entries[i].allocations.store(0,std::memory_order_relaxed);
+			entries[i].frees.store(0,std::memory_order_relaxed);
+			entries[i].bytes.store(0,std::memory_order_relaxed);
+			entries[i].minorFaults.store(0,std::memory_order_relaxed);
+			entries[i].majorFaults.store(0,std::memory_order_relaxed);
+		}
+		nentries.store(1,std::memory_order_release);
+		ticks.store(0,std::memory_order_relaxed);
+		faultTicks.store(0,std::memory_order_relaxed);
+		maxFaults.store(0,std::memory_order_relaxed);
+		allocations.store(0,std::memory_order_relaxed);
+	}
+
+	entry_t *lookup(const void *object,RTDiagnostics::kind_t kind) {
+		size_t n = nentries.load(std::memory_order_relaxed);
+		for (size_t i = 1; i < n; ++i)
+			if (entries[i].object == object)
+				return &entries[i];
+
+		// Out of room, charge the rest to RT::System
+		if (n == RTDIAG_MAX_OBJECTS)
+			return entries;
+
+		entries[n].object = object;
+		entries[n].kind = kind;
+		nentries.store(n+1,std::memory_order_release);
+		return &entries[n];
+	}
+
+	/*
+	 * Charge the faults taken since the last sample to the current object.
+	 */
+	void sample(bool charge) {
+		struct rusage ru;
+		if (getrusage(RUSAGE_THREAD,&ru))
+			return;
+
+		if (charge) {
+			size_t minor = ru.ru_minflt-lastMinor;
+			size_t major = ru.ru_majflt-lastMajor;
+			if (minor) add(current->minorFaults,minor);
+			if (major) add(current->majorFaults,major);
+			tickFaults += minor+major;
+		}
+
+		lastMinor = ru.ru_minflt;
+		lastMajor = ru.ru_majflt;
+	}
+
+	void switchTo(const void *object,RTDiagnostics::kind_t kind) {
+		if (!tracing)
+			return;
+		sample(true);
+		current = lookup(object,kind);
+	}
+
+	void heapCall(const char *what,size_t size,bool isFree) {
+		if (!enabled.load(std::memory_order_relaxed) || inHook || !RT::OS::isRealtime())
+			return;
+
+		inHook = true;
+		entry_t *e = current;
+		if (isFree)
+			add(e->frees,1);
+		else {
+			add(e->allocations,1);
+			add(e->bytes,size);
+		}
+		allocations.fetch_add(1,std::memory_order_relaxed);
+
+		// RTLog copies the record into a preallocated ring, so this does not recurse
+		if (isFree)
+			ERROR_MSG("RTDiagnostics : %s in realtime by %s %p\n",what,kindName(e->kind),e->object);
+		else
+			ERROR_MSG("RTDiagnostics : %s of %lu bytes in realtime by %s %p\n",what,static_cast<unsigned long>(size),kindName(e->kind),e->object);
+		inHook = false;
+	}
+
+	struct describe_t {
+		const void *object;
+		std::string name;
+	};
+
+	std::string blockName(IO::Block *block) {
+		std::ostringstream str;
+		str << block->getName() << " " << block->getID();
+		return str.str();
+	}
+
+	void describeDevice(RT::Device *device,void *param) {
+		describe_t *info = reinterpret_cast<describe_t *>(param);
+		if (device != info->object)
+			return;
+		IO::Block *block = dynamic_cast<IO::Block *>(device);
+		info->name = block ? blockName(block) : typeid(*device).name();
+	}
+
+	void describeThread(RT::Thread *thread,void *param) {
+		describe_t *info = reinterpret_cast<describe_t *>(param);
+		if (thread != info->object)
+			return;
+		IO::Block *block = dynamic_cast<IO::Block *>(thread);
+		info->name = block ? blockName(block) : typeid(*thread).name();
+	}
+
+	void printObject(const RTDiagnostics::object_stats_t &stats,void *) {
+		fprintf(stderr,"  %-32s allocations %lu (%lu bytes) frees %lu minor faults %lu major faults %lu\n",
+				RTDiagnostics::describe(stats).c_str(),
+				static_cast<unsigned long>(stats.allocations),static_cast<unsigned long>(stats.bytes),
+				static_cast<unsigned long>(stats.frees),static_cast<unsigned long>(stats.minorFaults),
+				static_cast<unsigned long>(stats.majorFaults));
+	}
+
+}; // namespace
+
+void RTDiagnostics::setEnabled(bool state) {
+	if (state && !enabled.load())
+		reset();
+	enabled.store(state);
+	if (!state)
+		report();
+}
+
+bool RTDiagnostics::isEnabled(void) {
+	return enabled.load();
+}
+
+void RTDiagnostics::reset(void) {
+	resetPending.store(true);
+}
+
+void RTDiagnostics::foreachObject(void (*callback)(const object_stats_t &,void *),void *param) {
+	size_t n = nentries.load(std::memory_order_acquire);
+	for (size_t i = 0; i < n; ++i) {
+		object_stats_t stats;
+		stats.object = i ? entries[i].object : 0;
+		stats.kind = i ? entries[i].kind : SYSTEM;
+		stats.allocations = entries[i].allocations.load(std::memory_order_relaxed);
+		stats.frees = entries[i].frees.load(std::memory_order_relaxed);
+		stats.bytes = entries[i].bytes.load(std::memory_order_relaxed);
+		stats.minorFaults = entries[i].minorFaults.load(std::memory_order_relaxed);
+		stats.majorFaults = entries[i].majorFaults.load(std::memory_order_relaxed);
+
+		if (stats.allocations || stats.frees || stats.minorFaults || stats.majorFaults)
+			callback(stats,param);
+	}
+}
+
+void RTDiagnostics::getTickStats(tick_stats_t &stats) {
+	stats.ticks = ticks.load(std::memory_order_relaxed);
+	stats.faultTicks = faultTicks.load(std::memory_order_relaxed);
+	stats.maxFaults = maxFaults.load(std::memory_order_relaxed);
+	stats.allocations = allocations.load(std::memory_order_relaxed);
+}
+
+std::string RTDiagnostics::describe(const object_stats_t &stats) {
+	describe_t info = { stats.object, "" };
+
+	if (stats.kind == DEVICE)
+		RT::System::getInstance()->foreachDevice(describeDevice,&info);
+	else if (stats.kind == THREAD)
+		RT::System::getInstance()->foreachThread(describeThread,&info);
+	else
+		return "RT::System";
+
+	if (info.name.empty()) {
+		std::ostringstream str;
+		str << kindName(stats.kind) << " " << stats.object << " (removed)";
+		return str.str();
+	}
+	return info.name;
+}
+
+void RTDiagnostics::report(void) {
+	tick_stats_t stats;
+	getTickStats(stats);
+
+	fprintf(stderr,"RTDiagnostics : %lu ticks traced, %lu with page faults (at most %lu in one tick), %lu heap calls in realtime\n",
+			static_cast<unsigned long>(stats.ticks),static_cast<unsigned long>(stats.faultTicks),
+			static_cast<unsigned long>(stats.maxFaults),static_cast<unsigned long>(stats.allocations));
+	foreachObject(printObject,0);
+}
+
+bool RTDiagnostics::beginTick(void) {
+	if (!enabled.load(std::memory_order_relaxed)) {
+		tracing = false;
+		return false;
+	}
+
+	if (resetPending.exchange(false))
+		clear();
+
+	// Faults while sleeping between ticks are not of interest
+	sample(false);
+	tracing = true;
+	current = entries;
+	tickFaults = 0;
+
+	return true;
+}
+
+void RTDiagnostics::enter(const RT::Device *device) {
+	switchTo(device,DEVICE);
+}
+
+void RTDiagnostics::enter(const RT::Thread *thread) {
+	switchTo(thread,THREAD);
+}
+
+void RTDiagnostics::leave(void) {
+	if (!tracing)
+		return;
+	sample(true);
+	current = entries;
+}
+
+void RTDiagnostics::endTick(void) {
+	if (!tracing)
+		return;
+	sample(true);
+	current = entries;
+
+	add(ticks,1);
+	if (tickFaults) {
+		add(faultTicks,1);
+		if (tickFaults > maxFaults.load(std::memory_order_relaxed))
+			maxFaults.store(tickFaults,std::memory_order_relaxed);
+	}
+}
+
+/******************************************************************
+ * Heap interposition. The rtxi binary is linked with -rdynamic,  *
+ *   so these also replace the allocator for every loaded plugin. *
+ ******************************************************************/
+
+extern "C" void *malloc(size_t size) {
+	heapCall("malloc",size,false);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n,size_t size) {
+	heapCall("calloc",n*size,false);
+	return __libc_calloc(n,size);
+}
+
+extern "C" void *realloc(void *ptr,size_t size) {
+	heapCall("realloc",size,false);
+	return __libc_realloc(ptr,size);
+}
+
+extern "C" void free(void *ptr) {
+	if (ptr)
+		heapCall("free",0,true);
+	__libc_free(ptr);
+}
+
+void *operator new(size_t size) {
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void *operator new(size_t size,const std::nothrow_t &) throw() {
+	return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size,const std::nothrow_t &) throw() {
+	return malloc(size ? size : 1);
+}
+
+void operator delete(void *ptr) throw() {
+	free(ptr);
+}
+
+void operator delete[](void *ptr) throw() {
+	free(ptr);
+}
+
+void operator delete(void *ptr,const std::nothrow_t &) throw() {
+	free(ptr);
+}
+
+void operator delete[](void *ptr,const std::nothrow_t &) throw() {
+	free(ptr);
+}
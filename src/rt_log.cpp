@@ -0,0 +1,282 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <debug.h>
+#include <mpsc_fifo.h>
+#include <rt.h>
+#include <rt_log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <pthread.h>
+#include <string>
+#include <time.h>
+
+#define RTLOG_SLOTS      256
+#define RTLOG_BATCH      16
+#define RTLOG_INTERVAL   10000000ll   // ns between drains of the ring
+#define RTLOG_RATE_LIMIT 100          // messages printed per second
+
+namespace {
+
+	MpscFifo *ring = 0;
+	std::atomic<size_t> dropped(0);
+
+	pthread_t thread;
+	bool running = false;
+	volatile bool finished = false;
+
+	const RTLog::arg_t *nextArg(const RTLog::record_t &r,size_t &n) {
+		if (n < r.nargs)
+			return &r.args[n++];
+		return 0;
+	}
+
+	long long asSigned(const RTLog::arg_t *a) {
+		if (!a) return 0;
+		switch (a->type) {
+			case RTLog::SIGNED:   return a->value.i;
+			case RTLog::UNSIGNED: return static_cast<long long>(a->value.u);
+			case RTLog::FLOATING: return static_cast<long long>(a->value.d);
+			default:              return static_cast<long long>(reinterpret_cast<size_t>(a->value.p));
+		}
+	}
+
+	unsigned long long asUnsigned(const RTLog::arg_t *a) {
+		if (!a) return 0;
+		unsigned long long v = static_cast<unsigned long long>(asSigned(a));
+		// printf would only see the original width of a narrower signed type
+		if (a->type == RTLog::SIGNED && a->size < sizeof(v))
+			v &= (1ull << (8*a->size))-1;
+		return v;
+	}
+
+	double asDouble(const RTLog::arg_t *a) {
+		if (!a) return 0.0;
+		switch (a->type) {
+			case RTLog::FLOATING: return a->value.d;
+			case RTLog::UNSIGNED: return static_cast<double>(a->value.u);
+			default:              return static_cast<double>(asSigned(a));
+		}
+	}
+
+	/*
+	 * Re-run each conversion of the format with the captured values. Length
+	 *   modifiers are replaced since every integer was widened when captured.
+	 */
+	std::string format(const RTLog::record_t &r) {
+		std::string out;
+		char spec[32], buffer[256];
+		size_t n = 0;
+
+		for (const char *c = r.fmt; *c; ++c) {
+			if (*c != '%') {
+				out += *c;
+				continue;
+			}
+			if (c[1] == '%') {
+				out += '%';
+				++c;
+				continue;
+			}
+
+			size_t len = 0;
+			spec[len++] = *c++;
+			for (; *c && strchr("-+ #0123456789.*",*c); ++c) {
+				if (*c == '*') {
+					// Only what fits is kept, the argument is used up anyway
+					const RTLog::arg_t *a = nextArg(r,n);
+					if (len < sizeof(spec)-8) {
+						size_t room = sizeof(spec)-8-len;
+						int written = snprintf(spec+len,room,"%lld",asSigned(a));
+						if (written > 0)
+							len += std::min(static_cast<size_t>(written),room-1);
+					}
+				} else if (len < sizeof(spec)-8)
+					spec[len++] = *c;
+			}
+			for (; *c && strchr("hlLqjzt",*c); ++c);
+			if (!*c)
+				break;
+
+			if (*c != 'n' && n < r.nargs && r.args[n].type == RTLog::UNKNOWN) {
+				nextArg(r,n);
+				out += "(?)";
+				continue;
+			}
+
+			// A conversion snprintf refuses, e.g. a huge width, prints nothing
+			buffer[0] = '\0';
+			switch (*c) {
+				case 'd': case 'i':
+					strcpy(spec+len,"lld");
+					spec[len+2] = *c;
+					snprintf(buffer,sizeof(buffer),spec,asSigned(nextArg(r,n)));
+					break;
+				case 'u': case 'o': case 'x': case 'X':
+					strcpy(spec+len,"llu");
+					spec[len+2] = *c;
+					snprintf(buffer,sizeof(buffer),spec,asUnsigned(nextArg(r,n)));
+					break;
+				case 'c':
+					strcpy(spec+len,"c");
+					snprintf(buffer,sizeof(buffer),spec,static_cast<int>(asSigned(nextArg(r,n))));
+					break;
+				case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+					spec[len] = *c;
+					spec[len+1] = '\0';
+					snprintf(buffer,sizeof(buffer),spec,asDouble(nextArg(r,n)));
+					break;
+				case 's': {
+					const RTLog::arg_t *a = nextArg(r,n);
+					strcpy(spec+len,"s");
+					snprintf(buffer,sizeof(buffer),spec,(a && a->type == RTLog::STRING) ? r.text+a->value.offset : "(?)");
+					break;
+				}
+				case 'p': {
+					const RTLog::arg_t *a = nextArg(r,n);
+					strcpy(spec+len,"p");
+					snprintf(buffer,sizeof(buffer),spec,a ? a->value.p : 0);
+					break;
+				}
+				default: // %n and anything unknown is dropped
+					nextArg(r,n);
+			}
+			out += buffer;
+		}
+
+		return out;
+	}
+
+	class Writer {
+
+		public:
+
+			Writer(void)
+				: windowStart(0), printed(0), suppressed(0), reportedDrops(0) {};
+
+			void drain(void) {
+				RTLog::record_t records[RTLOG_BATCH];
+				size_t count;
+
+				while ((count = ring->read(records,RTLOG_BATCH))) {
+					for (size_t i = 0; i < count; ++i)
+						print(records[i]);
+				}
+
+				flushCounters(RT::OS::getTime());
+			}
+
+		private:
+
+			void print(const RTLog::record_t &r) {
+				if (r.time-windowStart >= 1000000000ll)
+					flushCounters(r.time);
+
+				if (printed >= RTLOG_RATE_LIMIT) {
+					++suppressed;
+					return;
+				}
+				++printed;
+
+				fprintf(stderr,"%s:%d:%s",r.file,r.line,format(r).c_str());
+			}
+
+			void flushCounters(long long now) {
+				if (now-windowStart < 1000000000ll)
+					return;
+
+				if (suppressed)
+					fprintf(stderr,"RTLog : %lu realtime messages suppressed by rate limit\n",static_cast<unsigned long>(suppressed));
+
+				size_t drops = dropped.load(std::memory_order_relaxed);
+				if (drops != reportedDrops)
+					fprintf(stderr,"RTLog : %lu realtime messages lost, log ring full\n",static_cast<unsigned long>(drops-reportedDrops));
+				reportedDrops = drops;
+
+				windowStart = now;
+				printed = 0;
+				suppressed = 0;
+			}
+
+			long long windowStart;
+			size_t printed;
+			size_t suppressed;
+			size_t reportedDrops;
+
+	}; // class Writer
+
+	Writer writer;
+
+	void *bounce(void *) {
+		struct timespec ts = {
+			RTLOG_INTERVAL / 1000000000ll,
+			RTLOG_INTERVAL % 1000000000ll,
+		};
+
+		while (!finished) {
+			writer.drain();
+			while (nanosleep(&ts,0) < 0 && errno == EINTR);
+		}
+		writer.drain();
+
+		return 0;
+	}
+
+}; // namespace
+
+int RTLog::start(void) {
+	if (running)
+		return 0;
+
+	if (!ring) {
+		ring = new MpscFifo(sizeof(record_t),RTLOG_SLOTS,"RT log");
+		ring->setQuiet(true);
+	}
+
+	finished = false;
+	int retval = pthread_create(&thread,0,&::bounce,0);
+	if (retval) {
+		ERROR_MSG("RTLog::start : failed to create the log thread\n");
+		return retval;
+	}
+	running = true;
+
+	return 0;
+}
+
+void RTLog::stop(void) {
+	if (!running)
+		return;
+
+	finished = true;
+	pthread_join(thread,0);
+	running = false;
+}
+
+void RTLog::submit(record_t &r) {
+	r.time = RT::OS::getTime();
+	if (!ring || !ring->write(&r,sizeof(r)))
+		dropped.fetch_add(1,std::memory_order_relaxed);
+}
+
+size_t RTLog::getDropped(void) {
+	return dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,73 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Checks that string arguments of a realtime log message stay within the
+// record, however long they are, and that arguments of types without a
+// capture are still accounted for
+
+#include <rt_log.h>
+#include <stdio.h>
+#include <string>
+
+struct guarded_t {
+	RTLog::record_t record;
+	char guard[RTLOG_STRING_SIZE*4];
+};
+
+static int check(const char *what, bool ok)
+{
+	if (!ok)
+		fprintf(stderr, "rt_log_test: %s\n", what);
+	return ok ? 0 : 1;
+}
+
+int main(void)
+{
+	std::string name(RTLOG_STRING_SIZE-1, 'a');
+	std::string other(RTLOG_STRING_SIZE*2, 'b');
+
+	guarded_t g;
+	memset(g.guard, 'x', sizeof(g.guard));
+	g.record.nargs = 0;
+	g.record.textUsed = 0;
+	RTLog::packAll(g.record, name.c_str(), other.c_str(), other.c_str(), "tail", 42);
+
+	int failed = 0;
+	failed += check("text overflowed the record", g.record.textUsed <= RTLOG_STRING_SIZE);
+	for (size_t i = 0; i < sizeof(g.guard); ++i)
+		if (g.guard[i] != 'x') {
+			failed += check("bytes written past the record", false);
+			break;
+		}
+	failed += check("first string was not kept", name == g.record.text + g.record.args[0].value.offset);
+	for (int i = 1; i < 4; ++i) {
+		size_t offset = g.record.args[i].value.offset;
+		failed += check("string that didn't fit is not empty", offset < RTLOG_STRING_SIZE && !g.record.text[offset]);
+	}
+	failed += check("integer after the strings was lost", g.record.nargs == 5 && g.record.args[4].value.i == 42);
+
+	RTLog::record_t r;
+	r.nargs = 0;
+	r.textUsed = 0;
+	RTLog::packAll(r, name, 7);
+	failed += check("argument without a capture is not unknown", r.nargs == 2 && r.args[0].type == RTLog::UNKNOWN);
+	failed += check("integer after an unknown argument was lost", r.args[1].type == RTLog::SIGNED && r.args[1].value.i == 7);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+/*
+	 The Real-Time eXperiment Interface (RTXI)
+	 Copyright (C) 2011 Georgia Institute of Technology, University of Utah, Weill Cornell Medical College
+
+	 This program is free software: you can redistribute it and/or modify
+	 it under the terms of the GNU General Public License as published by
+	 the Free Software Foundation, either version 3 of the License, or
+	 (at your option) any later version.
+
+	 This program is distributed in the hope that it will be useful,
+	 but WITHOUT ANY WARRANTY; without even the implied warranty of
+	 MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	 GNU General Public License for more details.
+
+	 You should have received a copy of the GNU General Public License
+	 along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <debug.h>
+#include <rt_memory.h>
+
+#include <alloca.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+// Stack left untouched below the prefaulted part, for the frames of the caller
+#define STACK_MARGIN (16*1024)
+
+namespace {
+
+	size_t stackDepth = RTMEMORY_STACK_DEPTH;
+
+	size_t pageSize(void) {
+		static size_t size = sysconf(_SC_PAGESIZE);
+		return size;
+	}
+
+	/*
+	 * Bytes currently locked by this process, from the VmLck line of
+	 *   /proc/self/status.
+	 */
+	size_t lockedTotal(void) {
+		FILE *file = fopen("/proc/self/status","r");
+		if (!file)
+			return 0;
+
+		char line[128];
+		unsigned long kb = 0;
+		while (fgets(line,sizeof(line),file))
+			if (sscanf(line,"VmLck: %lu kB",&kb) == 1)
+				break;
+		fclose(file);
+
+		return kb*1024;
+	}
+
+	size_t residentBytes(char *start,size_t length) {
+		std::vector<unsigned char> vec((length+pageSize()-1)/pageSize());
+		if (mincore(start,length,&vec[0]))
+			return 0;
+
+		size_t pages = 0;
+		for (size_t i = 0; i < vec.size(); ++i)
+			if (vec[i] & 1)
+				++pages;
+
+		return pages*pageSize();
+	}
+
+	/*
+	 * Read every page, then mlock() the range. For writable private mappings
+	 *   the kernel breaks copy-on-write while locking, so BSS and data end up
+	 *   with private pages without this code writing to them.
+	 */
+	void lockRange(char *start,size_t length,RTMemory::region_stats_t &stats) {
+		for (size_t i = 0; i < length; i += pageSize())
+			static_cast<volatile char *>(start)[i];
+
+		stats.size += length;
+		if (!mlock(start,length))
+			stats.locked += length;
+		stats.resident += residentBytes(start,length);
+	}
+
+	__attribute__((noinline)) void touchStack(size_t depth) {
+		volatile char *p = static_cast<volatile char *>(alloca(depth));
+		for (size_t i = 0; i < depth; i += pageSize())
+			p[i] = 0;
+	}
+
+	struct find_image_t {
+		const struct link_map *map;
+		RTMemory::region_stats_t *stats;
+		bool found;
+	};
+
+	int lockImage(struct dl_phdr_info *info,size_t,void *param) {
+		find_image_t *image = reinterpret_cast<find_image_t *>(param);
+		if (info->dlpi_addr != image->map->l_addr || strcmp(info->dlpi_name,image->map->l_name))
+			return 0;
+
+		for (int i = 0; i < info->dlpi_phnum; ++i) {
+			const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+			if (phdr.p_type != PT_LOAD)
+				continue;
+
+			// p_memsz includes the BSS that follows the initialized data
+			uintptr_t start = (info->dlpi_addr+phdr.p_vaddr) & ~(pageSize()-1);
+			uintptr_t end = (info->dlpi_addr+phdr.p_vaddr+phdr.p_memsz+pageSize()-1) & ~(pageSize()-1);
+			lockRange(reinterpret_cast<char *>(start),end-start,*image->stats);
+		}
+
+		image->found = true;
+		return 1;
+	}
+
+}; // namespace
+
+void RTMemory::setStackDepth(size_t bytes) {
+	stackDepth = bytes;
+}
+
+size_t RTMemory::getStackDepth(void) {
+	return stackDepth;
+}
+
+void RTMemory::prefaultStack(region_stats_t &stats) {
+	memset(&stats,0,sizeof(stats));
+
+	pthread_attr_t attr;
+	void *base;
+	size_t size;
+
+	if (pthread_getattr_np(pthread_self(),&attr)) {
+		touchStack(stackDepth);
+		return;
+	}
+	pthread_attr_getstack(&attr,&base,&size);
+	pthread_attr_destroy(&attr);
+
+	// Never touch past the end of the stack, the guard page is right behind it
+	char *here = reinterpret_cast<char *>(&attr);
+	size_t room = here-reinterpret_cast<char *>(base);
+	size_t depth = stackDepth;
+	if (depth+STACK_MARGIN > room) {
+		depth = room > STACK_MARGIN ? room-STACK_MARGIN : 0;
+		ERROR_MSG("RTMemory::prefaultStack : only %lu of the requested %lu bytes of stack available\n",
+				static_cast<unsigned long>(depth),static_cast<unsigned long>(stackDepth));
+	}
+
+	checkBudget(depth,"the realtime stack");
+	touchStack(depth);
+
+	uintptr_t end = (reinterpret_cast<uintptr_t>(here)+pageSize()-1) & ~(pageSize()-1);
+	uintptr_t start = (reinterpret_cast<uintptr_t>(here)-depth) & ~(pageSize()-1);
+	lockRange(reinterpret_cast<char *>(start),end-start,stats);
+
+	if (stats.locked < stats.size || stats.resident < stats.size)
+		ERROR_MSG("RTMemory::prefaultStack : %lu of %lu bytes of stack locked, %lu resident\n",
+				static_cast<unsigned long>(stats.locked),static_cast<unsigned long>(stats.size),
+				static_cast<unsigned long>(stats.resident));
+}
+
+bool RTMemory::lockLibrary(void *handle,region_stats_t &stats) {
+	memset(&stats,0,sizeof(stats));
+
+	struct link_map *map;
+	if (dlinfo(handle,RTLD_DI_LINKMAP,&map)) {
+		ERROR_MSG("RTMemory::lockLibrary : %s\n",dlerror());
+		return false;
+	}
+
+	find_image_t image = { map, &stats, false };
+	dl_iterate_phdr(lockImage,&image);
+	if (!image.found) {
+		ERROR_MSG("RTMemory::lockLibrary : no loaded image for %s\n",map->l_name);
+		return false;
+	}
+
+	if (stats.locked < stats.size) {
+		checkBudget(stats.size-stats.locked,map->l_name);
+		ERROR_MSG("RTMemory::lockLibrary : only %lu of %lu bytes of %s locked\n",
+				static_cast<unsigned long>(stats.locked),static_cast<unsigned long>(stats.size),map->l_name);
+		return false;
+	}
+	if (stats.resident < stats.size)
+		ERROR_MSG("RTMemory::lockLibrary : only %lu of %lu bytes of %s resident\n",
+				static_cast<unsigned long>(stats.resident),static_cast<unsigned long>(stats.size),map->l_name);
+
+	return stats.resident == stats.size;
+}
+
+bool RTMemory::checkBudget(size_t size,const char *what) {
+	struct rlimit rlim;
+	if (getrlimit(RLIMIT_MEMLOCK,&rlim) || rlim.rlim_cur == RLIM_INFINITY)
+		return true;
+
+	size_t locked = lockedTotal();
+	if (locked+size <= rlim.rlim_cur)
+		return true;
+
+	ERROR_MSG("RTMemory : RLIMIT_MEMLOCK is %lu kB and %lu kB are already locked, "
+			"%lu kB more are needed for %s. Raise the limit (ulimit -l) or run as root.\n",
+			static_cast<unsigned long>(rlim.rlim_cur/1024),static_cast<unsigned long>(locked/1024),
+			static_cast<unsigned long>(size/1024),what);
+	return false;
+}
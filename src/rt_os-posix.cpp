@@ -42,7 +42,7 @@ int RT::OS::initiate(void) {
 	ERROR_MSG("***WARNING*** You are using the POSIX compatibility layer, RTXI is NOT running in realtime!!!\n");
 
 	if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
-		ERROR_MSG("RT::OS(POSIX)::initiate : failed to lock memory.\n");
+		ERROR_MSG("RT::OS(POSIX)::initiate : failed to lock memory, check RLIMIT_MEMLOCK (ulimit -l).\n");
 
 		/*
 		 * I don't think it is necessary to return an error in this case.
@@ -122,6 +122,10 @@ bool RT::OS::isRealtime(void) {
 	return false;
 }
 
+bool RT::OS::canSyscall(void) {
+	return true;
+}
+
 long long RT::OS::getTime(void) {
 	struct timeval tv;
 
@@ -174,6 +174,10 @@ bool RT::OS::isRealtime(void) {
 	return false;
 }
 
+bool RT::OS::canSyscall(void) {
+	return !isRealtime();
+}
+
 long long RT::OS::getTime(void) {
 	return rt_get_time_ns();
 }
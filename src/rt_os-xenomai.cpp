@@ -148,6 +148,10 @@ bool RT::OS::isRealtime(void) {
 	return false;
 }
 
+bool RT::OS::canSyscall(void) {
+	return !isRealtime();
+}
+
 long long RT::OS::getTime(void) {
 	return rt_timer_tsc2ns(rt_timer_tsc());
 }
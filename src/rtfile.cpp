@@ -24,9 +24,9 @@
 #include <cstdlib>
 #include <unistd.h>
 
-RTFile::RTFile(void):done(true), fd(-1), writing(false), fifo(1024*1024) {}
+RTFile::RTFile(void):done(true), fd(-1), writing(false), fifo(1024*1024,"RTFile") {}
 
-RTFile::RTFile(const std::string &name,int flags,mode_t mode):done(true), fd(-1), writing(false), fifo(1024*1024) {
+RTFile::RTFile(const std::string &name,int flags,mode_t mode):done(true), fd(-1), writing(false), fifo(1024*1024,"RTFile") {
 	open(name,flags,mode);
 }
 